@@ -0,0 +1,139 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <new>
+
+/**
+ * Fixed capacity ring of per time step activations, e.g. the hidden states or gate pre-activations a cell keeps for
+ * backpropagation through time. Each step is a rows x batch block and the blocks sit side by side in a single
+ * rows x (capacity * batch) row major buffer, so a run of consecutive steps is an ordinary strided matrix that one
+ * GEMM can consume.
+ *
+ * Memory is allocated once, aligned for the GEMM kernel, and reused across samples and batches. Once the ring is
+ * full every push overwrites the oldest step, so a store sized for a truncated BPTT window only ever holds that
+ * window.
+ *
+ * Activations are float unless stored in half precision for mixed precision training, e.g. LinearLib::BFloat16.
+ */
+template<typename T>
+struct BasicActivationStore {
+    static constexpr std::size_t ALIGNMENT = 64;
+
+    struct Release {
+        void operator()(T* memory) const {
+            ::operator delete[](memory, std::align_val_t(ALIGNMENT));
+        }
+    };
+
+    std::size_t rows;
+    std::size_t capacity;
+    std::size_t batch = 1;
+
+    // Steps pushed since the last reset, the store holds the last min(count, capacity) of them
+    std::size_t count = 0;
+
+    std::unique_ptr<T[], Release> data;
+    std::size_t allocated = 0;
+
+    BasicActivationStore(std::size_t const rows, std::size_t const capacity, std::size_t const batch = 1) :
+        rows(rows), capacity(capacity) {
+        reserve(batch);
+    }
+
+    BasicActivationStore(const BasicActivationStore& other) :
+        BasicActivationStore(other.rows, other.capacity, other.batch) {}
+
+    BasicActivationStore& operator=(const BasicActivationStore& other) {
+        assert(rows == other.rows && "Activation stores differ in shape");
+        resize(other.capacity);
+        reserve(other.batch);
+        return *this;
+    }
+
+    /**
+     * Changes the number of steps held, dropping every step and releasing the memory, which the next reserve
+     * allocates for the new capacity. Meant for configuration, not the training loop.
+     */
+    void resize(std::size_t const capacity) {
+        if (capacity != this->capacity) {
+            this->capacity = capacity;
+            data.reset();
+            allocated = 0;
+        }
+        count = 0;
+    }
+
+    /**
+     * Makes room for batches of up to the given size, the only call that may allocate.
+     */
+    void reserve(std::size_t const batch) {
+        const std::size_t size = rows * capacity * batch;
+        if (size > allocated) {
+            data.reset(static_cast<T*>(::operator new[](size * sizeof(T), std::align_val_t(ALIGNMENT))));
+            allocated = size;
+        }
+    }
+
+    /**
+     * Drops every step and switches to the given batch size, only allocating if it was not reserved up front.
+     */
+    void reset(std::size_t const batch) {
+        reserve(batch);
+        this->batch = batch;
+        count = 0;
+    }
+
+    // Distance between rows of a step block
+    [[nodiscard]] std::size_t ld() const {
+        return capacity * batch;
+    }
+
+    // Oldest step still held
+    [[nodiscard]] std::size_t first() const {
+        return count > capacity ? count - capacity : 0;
+    }
+
+    /**
+     * Appends n consecutive steps, which must not wrap around the end of the ring, and returns the first.
+     */
+    T* push(std::size_t const n = 1) {
+        const std::size_t slot = count % capacity;
+        assert(slot + n <= capacity && "Pushed steps wrap around the ring");
+        count += n;
+        return data.get() + slot * batch;
+    }
+
+    [[nodiscard]] T* at(std::size_t const step) {
+        assert(step >= first() && step < count && "Step is no longer or not yet held");
+        return data.get() + step % capacity * batch;
+    }
+
+    [[nodiscard]] const T* at(std::size_t const step) const {
+        assert(step >= first() && step < count && "Step is no longer or not yet held");
+        return data.get() + step % capacity * batch;
+    }
+
+    // Consecutive steps from step onwards that are adjacent in memory
+    [[nodiscard]] std::size_t run(std::size_t const step) const {
+        return capacity - step % capacity;
+    }
+
+    /**
+     * Splits n steps, starting at step a of x and step b of y, into the longest runs that are contiguous in both
+     * stores and calls fn(offset, length) for each, e.g. to issue one GEMM per run.
+     */
+    template<typename X, typename Y, typename Fn>
+    static void forEachRun(const BasicActivationStore<X>& x, std::size_t const a, const BasicActivationStore<Y>& y,
+                           std::size_t const b, std::size_t const n, Fn&& fn) {
+        for (std::size_t offset = 0; offset < n;) {
+            const std::size_t length = std::min({n - offset, x.run(a + offset), y.run(b + offset)});
+            fn(offset, length);
+            offset += length;
+        }
+    }
+};
+
+using ActivationStore = BasicActivationStore<float>;
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstddef>
+
+/**
+ * Number of calls into the global operator new since start up, counted by the replacement allocation functions in
+ * Allocations.cpp. Benchmarks diff this around a hot loop to prove it stays off the heap.
+ */
+std::size_t allocationCount();
@@ -0,0 +1,214 @@
+#pragma once
+
+#include "LinearLib/Arena.hpp"
+#include "LinearLib/Matrix.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <sstream>
+#include <string>
+
+/**
+ * Building blocks shared by the recurrent models. Batches are R x B matrices with one sample per column.
+ */
+namespace Cell {
+
+    inline float sigmoid(const float x) {
+        return 1.0f / (1.0f + std::exp(-x));
+    }
+
+    // Adds a column vector to every column of a rows x cols block with leading dimension ldx
+    inline void addBias(const std::size_t rows, const std::size_t cols, float* x, const std::size_t ldx,
+                        const float* bias) {
+        for (std::size_t i = 0; i < rows; i++) {
+            for (std::size_t j = 0; j < cols; j++) {
+                x[i * ldx + j] += bias[i];
+            }
+        }
+    }
+
+    // Adds a column vector to every column of a batch
+    template<std::size_t R, std::size_t B>
+    void addBias(LinearLib::Matrix<R, B, float>& x, const LinearLib::Matrix<R, 1, float>& bias) {
+        for (std::size_t i = 0; i < R; i++) {
+            for (std::size_t j = 0; j < B; j++) {
+                x[i][j] += bias[i][0];
+            }
+        }
+    }
+
+    // Accumulates the row sums of a rows x cols block with leading dimension ldx into res, x in float or half precision
+    template<typename T>
+    void sumColumns(const std::size_t rows, const std::size_t cols, const T* x, const std::size_t ldx, float* res) {
+        for (std::size_t i = 0; i < rows; i++) {
+            float sum = 0.0f;
+            for (std::size_t j = 0; j < cols; j++) {
+                sum += static_cast<float>(x[i * ldx + j]);
+            }
+            res[i] += sum;
+        }
+    }
+
+    // Accumulates the sum over the batch columns into a column vector
+    template<std::size_t R, std::size_t B>
+    void sumColumns(const LinearLib::Matrix<R, B, float>& x, LinearLib::Matrix<R, 1, float>& res) {
+        sumColumns(R, B, x.raw(), B, res.raw());
+    }
+
+    /**
+     * Layer normalisation of every column of a rows x cols block x, y = gamma * x_hat + beta with x_hat the column
+     * standardised over its rows. x_hat and y share the leading dimension ld, and the reciprocal standard deviation of
+     * each column is written to the row rstd, which backward needs along with x_hat. The passes run along the rows,
+     * so they vectorise over the columns.
+     */
+    inline void layerNorm(const std::size_t rows, const std::size_t cols, const float* x, const std::size_t ldx,
+                          const float* gamma, const float* beta, float* x_hat, float* y, float* rstd,
+                          const std::size_t ld) {
+        constexpr float epsilon = 1e-5f;
+        const float scale = 1.0f / static_cast<float>(rows);
+
+        // The mean, then the variance, accumulate in rstd
+        std::fill_n(rstd, cols, 0.0f);
+        for (std::size_t i = 0; i < rows; i++) {
+            for (std::size_t j = 0; j < cols; j++) {
+                rstd[j] += x[i * ldx + j] * scale;
+            }
+        }
+
+        for (std::size_t i = 0; i < rows; i++) {
+            for (std::size_t j = 0; j < cols; j++) {
+                x_hat[i * ld + j] = x[i * ldx + j] - rstd[j];
+            }
+        }
+
+        std::fill_n(rstd, cols, 0.0f);
+        for (std::size_t i = 0; i < rows; i++) {
+            for (std::size_t j = 0; j < cols; j++) {
+                rstd[j] += x_hat[i * ld + j] * x_hat[i * ld + j] * scale;
+            }
+        }
+
+        for (std::size_t j = 0; j < cols; j++) {
+            rstd[j] = 1.0f / std::sqrt(rstd[j] + epsilon);
+        }
+
+        for (std::size_t i = 0; i < rows; i++) {
+            for (std::size_t j = 0; j < cols; j++) {
+                x_hat[i * ld + j] *= rstd[j];
+                y[i * ld + j] = gamma[i] * x_hat[i * ld + j] + beta[i];
+            }
+        }
+    }
+
+    /**
+     * Backpropagates the gradient d_y of layerNorm, accumulating the input gradient into d_x and the gradients of
+     * gamma and beta into d_gamma and d_beta. Takes two rows of scratch from the current arena.
+     */
+    inline void layerNormBackward(const std::size_t rows, const std::size_t cols, const float* d_y,
+                                  const std::size_t lddy, const float* gamma, const float* x_hat, const float* rstd,
+                                  const std::size_t ld, float* d_x, const std::size_t lddx, float* d_gamma,
+                                  float* d_beta) {
+        LinearLib::Arena& arena = LinearLib::Arena::current();
+        LinearLib::Arena::Scope scope(arena);
+
+        const float scale = 1.0f / static_cast<float>(rows);
+
+        // Column means of gamma * d_y and of gamma * d_y * x_hat
+        float* mean = arena.allocate<float>(cols);
+        float* correlation = arena.allocate<float>(cols);
+        std::fill_n(mean, cols, 0.0f);
+        std::fill_n(correlation, cols, 0.0f);
+
+        for (std::size_t i = 0; i < rows; i++) {
+            float d_g = 0.0f;
+            float d_b = 0.0f;
+            for (std::size_t j = 0; j < cols; j++) {
+                const float d = d_y[i * lddy + j];
+                const float g = gamma[i] * d;
+                mean[j] += g * scale;
+                correlation[j] += g * x_hat[i * ld + j] * scale;
+                d_g += d * x_hat[i * ld + j];
+                d_b += d;
+            }
+            d_gamma[i] += d_g;
+            d_beta[i] += d_b;
+        }
+
+        for (std::size_t i = 0; i < rows; i++) {
+            for (std::size_t j = 0; j < cols; j++) {
+                d_x[i * lddx + j] += rstd[j] * (gamma[i] * d_y[i * lddy + j] - mean[j]
+                                                - x_hat[i * ld + j] * correlation[j]);
+            }
+        }
+    }
+
+    /**
+     * Largest checkpoint interval in [1, steps] whose activation memory, as given by bytes(interval), fits the
+     * budget. If none fits, the interval needing the least memory, which is near sqrt(steps).
+     */
+    template<typename Bytes>
+    std::size_t checkpointInterval(const std::size_t steps, const std::size_t budget, Bytes&& bytes) {
+        std::size_t least = 1;
+        for (std::size_t interval = steps; interval > 0; --interval) {
+            if (bytes(interval) <= budget) {
+                return interval;
+            }
+            if (bytes(interval) < bytes(least)) {
+                least = interval;
+            }
+        }
+        return least;
+    }
+
+    // Row major, one record per element
+    template<std::size_t R, std::size_t C>
+    void read(std::stringstream& stream, LinearLib::Matrix<R, C, float>& mat) {
+        std::string token;
+        for (std::size_t i = 0; i < R; i++) {
+            for (std::size_t j = 0; j < C; j++) {
+                std::getline(stream, token, '\x{1E}');
+                mat[i][j] = std::stof(token);
+            }
+        }
+    }
+
+    template<std::size_t R, std::size_t C>
+    void write(std::stringstream& stream, const LinearLib::Matrix<R, C, float>& mat) {
+        for (std::size_t i = 0; i < R; i++) {
+            for (std::size_t j = 0; j < C; j++) {
+                stream << mat[i][j] << "\x{1E}";
+            }
+        }
+    }
+
+    // Only the nonzero elements: their count, then the row major index and value of each, one record apiece
+    template<std::size_t R, std::size_t C>
+    void readSparse(std::stringstream& stream, LinearLib::Matrix<R, C, float>& mat) {
+        std::string token;
+        mat.fill(0.0f);
+
+        std::getline(stream, token, '\x{1E}');
+        const std::size_t count = std::stoul(token);
+
+        for (std::size_t k = 0; k < count; k++) {
+            std::getline(stream, token, '\x{1E}');
+            const std::size_t index = std::stoul(token);
+            assert(index < R * C && "Sparse index outside the matrix");
+
+            std::getline(stream, token, '\x{1E}');
+            mat.raw()[index] = std::stof(token);
+        }
+    }
+
+    template<std::size_t R, std::size_t C>
+    void writeSparse(std::stringstream& stream, const LinearLib::Matrix<R, C, float>& mat) {
+        const float* values = mat.raw();
+        stream << std::count_if(values, values + R * C, [](const float v) { return v != 0.0f; }) << "\x{1E}";
+
+        for (std::size_t k = 0; k < R * C; k++) {
+            if (values[k] != 0.0f) {
+                stream << k << "\x{1E}" << values[k] << "\x{1E}";
+            }
+        }
+    }
+}
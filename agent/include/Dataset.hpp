@@ -0,0 +1,120 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <concepts>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <random>
+#include <vector>
+
+/**
+ * Indexable windows of samples, e.g. a vector of Sample or a WindowDataset: window i yields step t of feature f as
+ * at(t, f) and label o as target(o).
+ */
+template<typename S>
+concept Windows = requires(const S& samples, const std::size_t i) {
+    { samples.size() } -> std::convertible_to<std::size_t>;
+    { samples[i].at(i, i) } -> std::convertible_to<float>;
+    { samples[i].target(i) } -> std::convertible_to<float>;
+};
+
+/**
+ * Sliding windows over one series, which is stored once and never copied into the windows. The series is a row
+ * major table of length steps by columns, e.g. several indicators per trading day, in one aligned buffer. Window k
+ * is I consecutive steps of the selected feature columns, labelled with the target column the given horizons after
+ * its last step; windows start stride steps apart.
+ *
+ * A window is a view, see Window, so the memory is that of the series plus one index per window instead of I * F
+ * values per window. Shuffling and splitting permute and cut the indices only, and the parts of a split share the
+ * series. Like a vector of Sample, it can be handed to Environment for training and validation.
+ */
+template<std::size_t I, std::size_t O, std::size_t F = 1>
+struct WindowDataset {
+    static constexpr std::size_t ALIGNMENT = 64;
+
+    struct Release {
+        void operator()(float* memory) const {
+            ::operator delete[](memory, std::align_val_t(ALIGNMENT));
+        }
+    };
+
+    // One window read in place from the series, with the accessors of Sample
+    struct Window {
+        const WindowDataset* dataset;
+        std::size_t start;
+
+        // Feature f of step t of the window
+        [[nodiscard]] float at(const std::size_t t, const std::size_t f) const {
+            return dataset->value(start + t, dataset->features[f]);
+        }
+
+        // Label o, the target column horizons[o] steps after the last step of the window
+        [[nodiscard]] float target(const std::size_t o) const {
+            return dataset->value(start + I - 1 + dataset->horizons[o], dataset->column);
+        }
+    };
+
+    std::shared_ptr<const float[]> series;
+    std::size_t length;
+    std::size_t columns;
+
+    // Columns read as the F features of every step, and the column the labels are read from
+    std::array<std::size_t, F> features;
+    std::size_t column;
+
+    std::array<std::size_t, O> horizons;
+
+    // First step of every window, in the order they are visited
+    std::vector<std::size_t> starts;
+
+    /**
+     * Copies the length x columns series once into an aligned buffer and indexes every window that fits, one every
+     * stride steps, in order.
+     */
+    WindowDataset(const float* values, const std::size_t length, const std::size_t columns,
+                  const std::array<std::size_t, F>& features, const std::size_t column,
+                  const std::array<std::size_t, O>& horizons, const std::size_t stride = 1) :
+        length(length), columns(columns), features(features), column(column), horizons(horizons) {
+        assert(stride > 0 && "Windows must advance");
+        assert(std::all_of(features.begin(), features.end(), [&](const std::size_t f) { return f < columns; })
+               && column < columns && "Column outside the series");
+
+        float* buffer = static_cast<float*>(::operator new[](length * columns * sizeof(float),
+                                                              std::align_val_t(ALIGNMENT)));
+        std::copy_n(values, length * columns, buffer);
+        series = std::shared_ptr<const float[]>(buffer, Release());
+
+        // A window needs its I steps and the furthest label after them
+        const std::size_t span = I + *std::max_element(horizons.begin(), horizons.end());
+        for (std::size_t start = 0; start + span <= length; start += stride) {
+            starts.push_back(start);
+        }
+    }
+
+    [[nodiscard]] float value(const std::size_t step, const std::size_t col) const {
+        return series[step * columns + col];
+    }
+
+    [[nodiscard]] std::size_t size() const {
+        return starts.size();
+    }
+
+    [[nodiscard]] Window operator[](const std::size_t i) const {
+        return Window{this, starts[i]};
+    }
+
+    // Permutes the order of the windows, the series stays where it is
+    void shuffle(const unsigned int seed) {
+        std::shuffle(starts.begin(), starts.end(), std::default_random_engine(seed));
+    }
+
+    // The windows from first to last in the current order, sharing the series
+    [[nodiscard]] WindowDataset slice(const std::size_t first, const std::size_t last) const {
+        WindowDataset res = *this;
+        res.starts.assign(starts.begin() + first, starts.begin() + last);
+        return res;
+    }
+};
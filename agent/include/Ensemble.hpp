@@ -0,0 +1,247 @@
+#pragma once
+
+#include "Environment.hpp"
+#include "LinearLib/Arena.hpp"
+#include "LinearLib/Gemm.hpp"
+#include "LinearLib/Matrix.hpp"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <cmath>
+
+/**
+ * K copies of a model trained from different seeds, whose forecasts are averaged. Forecasts of a single model vary
+ * with its initialisation; the mean of the members is steadier, and their spread shows how much to trust it.
+ *
+ * Members train concurrently, one thread per core, each in its own Environment with its own arena, reading the same
+ * samples. With a core per member the ensemble therefore trains in about the wall time of one model.
+ *
+ * For RNN members, predict() stacks the input weights of all members into one K * H x F matrix, so the input
+ * projections of every member and step are a single GEMM and the tanh of all members one pass per step. Only the
+ * recurrent products, which read each member's own state, stay separate.
+ */
+template<std::size_t K, std::size_t I, std::size_t H, std::size_t O, std::size_t B = 1, std::size_t F = 1,
+         template<std::size_t, std::size_t, std::size_t, std::size_t> class Model = RNN,
+         typename Objective = Loss::SquaredError>
+struct Ensemble {
+    static_assert(K > 0, "An ensemble needs at least one member");
+
+    using Member = Environment<I, H, O, B, F, Model, Objective>;
+
+    static constexpr std::size_t TARGETS = Member::TARGETS;
+    static constexpr bool STACKED = std::is_same_v<Model<I, H, O, F>, RNN<I, H, O, F>>;
+
+    // Mean of the members' outputs and their standard deviation across members
+    struct Forecast {
+        LinearLib::Matrix<O, 1, float> mean;
+        LinearLib::Matrix<O, 1, float> spread;
+    };
+
+    std::vector<std::unique_ptr<Member>> members;
+
+    // Input weights and biases of every member stacked in member order, rebuilt by stack() after training
+    std::vector<float> w_i_h;
+    std::vector<float> b_i_h;
+
+    LinearLib::Arena arena;
+
+    // Progress of training and validation, where the members' logs are collected once they are done
+    std::ostream* log = &std::cout;
+
+    // Members are seeded seed, seed + stride, ...; a stride past the seeds one model draws keeps them apart
+    explicit Ensemble(const unsigned int nEpochs, const int patience = 20, const int seed = 42,
+                      const int stride = 101) {
+        for (std::size_t k = 0; k < K; k++) {
+            const int memberSeed = seed + static_cast<int>(k) * stride;
+            members.push_back(std::make_unique<Member>(nEpochs, patience, memberSeed));
+
+            // Members save every epoch side by side, so each file names its member and seed
+            members[k]->name = std::format("model_member{}_seed{}", k, memberSeed);
+        }
+        stack();
+    }
+
+    /**
+     * Trains every member on the same samples, as many at once as there are cores. Each member's progress is
+     * buffered and printed once all are done, in member order.
+     */
+    template<Windows Samples>
+    void train(const Samples& input) {
+        std::vector<std::ostringstream> logs(K);
+        for (std::size_t k = 0; k < K; k++) {
+            members[k]->log = &logs[k];
+        }
+
+        std::atomic<std::size_t> next = 0;
+        const auto work = [&] {
+            for (std::size_t k; (k = next.fetch_add(1, std::memory_order_relaxed)) < K;) {
+                members[k]->train(input);
+            }
+        };
+
+        {
+            const std::size_t threads = std::clamp<std::size_t>(std::thread::hardware_concurrency(), 1, K);
+            std::vector<std::jthread> workers;
+            for (std::size_t t = 1; t < threads; t++) {
+                workers.emplace_back(work);
+            }
+            work();
+        }
+
+        for (std::size_t k = 0; k < K; k++) {
+            *log << "Member " << k << " (seed " << members[k]->seed << ")" << std::endl << logs[k].str();
+            members[k]->log = log;
+        }
+
+        stack();
+    }
+
+    // Gathers the input weights and biases of the members into the stacked copies predict() multiplies with
+    void stack() {
+        if constexpr (STACKED) {
+            w_i_h.resize(K * H * F);
+            b_i_h.resize(K * H);
+
+            for (std::size_t k = 0; k < K; k++) {
+                const auto& model = members[k]->model;
+                std::copy_n(model.w_i_h().raw(), H * F, w_i_h.data() + k * H * F);
+                std::copy_n(model.b_i_h().raw(), H, b_i_h.data() + k * H);
+            }
+        }
+    }
+
+    /**
+     * Forecasts a window with every member and returns the mean and the spread of their outputs.
+     */
+    Forecast predict(const LinearLib::Matrix<I, F, float>& input) {
+        LinearLib::Arena::Scope scope(arena);
+
+        // Outputs of member k in row k
+        float* y = arena.allocate<float>(K * O);
+
+        if constexpr (STACKED) {
+            auto& x = arena.make<LinearLib::Matrix<F, I, float>>();
+            input.transpose(x);
+
+            // Pre-activations of every member and step, member k in row block k, step t in column t
+            float* pre = arena.allocate<float>(K * H * I);
+            float* h = arena.allocate<float>(K * H);
+
+            LinearLib::gemm(false, false, K * H, I, F, w_i_h.data(), F, x.raw(), I, 0.0f, pre, I);
+
+            for (std::size_t t = 0; t < I; t++) {
+                // h_0 is zero, so the first step has no recurrent term
+                if (t > 0) {
+                    for (std::size_t k = 0; k < K; k++) {
+                        LinearLib::gemm(false, false, H, 1, H, members[k]->model.w_h_h().raw(), H, h + k * H, 1,
+                                        1.0f, pre + k * H * I + t, I);
+                    }
+                }
+
+                for (std::size_t i = 0; i < K * H; i++) {
+                    h[i] = std::tanh(pre[i * I + t] + b_i_h[i]);
+                }
+            }
+
+            for (std::size_t k = 0; k < K; k++) {
+                const auto& model = members[k]->model;
+                LinearLib::gemm(false, false, O, 1, H, model.w_h_o().raw(), H, h + k * H, 1, 0.0f, y + k * O, 1);
+                for (std::size_t o = 0; o < O; o++) {
+                    y[k * O + o] += model.b_h_o()[o][0];
+                }
+            }
+        } else {
+            for (std::size_t k = 0; k < K; k++) {
+                const LinearLib::Matrix<O, 1, float> member = members[k]->predict(input);
+                std::copy_n(member.raw(), O, y + k * O);
+            }
+        }
+
+        Forecast res;
+        for (std::size_t o = 0; o < O; o++) {
+            float mean = 0.0f;
+            for (std::size_t k = 0; k < K; k++) {
+                mean += y[k * O + o];
+            }
+            mean /= static_cast<float>(K);
+
+            float variance = 0.0f;
+            for (std::size_t k = 0; k < K; k++) {
+                variance += (y[k * O + o] - mean) * (y[k * O + o] - mean);
+            }
+
+            res.mean[o][0] = mean;
+            res.spread[o][0] = K > 1 ? std::sqrt(variance / static_cast<float>(K - 1)) : 0.0f;
+        }
+
+        return res;
+    }
+
+    /**
+     * Scores every member and the mean of their outputs on the given samples, in batches of B.
+     */
+    template<Windows Samples>
+    void validate(const Samples& input) {
+
+        *log << "Beginning validating..." << std::endl;
+
+        std::vector<float> losses(K, 0.0f);
+        float loss = 0.0f;
+        LinearLib::Matrix<TARGETS, 1, float> targets = LinearLib::Matrix<TARGETS, 1, float>::zeros();
+
+        for (std::size_t j = 0; j < input.size(); j += B) {
+            LinearLib::Arena::Scope scope(arena);
+
+            const std::size_t count = std::min(B, input.size() - j);
+
+            auto& x = arena.make<LinearLib::Matrix<F, I * B, float>>();
+            auto& labels = arena.make<LinearLib::Matrix<TARGETS, B, float>>();
+            auto& mean = arena.make<LinearLib::Matrix<O, B, float>>();
+            auto& d_y = arena.make<LinearLib::Matrix<O, B, float>>();
+            x.fill(0.0f);
+            mean.fill(0.0f);
+
+            Member::batch(input, j, count, x);
+            for (std::size_t b = 0; b < count; b++) {
+                for (std::size_t t = 0; t < TARGETS; t++) {
+                    labels[t][b] = input[j + b].target(t);
+                }
+            }
+
+            for (std::size_t k = 0; k < K; k++) {
+                Member& member = *members[k];
+                LinearLib::Arena::Scope inner(member.arena);
+
+                const LinearLib::Matrix<O, B, float> y = member.model.template forward<B>(x);
+                member.model.clearHistory();
+
+                losses[k] += Objective::template evaluate<O>(count, B, y.raw(), labels.raw(), d_y.raw());
+                for (std::size_t o = 0; o < O; o++) {
+                    for (std::size_t b = 0; b < B; b++) {
+                        mean[o][b] += y[o][b] / static_cast<float>(K);
+                    }
+                }
+            }
+
+            loss += Objective::template evaluate<O>(count, B, mean.raw(), labels.raw(), d_y.raw(), targets.raw());
+        }
+
+        const auto samples = static_cast<float>(input.size());
+        for (std::size_t k = 0; k < K; k++) {
+            *log << "Member " << k << " Loss: " << losses[k] / samples << std::endl;
+        }
+        *log << "Ensemble Value Loss: " << loss << " Loss: " << loss / samples << std::endl;
+
+        if constexpr (TARGETS > 1) {
+            for (std::size_t t = 0; t < TARGETS; t++) {
+                *log << "Target " << t << " Loss: " << targets[t][0] / samples << std::endl;
+            }
+        }
+
+        *log << "Validation complete" << std::endl;
+    }
+};
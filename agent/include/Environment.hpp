@@ -4,130 +4,535 @@
 #include <filesystem>
 #include <fstream>
 #include <limits>
-
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <variant>
+
+#include "Allocations.hpp"
+#include "Dataset.hpp"
+#include "FrozenRNN.hpp"
+#include "GRU.hpp"
+#include "LSTM.hpp"
+#include "Loss.hpp"
+#include "MGU.hpp"
+#include "Pruning.hpp"
 #include "RNN.hpp"
+#include "Session.hpp"
+#include "StackedRNN.hpp"
+#include "TCN.hpp"
+#include "Transformer.hpp"
 
-template<std::size_t I, std::size_t O>
+// A window of I time steps with F features each, one row per step
+template<std::size_t I, std::size_t O, std::size_t F = 1>
 struct Sample {
-    LinearLib::Matrix<I, 1, float> input;
+    LinearLib::Matrix<I, F, float> input;
     LinearLib::Matrix<O, 1, float> label;
 
-    Sample(LinearLib::Matrix<I, 1, float> input, LinearLib::Matrix<O, 1, float> label) : input(input), label(label) {}
+    Sample(LinearLib::Matrix<I, F, float> input, LinearLib::Matrix<O, 1, float> label) : input(input), label(label) {}
+
+    [[nodiscard]] float at(const std::size_t t, const std::size_t f) const {
+        return input[t][f];
+    }
+
+    [[nodiscard]] float target(const std::size_t o) const {
+        return label[o][0];
+    }
 };
 
-template<std::size_t I, std::size_t H, std::size_t O>
+/**
+ * Trains and evaluates a model on windows of I observations of F features, feeding it minibatches of B samples at
+ * a time. The model is any model with the interface of RNN, e.g. the LSTM, GRU, MGU, StackedRNN, TCN or Transformer.
+ *
+ * The model's O outputs are trained against the labels of the samples with the given objective, see Loss. Squared
+ * error fits a point forecast per label, the quantile and Gaussian objectives a distribution per label out of the
+ * same single forward pass.
+ *
+ * Samples are any Windows, the materialised Sample or the windows of a WindowDataset read in place from the series.
+ */
+template<std::size_t I, std::size_t H, std::size_t O, std::size_t B = 1, std::size_t F = 1,
+         template<std::size_t, std::size_t, std::size_t, std::size_t> class Model = RNN,
+         typename Objective = Loss::SquaredError>
 struct Environment {
+    // Labels per sample, e.g. one per horizon
+    static constexpr std::size_t TARGETS = Objective::template TARGETS<O>;
+
     unsigned int nEpochs;
     unsigned int patience;
     unsigned int currentEpoch = 0;
     int seed;
-    RNN<I, H, O> model = RNN<I, H, O>(0.05f, 10.0f);
+    Model<I, H, O, F> model = Model<I, H, O, F>(0.05f, 10.0f);
+
+    // Progress of training, saving and validation, e.g. a buffer per member when several train at once
+    std::ostream* log = &std::cout;
+
+    // Start of the names of the files save() writes, telling apart e.g. the members of an ensemble
+    std::string name = "model";
+
+    // Backs the per-batch temporaries of the model, rewound after every step
+    LinearLib::Arena arena;
 
-    explicit Environment(const unsigned int nEpochs, const int patience = 20, const int seed = 42) {
+    // Whether the model can be pruned and written in sparse form, as RNN can
+    static constexpr bool PRUNABLE = requires(Model<I, H, O, F>& m) {
+        m.prune(0.0f, 0.0f);
+        m.serialize(true);
+    };
+
+    /**
+     * Gradual magnitude pruning over the epochs of train(); unset trains dense. Only for models that can be pruned,
+     * for any other the schedule is an empty type, so assigning a Pruning fails to compile.
+     */
+    std::optional<std::conditional_t<PRUNABLE, Pruning, std::monostate>> pruning;
+
+    explicit Environment(const unsigned int nEpochs, const int patience = 20, const int seed = 42) :
+        model(0.05f, 10.0f, seed) {
         this->nEpochs = nEpochs;
         this->patience = patience;
         this->seed = seed;
+
+        model.template reserve<B>();
     }
 
-    void train(const std::vector<Sample<I, O>>& input) {
+    /**
+     * Checkpoints BPTT every interval steps of a window, see the model's checkpoint(). An interval of 0 picks
+     * sqrt(I), which roughly minimises the activation memory.
+     */
+    void checkpoint(std::size_t interval) {
+        if (interval == 0) {
+            interval = static_cast<std::size_t>(std::ceil(std::sqrt(static_cast<double>(I))));
+        }
+        model.template checkpoint<B>(interval);
+    }
 
-        std::cout << "Beginning Training..." << std::endl;
+    // Picks the longest checkpoint interval whose activations for a batch fit in the given number of bytes
+    void checkpointBudget(const std::size_t bytes) {
+        model.template checkpoint<B>(Cell::checkpointInterval(I, bytes, [](const std::size_t interval) {
+            return Model<I, H, O, F>::template activationBytes<B>(interval);
+        }));
+    }
 
-        float minLoss = std::numeric_limits<float>::max();
-        unsigned int patienceCounter = 0;
+    /**
+     * Trains on the samples for up to nEpochs epochs, see fit(). With pruning set, the model is pruned to the
+     * scheduled sparsity at the start of every epoch and exported in sparse form once training ends.
+     */
+    template<Windows Samples>
+    void train(const Samples& input) {
+        fit([&] {
+            if constexpr (PRUNABLE) {
+                if (pruning && pruning->sparsity(currentEpoch) > 0.0f) {
+                    prune(pruning->sparsity(currentEpoch));
+                }
+            }
+            return epoch(input);
+        }, input.size());
 
-        for (uint i = 0; i < nEpochs; i++) {
-            currentEpoch++;
-            std::cout << "Starting Epoch " << currentEpoch << std::endl;
-            std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        if constexpr (PRUNABLE) {
+            if (pruning) {
+                saveSparse();
+            }
+        }
+    }
 
-            float loss = 0;
+    // Prunes the model to the given sparsity, layers at or past the pruning threshold switching to sparse kernels
+    void prune(const float sparsity) requires PRUNABLE {
+        model.prune(sparsity, pruning ? pruning->threshold : Pruning().threshold);
+        *log << "Pruned to " << sparsity * 100.0f << "% sparsity" << std::endl;
+    }
 
-            for (std::size_t j = 0; j < input.size(); j++) {
+    // One pass over the samples in minibatches of B, updating the model, and its summed loss
+    template<Windows Samples>
+    float epoch(const Samples& input) {
+        float loss = 0;
 
-                Sample<I, O> sample = input[j];
+        for (std::size_t j = 0; j < input.size(); j += B) {
+            loss += step(input, j, true);
+        }
 
-                LinearLib::Matrix<1, 1, float> y = model.forward(sample.input);
+        return loss;
+    }
 
-                loss += mse(sample, y);
+    // Summed loss of the model on the samples, without updating it or reporting
+    template<Windows Samples>
+    float evaluate(const Samples& input) {
+        float loss = 0;
 
-                const LinearLib::Matrix<1, 1, float> d_y = sample.label - y;
+        for (std::size_t j = 0; j < input.size(); j += B) {
+            loss += step(input, j, false);
+        }
 
-                model.backward(d_y);
+        return loss;
+    }
 
-                model.clearHistory();
-            }
+    /**
+     * Trains on one long contiguous series with truncated backpropagation through time, see series(). Each sample
+     * is a single step, its input the observation and its label the value to predict at that step.
+     */
+    void trainTruncated(const std::vector<Sample<1, TARGETS, F>>& input, const std::size_t k1, const std::size_t k2) {
+        fit([&] {
+            return series(input, k1, k2, true);
+        }, input.size());
+    }
+
+    /**
+     * Runs epochs of the given pass, which returns its summed loss, saving after each and stopping early once the
+     * loss has not improved for patience epochs.
+     */
+    template<typename Pass>
+    void fit(Pass&& pass, const std::size_t samples) {
+
+        *log << "Beginning Training..." << std::endl;
+
+        float minLoss = std::numeric_limits<float>::max();
+        unsigned int patienceCounter = 0;
+
+        for (uint i = 0; i < nEpochs; i++) {
+            currentEpoch++;
+            *log << "Starting Epoch " << currentEpoch << std::endl;
+            std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+
+            const float loss = pass();
 
             std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
-            std::cout << "Epoch " << currentEpoch << " Completed. Elapsed Time: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() << "ms Value Loss: " << loss << " Loss: " << loss / static_cast<float>(input.size()) << std::endl;
+            *log << "Epoch " << currentEpoch << " Completed. Elapsed Time: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() << "ms Value Loss: " << loss << " Loss: " << loss / static_cast<float>(samples) << std::endl;
             save();
 
             if (loss >= minLoss) {
                 patienceCounter++;
                 if (patienceCounter >= this->patience) {
-                    std::cout << "Patience exceeded, early stopping." << std::endl;
+                    *log << "Patience exceeded, early stopping." << std::endl;
                     break;
                 }
             } else {
                 minLoss = loss;
                 patienceCounter = 0;
-                std::cout << "New record." << std::endl;
+                *log << "New record." << std::endl;
             }
         }
 
-        std::cout << "Training complete" << std::endl;
+        *log << "Training complete" << std::endl;
     }
 
-    void validate(const std::vector<Sample<I, O>>& input) {
+    template<Windows Samples>
+    void validate(const Samples& input) {
 
-        std::cout << "Beginning validating..." << std::endl;
+        *log << "Beginning validating..." << std::endl;
 
         float loss = 0;
+        LinearLib::Matrix<TARGETS, 1, float> targets = LinearLib::Matrix<TARGETS, 1, float>::zeros();
+
+        for (std::size_t j = 0; j < input.size(); j += B) {
+            loss += step(input, j, false, &targets);
+        }
 
-        for (Sample sample: input) {
-            const LinearLib::Matrix<1, 1, float> y = model.forward(sample.input);
+        *log << "Value Loss: " << loss << " Loss: " << loss / static_cast<float>(input.size()) << std::endl;
 
-            loss += mse(sample, y);
+        // The share of every label, e.g. every forecast horizon
+        if constexpr (TARGETS > 1) {
+            for (std::size_t t = 0; t < TARGETS; t++) {
+                *log << "Target " << t << " Loss: " << targets[t][0] / static_cast<float>(input.size()) << std::endl;
+            }
         }
 
-        std::cout << "Value Loss: " << loss << " Loss: " << loss / static_cast<float>(input.size()) << std::endl;
+        *log << "Validation complete" << std::endl;
+    }
+
+    void validateTruncated(const std::vector<Sample<1, TARGETS, F>>& input, const std::size_t k1) {
 
-        std::cout << "Validation complete" << std::endl;
+        *log << "Beginning validating..." << std::endl;
+
+        const float loss = series(input, k1, k1, false);
+
+        *log << "Value Loss: " << loss << " Loss: " << loss / static_cast<float>(input.size()) << std::endl;
+
+        *log << "Validation complete" << std::endl;
     }
 
-    float predict(const LinearLib::Matrix<I, O, float> &input) {
-        return model.forward(input)[0][0];
+    // Forecasts every output of the window, e.g. every horizon, in a single forward pass
+    LinearLib::Matrix<O, 1, float> predict(const LinearLib::Matrix<I, F, float> &input) {
+        LinearLib::Arena::Scope scope(arena);
+
+        auto& x = arena.make<LinearLib::Matrix<F, I, float>>();
+        input.transpose(x);
+
+        const LinearLib::Matrix<O, 1, float> res = model.template forward<1>(x);
+
+        model.clearHistory();
+
+        return res;
     }
 
-    void save() {
-        std::cout << "Saving model..." << std::endl;
-        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    /**
+     * Opens a streaming session on the model that ingests one observation at a time, see Session. Fed the I steps
+     * of a window from a fresh state, it forecasts the same as predict() on that window.
+     */
+    Session<Model<I, H, O, F>> session() const {
+        return Session<Model<I, H, O, F>>(model);
+    }
 
-        std::filesystem::create_directories("data");
+    // Lays out the windows of count samples from start in the time major batch x, column t * B + b holds step t of b
+    template<Windows Samples>
+    static void batch(const Samples& input, const std::size_t start, const std::size_t count,
+                      LinearLib::Matrix<F, I * B, float>& x) {
+        for (std::size_t b = 0; b < count; b++) {
+            const auto& window = input[start + b];
+            for (std::size_t t = 0; t < I; t++) {
+                for (std::size_t f = 0; f < F; f++) {
+                    x[f][t * B + b] = window.at(t, f);
+                }
+            }
+        }
+    }
 
-        const auto filePath = std::format("data/model_{}_{}.qnt", currentEpoch, now.time_since_epoch().count());
+    /**
+     * Runs one minibatch of up to B samples starting at start, updating the model when learn is set, and returns
+     * its summed loss. A short final batch is zero padded, the padding is excluded from the loss and gradients.
+     * The loss of each label is also added to targets when given.
+     */
+    template<Windows Samples>
+    float step(const Samples& input, const std::size_t start, const bool learn,
+               LinearLib::Matrix<TARGETS, 1, float>* targets = nullptr) {
+        LinearLib::Arena::Scope scope(arena);
+
+        const std::size_t count = std::min(B, input.size() - start);
+
+        // Time major, column t * B + b holds step t of sample b
+        auto& x = arena.make<LinearLib::Matrix<F, I * B, float>>();
+        auto& labels = arena.make<LinearLib::Matrix<TARGETS, B, float>>();
+        auto& d_y = arena.make<LinearLib::Matrix<O, B, float>>();
+        x.fill(0.0f);
+        d_y.fill(0.0f);
+
+        batch(input, start, count, x);
+        for (std::size_t b = 0; b < count; b++) {
+            for (std::size_t t = 0; t < TARGETS; t++) {
+                labels[t][b] = input[start + b].target(t);
+            }
+        }
 
-        std::cout << "Outputting file: " << filePath.c_str() << std::endl;
+        const LinearLib::Matrix<O, B, float> y = model.template forward<B>(x);
 
-        std::ofstream file(filePath.c_str());
+        // Scores the samples and leaves the gradient of the padding zero
+        const float loss = Objective::template evaluate<O>(count, B, y.raw(), labels.raw(), d_y.raw(),
+                                                           targets != nullptr ? targets->raw() : nullptr);
 
-        if (!file.is_open()) {
-            std::cerr << "Failed to open file: " << filePath.c_str() << std::endl;
-            return;
+        if (learn) {
+            model.backward(x, d_y, count);
         }
 
-        file << model.serialize();
+        model.clearHistory();
 
-        file.close();
+        return loss;
+    }
+
+    /**
+     * One pass of truncated backpropagation through time, TBPTT(k1, k2), over a contiguous series, returning its
+     * summed loss. The series is cut into B streams run side by side, which carry their hidden state from chunk to
+     * chunk. Every k1 steps the outputs of the new steps are scored and, when learning, their error is propagated
+     * back through the last k2 steps, at most the model window I. Cost per step and activation memory therefore do
+     * not grow with the length of the series. Steps past the last multiple of B are dropped.
+     */
+    float series(const std::vector<Sample<1, TARGETS, F>>& input, const std::size_t k1, const std::size_t k2,
+                 const bool learn) {
+        assert(k1 > 0 && k1 <= k2 && k2 <= I && "Truncation needs 0 < k1 <= k2 <= I");
+
+        const std::size_t length = input.size() / B;
+
+        model.template begin<B>();
+
+        float loss = 0;
+
+        for (std::size_t start = 0; start < length; start += k1) {
+            LinearLib::Arena::Scope scope(arena);
+
+            const std::size_t steps = std::min(k1, length - start);
+
+            // Time major, column s * B + b holds step start + s of stream b
+            const std::size_t n = steps * B;
+            float* x = arena.allocate<float>(F * n);
+            float* y = arena.allocate<float>(O * n);
+            float* labels = arena.allocate<float>(TARGETS * n);
+            float* d_y = arena.allocate<float>(O * n);
+
+            for (std::size_t s = 0; s < steps; s++) {
+                for (std::size_t b = 0; b < B; b++) {
+                    const Sample<1, TARGETS, F>& sample = input[b * length + start + s];
+                    for (std::size_t f = 0; f < F; f++) {
+                        x[f * n + s * B + b] = sample.input[0][f];
+                    }
+                    for (std::size_t t = 0; t < TARGETS; t++) {
+                        labels[t * n + s * B + b] = sample.label[t][0];
+                    }
+                }
+            }
+
+            model.template advance<B>(x, steps, y);
+
+            loss += Objective::template evaluate<O>(n, n, y, labels, d_y);
+
+            if (learn) {
+                model.template truncatedBackward<B>(d_y, steps, k2, n);
+            }
+        }
+
+        model.clearHistory();
+
+        return loss;
+    }
+
+    /**
+     * Times training steps over the given samples without saving or early stopping, and reports the heap
+     * allocations and arena usage of the steady state. The first pass over the samples is a warm up, so one-off
+     * growth of the arena, history and kernel buffers is not counted. Fewer than B samples make one short,
+     * zero padded batch.
+     */
+    template<Windows Samples>
+    void benchmark(const Samples& input, const std::size_t steps) {
+        assert(input.size() > 0 && "Benchmarking needs samples");
+
+        // Starts of the full batches, or just 0 for a short one
+        const std::size_t starts = input.size() >= B ? input.size() - B + 1 : 1;
+
+        for (std::size_t j = 0; j < input.size(); j += B) {
+            step(input, j, true);
+        }
+
+        const std::size_t allocationsBefore = allocationCount();
+        const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+
+        for (std::size_t i = 0; i < steps; i++) {
+            step(input, i * B % starts, true);
+        }
+
+        const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        const std::size_t allocations = allocationCount() - allocationsBefore;
+        const double elapsed = std::chrono::duration<double, std::micro>(end - begin).count();
+
+        std::cout << "Batch " << B << " training step: " << elapsed / static_cast<double>(steps) << "us ("
+                  << elapsed / static_cast<double>(steps * B) << "us per sample), heap allocations: "
+                  << allocations << " over " << steps << " steps, arena peak: "
+                  << arena.stats.peak / 1024 << "KiB of " << arena.stats.capacity / 1024 << "KiB in "
+                  << arena.stats.blockAllocations << " block(s)" << std::endl;
+    }
+
+    // Whether the model can be frozen into an inference plan, as RNN can in any precision
+    static constexpr bool FREEZABLE = std::is_constructible_v<FrozenRNN<I, H, O, F, B>, const Model<I, H, O, F>&>;
+
+    /**
+     * Inference only plan of the model for batches of B windows, see FrozenRNN. It copies the weights, so later
+     * training does not change it.
+     */
+    FrozenRNN<I, H, O, F, B> freeze() const requires FREEZABLE {
+        return FrozenRNN<I, H, O, F, B>(model);
+    }
+
+    /**
+     * Times forecasts of batches of B windows through the model's forward pass and through its frozen plan, and
+     * reports the heap allocations of the plan. Fewer than B samples make one zero padded batch.
+     */
+    template<Windows Samples>
+    void benchmarkInference(const Samples& input, const std::size_t steps) requires FREEZABLE {
+        assert(input.size() > 0 && "Benchmarking needs samples");
+
+        LinearLib::Arena::Scope scope(arena);
+
+        // Windows per batch and the starts of the batches, just 0 for a short one
+        const std::size_t count = std::min(B, input.size());
+        const std::size_t starts = input.size() - count + 1;
+
+        auto& x = arena.make<LinearLib::Matrix<F, I * B, float>>();
+        x.fill(0.0f);
+
+        auto frozen = freeze();
+
+        const auto time = [&](auto&& forward) {
+            forward(0);
+
+            const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            for (std::size_t i = 0; i < steps; i++) {
+                forward(i * B % starts);
+            }
+            const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+            return std::chrono::duration<double, std::micro>(end - begin).count() / static_cast<double>(steps);
+        };
+
+        float checksum = 0.0f;
+
+        const double training = time([&](const std::size_t start) {
+            LinearLib::Arena::Scope inner(arena);
+            batch(input, start, count, x);
+            checksum += model.template forward<B>(x)[0][0];
+            model.clearHistory();
+        });
+
+        const std::size_t allocationsBefore = allocationCount();
+        const double frozenTime = time([&](const std::size_t start) {
+            batch(input, start, count, x);
+            checksum -= frozen.forward(x)[0][0];
+        });
+        const std::size_t allocations = allocationCount() - allocationsBefore;
+
+        std::cout << "Batch " << B << " inference: " << training << "us through the model, " << frozenTime
+                  << "us frozen, heap allocations: " << allocations << " over " << steps << " frozen calls, mismatch: "
+                  << std::abs(checksum) << std::endl;
     }
 
+    // Writes the model to data/ and returns the path of the file
+    std::string save() {
+        return write(".qnt", [&] { return model.serialize(); });
+    }
+
+    // Writes only the nonzero weights of a pruned model to data/, see load(), and returns the path of the file
+    std::string saveSparse() requires PRUNABLE {
+        return write(".sparse.qnt", [&] { return model.serialize(true); });
+    }
+
+    // Reads a model written by save() or, told by the suffix of the path, by saveSparse()
     void load(std::string const& path) {
         std::ifstream file;
         file.open(path.c_str());
-        this->model = RNN<I, H, O>::import(file.rdbuf());
+
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+
+        if constexpr (PRUNABLE) {
+            this->model = Model<I, H, O, F>::deserialize(buffer.str(), path.ends_with(".sparse.qnt"));
+        } else {
+            this->model = Model<I, H, O, F>::deserialize(buffer.str());
+        }
+    }
+
+    // Products issued by one training step, used to autotune the GEMM kernel
+    static std::vector<LinearLib::Autotune::Shape> gemmShapes() {
+        return Model<I, H, O, F>::template gemmShapes<B>();
     }
 
-    static float mse(const Sample<I, O>& sample, LinearLib::Matrix<O, 1, float> pred) {
-        return std::pow(sample.label[0][0] - pred[0][0], 2) / 2;
+    // Writes the output of serialize to a new file in data/ named after the model and epoch, and returns its path
+    template<typename Serialize>
+    std::string write(const std::string_view suffix, Serialize&& serialize) {
+        *log << "Saving model..." << std::endl;
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+        std::filesystem::create_directories("data");
+
+        const auto filePath = std::format("data/{}_{}_{}{}", name, currentEpoch, now.time_since_epoch().count(),
+                                          suffix);
+
+        *log << "Outputting file: " << filePath.c_str() << std::endl;
+
+        std::ofstream file(filePath.c_str());
+
+        if (!file.is_open()) {
+            std::cerr << "Failed to open file: " << filePath.c_str() << std::endl;
+            return filePath;
+        }
+
+        file << serialize();
+
+        file.close();
+
+        return filePath;
     }
 };
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "RNN.hpp"
+#include "LinearLib/Arena.hpp"
+#include "LinearLib/Gemm.hpp"
+#include "LinearLib/Matrix.hpp"
+#include <memory>
+#include <new>
+#include <vector>
+#include <cmath>
+
+/**
+ * Inference only plan of a trained RNN for batches of B windows, for serving where the weights never change. Freezing
+ * copies the weights out of the model and packs each into the panel layout of the GEMM kernel for the product it
+ * takes part in, so no call repacks them. Nothing is recorded for backward: the hidden state is overwritten step by
+ * step and the bias and tanh are one pass over the recurrent product.
+ *
+ * Every buffer a forward pass touches is planned at freeze time, laid out back to back in one aligned block, so
+ * forward() allocates nothing and costs its GEMMs and one activation pass per step. The plan is independent of the
+ * model it was frozen from.
+ */
+template<std::size_t I, std::size_t H, std::size_t O, std::size_t F = 1, std::size_t B = 1>
+struct FrozenRNN {
+    // Offsets into memory: input projections of every step, time major like the batch, the hidden state and the
+    // biases, each starting on a cache line
+    static constexpr std::size_t ALIGNMENT = LinearLib::Arena::ALIGNMENT / sizeof(float);
+
+    static constexpr std::size_t aligned(const std::size_t n) {
+        return (n + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    }
+
+    static constexpr std::size_t PROJECTIONS = 0;
+    static constexpr std::size_t HIDDEN = PROJECTIONS + aligned(H * I * B);
+    static constexpr std::size_t B_I_H = HIDDEN + aligned(H * B);
+    static constexpr std::size_t B_H_O = B_I_H + aligned(H);
+    static constexpr std::size_t SIZE = B_H_O + aligned(O);
+
+    struct Release {
+        void operator()(float* memory) const {
+            ::operator delete[](memory, std::align_val_t(LinearLib::Arena::ALIGNMENT));
+        }
+    };
+
+    LinearLib::PackedMatrix<float> w_i_h;
+    LinearLib::PackedMatrix<float> w_h_h;
+    LinearLib::PackedMatrix<float> w_h_o;
+
+    std::unique_ptr<float[], Release> memory;
+
+    // Freezes the float master weights, also of an RNN trained in mixed precision
+    template<typename Storage>
+    explicit FrozenRNN(const RNN<I, H, O, F, Storage>& model) :
+        w_i_h(LinearLib::pack(false, H, F, model.w_i_h().raw(), F, I * B)),
+        w_h_h(LinearLib::pack(false, H, H, model.w_h_h().raw(), H, B)),
+        w_h_o(LinearLib::pack(false, O, H, model.w_h_o().raw(), H, B)),
+        memory(static_cast<float*>(::operator new[](SIZE * sizeof(float),
+                                                     std::align_val_t(LinearLib::Arena::ALIGNMENT)))) {
+        std::copy_n(model.b_i_h().raw(), H, memory.get() + B_I_H);
+        std::copy_n(model.b_h_o().raw(), O, memory.get() + B_H_O);
+    }
+
+    /**
+     * Forecasts a batch of B windows laid out time major in x, the same as RNN::forward on the model frozen. Calls
+     * share the planned buffers, so a plan serves one thread at a time.
+     */
+    LinearLib::Matrix<O, B, float> forward(const LinearLib::Matrix<F, I * B, float>& x) {
+        float* projections = memory.get() + PROJECTIONS;
+        float* h = memory.get() + HIDDEN;
+        const float* b_i_h = memory.get() + B_I_H;
+        const float* b_h_o = memory.get() + B_H_O;
+
+        constexpr std::size_t ld = I * B;
+        LinearLib::gemm(w_i_h, I * B, x.raw(), I * B, 0.0f, projections, ld);
+
+        for (std::size_t t = 0; t < I; t++) {
+            float* pre = projections + t * B;
+
+            // h_0 is zero, so the first step has no recurrent term
+            if (t > 0) {
+                LinearLib::gemm(w_h_h, B, h, B, 1.0f, pre, ld);
+            }
+
+            for (std::size_t i = 0; i < H; i++) {
+                for (std::size_t b = 0; b < B; b++) {
+                    h[i * B + b] = std::tanh(pre[i * ld + b] + b_i_h[i]);
+                }
+            }
+        }
+
+        LinearLib::Matrix<O, B, float> y;
+        LinearLib::gemm(w_h_o, B, h, B, 0.0f, y.raw(), B);
+        for (std::size_t o = 0; o < O; o++) {
+            for (std::size_t b = 0; b < B; b++) {
+                y[o][b] += b_h_o[o];
+            }
+        }
+
+        return y;
+    }
+};
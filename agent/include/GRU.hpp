@@ -0,0 +1,375 @@
+#pragma once
+
+#include "ActivationStore.hpp"
+#include "Cell.hpp"
+#include "Optimizer.hpp"
+#include "Parameters.hpp"
+#include "LinearLib/Arena.hpp"
+#include "LinearLib/Autotune.hpp"
+#include "LinearLib/Matrix.hpp"
+#include <utility>
+#include <vector>
+#include <cmath>
+
+/**
+ * GRU over windows of I time steps with F features each, reading the output off the last hidden state:
+ *
+ *   r = sigmoid(W_xr x + b_xr + W_hr h + b_hr)
+ *   z = sigmoid(W_xz x + b_xz + W_hz h + b_hz)
+ *   n = tanh(W_xn x + b_xn + r * (W_hn h + b_hn))
+ *   h' = (1 - z) * n + z * h
+ *
+ * The reset, update and candidate weights are stacked into 3H row blocks of w_x and w_h, in that order, so each step
+ * is a single 3H x H by H x B GEMM followed by one fused pass. Batches use the same time major layout as RNN.
+ */
+template<std::size_t I, std::size_t H, std::size_t O, std::size_t F = 1>
+struct GRU {
+    static constexpr std::size_t GATES = 3;
+
+    // Offsets of the weights and biases in the flat parameter and gradient buffers
+    static constexpr std::size_t W_X = 0;
+    static constexpr std::size_t W_H = W_X + Parameters::padded(GATES * H * F);
+    static constexpr std::size_t B_X = W_H + Parameters::padded(GATES * H * H);
+    static constexpr std::size_t B_H = B_X + Parameters::padded(GATES * H);
+    static constexpr std::size_t W_H_O = B_H + Parameters::padded(GATES * H);
+    static constexpr std::size_t B_H_O = W_H_O + Parameters::padded(O * H);
+    static constexpr std::size_t PARAMETERS = B_H_O + Parameters::padded(O);
+
+    Parameters parameters = Parameters(PARAMETERS);
+
+    // Hidden states h_0 .. h_I of the last forward pass
+    ActivationStore states = ActivationStore(H, I + 1);
+
+    // Activated r, z and n of steps 1 .. I, and their recurrent candidate terms W_hn h + b_hn. Backward overwrites
+    // them with the input side gate gradients and the recurrent side candidate gradient.
+    ActivationStore gates = ActivationStore(GATES * H, I);
+    ActivationStore candidates = ActivationStore(H, I);
+
+    float learning_rate;
+    float clip;
+
+    // Update rule and its moments, plain SGD unless configured otherwise
+    Optimizer optimizer;
+    int seed;
+
+    GRU(LinearLib::Matrix<GATES * H, F, float> w_x, LinearLib::Matrix<GATES * H, H, float> w_h,
+        LinearLib::Matrix<GATES * H, 1, float> b_x, LinearLib::Matrix<GATES * H, 1, float> b_h,
+        LinearLib::Matrix<O, H, float> w_h_o, LinearLib::Matrix<O, 1, float> b_h_o, float learning_rate, float clip,
+        int seed = 42) {
+        this->w_x() = w_x;
+        this->w_h() = w_h;
+        this->b_x() = b_x;
+        this->b_h() = b_h;
+        this->w_h_o() = w_h_o;
+        this->b_h_o() = b_h_o;
+
+        this->learning_rate = learning_rate;
+        this->clip = clip;
+        this->seed = seed;
+    }
+
+    GRU(float learning_rate, float clip, int seed = 42) {
+        this->learning_rate = learning_rate;
+        this->clip = clip;
+        this->seed = seed;
+
+        const float bound = 1.0f / std::sqrt(static_cast<float>(H));
+
+        w_x() = LinearLib::Matrix<GATES * H, F, float>::random(-bound, bound, seed);
+        w_h() = LinearLib::Matrix<GATES * H, H, float>::random(-bound, bound, seed + 1);
+        w_h_o() = LinearLib::Matrix<O, H, float>::random(-bound, bound, seed + 2);
+    }
+
+    auto& w_x() { return parameters.template value<GATES * H, F>(W_X); }
+    auto& w_h() { return parameters.template value<GATES * H, H>(W_H); }
+    auto& b_x() { return parameters.template value<GATES * H, 1>(B_X); }
+    auto& b_h() { return parameters.template value<GATES * H, 1>(B_H); }
+    auto& w_h_o() { return parameters.template value<O, H>(W_H_O); }
+    auto& b_h_o() { return parameters.template value<O, 1>(B_H_O); }
+
+    const auto& w_x() const { return parameters.template value<GATES * H, F>(W_X); }
+    const auto& w_h() const { return parameters.template value<GATES * H, H>(W_H); }
+    const auto& b_x() const { return parameters.template value<GATES * H, 1>(B_X); }
+    const auto& b_h() const { return parameters.template value<GATES * H, 1>(B_H); }
+    const auto& w_h_o() const { return parameters.template value<O, H>(W_H_O); }
+    const auto& b_h_o() const { return parameters.template value<O, 1>(B_H_O); }
+
+    // Sizes the activation stores for batches of B, after which training never allocates
+    template<std::size_t B>
+    void reserve() {
+        states.reserve(B);
+        gates.reserve(B);
+        candidates.reserve(B);
+    }
+
+    // Products issued by one training step on a batch of B, used to autotune the GEMM kernel for this model
+    template<std::size_t B>
+    static std::vector<LinearLib::Autotune::Shape> gemmShapes() {
+        return {{GATES * H, I * B, F}, {GATES * H, B, H}, {O, B, H}, {H, B, O}, {O, H, B}, {H, B, 2 * H},
+                {H, B, H}, {2 * H, H, I * B}, {H, H, I * B}, {GATES * H, F, I * B}};
+    }
+
+    template<std::size_t B>
+    LinearLib::Matrix<O, B, float> forward(const LinearLib::Matrix<F, I * B, float>& x) {
+
+        LinearLib::Arena& arena = LinearLib::Arena::current();
+
+        states.reset(B);
+        gates.reset(B);
+        candidates.reset(B);
+
+        // Gates and candidates share their capacity and so their leading dimension
+        const std::size_t ls = states.ld();
+        const std::size_t lg = gates.ld();
+
+        // Input projections of every step in one GEMM
+        float* u = gates.push(I);
+        LinearLib::gemm(false, false, GATES * H, I * B, F, this->w_x().raw(), F, x.raw(), I * B, 0.0f, u, lg);
+        candidates.push(I);
+
+        float* h_0 = states.push();
+        for (std::size_t j = 0; j < H; j++) {
+            for (std::size_t k = 0; k < B; k++) {
+                h_0[j * ls + k] = 0.0f;
+            }
+        }
+
+        // Recurrent projections of the current step, kept apart since r only gates the candidate's share
+        auto& v = arena.make<LinearLib::Matrix<GATES * H, B, float>>();
+
+        for (std::size_t t = 0; t < I; t++) {
+            float* a = gates.at(t);
+            float* hn = candidates.at(t);
+
+            if (t > 0) {
+                LinearLib::strassenGemm(false, false, GATES * H, B, H, this->w_h().raw(), H, states.at(t), ls, 0.0f,
+                                        v.raw(), B);
+            } else {
+                v.fill(0.0f);
+            }
+
+            const float* h_prev = states.at(t);
+            float* h = states.push();
+
+            for (std::size_t j = 0; j < H; j++) {
+                float* reset = a + j * lg;
+                float* update = a + (H + j) * lg;
+                float* candidate = a + (2 * H + j) * lg;
+
+                for (std::size_t k = 0; k < B; k++) {
+                    reset[k] = Cell::sigmoid(reset[k] + this->b_x()[j][0] + v[j][k] + this->b_h()[j][0]);
+                    update[k] = Cell::sigmoid(update[k] + this->b_x()[H + j][0] + v[H + j][k] + this->b_h()[H + j][0]);
+
+                    hn[j * lg + k] = v[2 * H + j][k] + this->b_h()[2 * H + j][0];
+                    candidate[k] = std::tanh(candidate[k] + this->b_x()[2 * H + j][0] + reset[k] * hn[j * lg + k]);
+
+                    h[j * ls + k] = (1.0f - update[k]) * candidate[k] + update[k] * h_prev[j * ls + k];
+                }
+            }
+        }
+
+        LinearLib::Matrix<O, B, float> y;
+        LinearLib::gemm(false, false, O, B, H, this->w_h_o().raw(), H, states.at(I), ls, 0.0f, y.raw(), B);
+        Cell::addBias(y, this->b_h_o());
+
+        return y;
+    }
+
+    /**
+     * Backpropagation through time for the batch of the last forward, given its input x. Gradients are averaged
+     * over the first count columns, columns past count are padding and must have a zero d_y.
+     *
+     * The reset and update gradients are shared by both sides, only the candidate differs: the recurrent side sees
+     * it multiplied by r. Those rows are kept in candidates so the weight gradients remain GEMMs over the window.
+     */
+    template<std::size_t B>
+    void backward(const LinearLib::Matrix<F, I * B, float>& x, const LinearLib::Matrix<O, B, float>& d_y,
+                  const std::size_t count = B) {
+
+        LinearLib::Arena& arena = LinearLib::Arena::current();
+
+        const std::size_t ls = states.ld();
+        const std::size_t lg = gates.ld();
+
+        parameters.clearGradients();
+
+        auto& d_w_x = parameters.template gradient<GATES * H, F>(W_X);
+        auto& d_w_h = parameters.template gradient<GATES * H, H>(W_H);
+        auto& d_b_x = parameters.template gradient<GATES * H, 1>(B_X);
+        auto& d_b_h = parameters.template gradient<GATES * H, 1>(B_H);
+        auto& d_w_h_o = parameters.template gradient<O, H>(W_H_O);
+        auto& d_b_h_o = parameters.template gradient<O, 1>(B_H_O);
+
+        LinearLib::gemm(false, true, O, H, B, d_y.raw(), B, states.at(I), ls, 0.0f, d_w_h_o.raw(), H);
+        Cell::sumColumns(d_y, d_b_h_o);
+
+        auto* d_h = &arena.make<LinearLib::Matrix<H, B, float>>();
+        auto* d_h_prev = &arena.make<LinearLib::Matrix<H, B, float>>();
+        LinearLib::matmulTN(this->w_h_o(), d_y, *d_h);
+
+        // Backprop through time
+        for (std::size_t t = I; t > 0; --t) {
+            float* a = gates.at(t - 1);
+            float* hn = candidates.at(t - 1);
+            const float* h_prev = states.at(t - 1);
+
+            for (std::size_t j = 0; j < H; j++) {
+                float* reset = a + j * lg;
+                float* update = a + (H + j) * lg;
+                float* candidate = a + (2 * H + j) * lg;
+
+                for (std::size_t k = 0; k < B; k++) {
+                    const float dh = (*d_h)[j][k];
+
+                    const float d_candidate = dh * (1.0f - update[k]) * (1.0f - candidate[k] * candidate[k]);
+                    const float d_update = dh * (h_prev[j * ls + k] - candidate[k]) * update[k] * (1.0f - update[k]);
+                    const float d_reset = d_candidate * hn[j * lg + k] * reset[k] * (1.0f - reset[k]);
+
+                    (*d_h_prev)[j][k] = dh * update[k];
+
+                    hn[j * lg + k] = d_candidate * reset[k];
+                    reset[k] = d_reset;
+                    update[k] = d_update;
+                    candidate[k] = d_candidate;
+                }
+            }
+
+            if (t > 1) {
+                LinearLib::strassenGemm(true, false, H, B, 2 * H, this->w_h().raw(), H, a, lg, 1.0f,
+                                        d_h_prev->raw(), B);
+                LinearLib::strassenGemm(true, false, H, B, H, this->w_h().raw() + 2 * H * H, H, hn, lg, 1.0f,
+                                        d_h_prev->raw(), B);
+            }
+
+            std::swap(d_h, d_h_prev);
+        }
+
+        // A window fills every store from its first slot, so its steps are contiguous
+        const float* d_u = gates.at(0);
+        const float* d_v = candidates.at(0);
+
+        Cell::sumColumns(GATES * H, I * B, d_u, lg, d_b_x.raw());
+        Cell::sumColumns(2 * H, I * B, d_u, lg, d_b_h.raw());
+        Cell::sumColumns(H, I * B, d_v, lg, d_b_h.raw() + 2 * H);
+
+        LinearLib::gemm(false, true, GATES * H, F, I * B, d_u, lg, x.raw(), I * B, 0.0f, d_w_x.raw(), F);
+        LinearLib::strassenGemm(false, true, 2 * H, H, I * B, d_u, lg, states.at(0), ls, 0.0f, d_w_h.raw(), H);
+        LinearLib::strassenGemm(false, true, H, H, I * B, d_v, lg, states.at(0), ls, 0.0f, d_w_h.raw() + 2 * H * H, H);
+
+        // Average over the batch, clip and apply, one pass over the model
+        optimizer.step();
+        optimizer.update(0, parameters.values(), parameters.gradients(), PARAMETERS, 1.0f / static_cast<float>(count),
+                         this->clip, this->learning_rate);
+    }
+
+    // Hidden state of a single stream, carried from one observation to the next, see Session
+    struct State {
+        LinearLib::Matrix<H, 1, float> h = LinearLib::Matrix<H, 1, float>::zeros();
+    };
+
+    /**
+     * Advances a single stream by one observation, a single cell step from the carried state, and returns the
+     * output read off the new hidden state. The cost is O(H^2) whatever the window length I.
+     */
+    LinearLib::Matrix<O, 1, float> observe(State& state, const LinearLib::Matrix<F, 1, float>& x) const {
+        LinearLib::Matrix<GATES * H, 1, float> u;
+        LinearLib::Matrix<GATES * H, 1, float> v;
+        LinearLib::gemm(false, false, GATES * H, 1, F, this->w_x().raw(), F, x.raw(), 1, 0.0f, u.raw(), 1);
+        LinearLib::gemm(false, false, GATES * H, 1, H, this->w_h().raw(), H, state.h.raw(), 1, 0.0f, v.raw(), 1);
+
+        for (std::size_t j = 0; j < H; j++) {
+            const float reset = Cell::sigmoid(u[j][0] + this->b_x()[j][0] + v[j][0] + this->b_h()[j][0]);
+            const float update =
+                Cell::sigmoid(u[H + j][0] + this->b_x()[H + j][0] + v[H + j][0] + this->b_h()[H + j][0]);
+            const float hn = v[2 * H + j][0] + this->b_h()[2 * H + j][0];
+            const float candidate = std::tanh(u[2 * H + j][0] + this->b_x()[2 * H + j][0] + reset * hn);
+
+            state.h[j][0] = (1.0f - update) * candidate + update * state.h[j][0];
+        }
+
+        LinearLib::Matrix<O, 1, float> y;
+        LinearLib::gemm(false, false, O, 1, H, this->w_h_o().raw(), H, state.h.raw(), 1, 0.0f, y.raw(), 1);
+        Cell::addBias(y, this->b_h_o());
+
+        return y;
+    }
+
+    // Drops the stored activations, keeping their memory
+    void clearHistory() {
+        states.reset(states.batch);
+        gates.reset(gates.batch);
+        candidates.reset(candidates.batch);
+    }
+
+    static GRU deserialize(const std::string& serialized) {
+        std::stringstream stream(serialized);
+        std::string token;
+
+        std::getline(stream, token, '\x{1E}');
+        assert(token == std::to_string(I) && "Invalid input size!");
+
+        std::getline(stream, token, '\x{1E}');
+        assert(token == std::to_string(H) && "Invalid hidden size!");
+
+        std::getline(stream, token, '\x{1E}');
+        assert(token == std::to_string(O) && "Invalid output size!");
+
+        std::getline(stream, token, '\x{1E}');
+        assert(token == std::to_string(F) && "Invalid feature count!");
+
+        std::getline(stream, token, '\x{1E}');
+        float learning_rate = std::stof(token);
+
+        std::getline(stream, token, '\x{1E}');
+        float clip = std::stof(token);
+
+        std::getline(stream, token, '\x{1E}');
+        int seed = std::stoi(token);
+
+        LinearLib::Matrix<GATES * H, F, float> w_x;
+        Cell::read(stream, w_x);
+
+        LinearLib::Matrix<GATES * H, H, float> w_h;
+        Cell::read(stream, w_h);
+
+        LinearLib::Matrix<GATES * H, 1, float> b_x;
+        Cell::read(stream, b_x);
+
+        LinearLib::Matrix<GATES * H, 1, float> b_h;
+        Cell::read(stream, b_h);
+
+        LinearLib::Matrix<O, H, float> w_h_o;
+        Cell::read(stream, w_h_o);
+
+        LinearLib::Matrix<O, 1, float> b_h_o;
+        Cell::read(stream, b_h_o);
+
+        return GRU(w_x, w_h, b_x, b_h, w_h_o, b_h_o, learning_rate, clip, seed);
+    }
+
+    [[nodiscard]] std::string serialize() const {
+
+        std::stringstream stream("");
+
+        stream << I << "\x{1E}" << H << "\x{1E}" << O << "\x{1E}" << F << "\x{1E}" << learning_rate << "\x{1E}" << clip << "\x{1E}" << seed << "\x{1E}";
+
+        Cell::write(stream, w_x());
+        Cell::write(stream, w_h());
+        Cell::write(stream, b_x());
+        Cell::write(stream, b_h());
+        Cell::write(stream, w_h_o());
+        Cell::write(stream, b_h_o());
+
+        return stream.str();
+    }
+
+    // Final hidden state of the first window in the last batch
+    LinearLib::Matrix<H, 1, float> get_hidden_state() {
+        LinearLib::Matrix<H, 1, float> res;
+        const float* last = states.at(states.count - 1);
+        for (std::size_t i = 0; i < H; i++) {
+            res[i][0] = last[i * states.ld()];
+        }
+        return res;
+    }
+};
@@ -0,0 +1,453 @@
+#pragma once
+
+#include "ActivationStore.hpp"
+#include "Cell.hpp"
+#include "Optimizer.hpp"
+#include "Parameters.hpp"
+#include "LinearLib/Arena.hpp"
+#include "LinearLib/Autotune.hpp"
+#include "LinearLib/Matrix.hpp"
+#include <vector>
+#include <cmath>
+
+/**
+ * LSTM over windows of I time steps with F features each, reading the output off the last hidden state.
+ *
+ * The input, forget, candidate and output gate weights are stacked into 4H row blocks of w_x and w_h, in that order,
+ * so each step is a single 4H x H by H x B GEMM followed by one fused pass applying the gate nonlinearities and the
+ * cell update. Batches use the same time major layout as RNN, column t * B + b holds step t of window b.
+ */
+template<std::size_t I, std::size_t H, std::size_t O, std::size_t F = 1>
+struct LSTM {
+    static constexpr std::size_t GATES = 4;
+
+    // Offsets of the weights and biases in the flat parameter and gradient buffers
+    static constexpr std::size_t W_X = 0;
+    static constexpr std::size_t W_H = W_X + Parameters::padded(GATES * H * F);
+    static constexpr std::size_t B_GATES = W_H + Parameters::padded(GATES * H * H);
+    static constexpr std::size_t W_H_O = B_GATES + Parameters::padded(GATES * H);
+    static constexpr std::size_t B_H_O = W_H_O + Parameters::padded(O * H);
+    static constexpr std::size_t PARAMETERS = B_H_O + Parameters::padded(O);
+
+    Parameters parameters = Parameters(PARAMETERS);
+
+    // Hidden and cell states h_0 .. h_I and c_0 .. c_I of the last forward pass
+    ActivationStore states = ActivationStore(H, I + 1);
+    ActivationStore cells = ActivationStore(H, I + 1);
+
+    // Activated gates of steps 1 .. I. Backward overwrites them with the gate pre-activation gradients.
+    ActivationStore gates = ActivationStore(GATES * H, I);
+
+    // Steps per checkpoint segment, and the hidden and cell state stacked at the start of each segment of the last
+    // forward pass
+    std::size_t interval = I;
+    ActivationStore checkpoints = ActivationStore(2 * H, 1);
+
+    float learning_rate;
+    float clip;
+
+    // Update rule and its moments, plain SGD unless configured otherwise
+    Optimizer optimizer;
+    int seed;
+
+    LSTM(LinearLib::Matrix<GATES * H, F, float> w_x, LinearLib::Matrix<GATES * H, H, float> w_h,
+         LinearLib::Matrix<GATES * H, 1, float> b, LinearLib::Matrix<O, H, float> w_h_o,
+         LinearLib::Matrix<O, 1, float> b_h_o, float learning_rate, float clip, int seed = 42) {
+        this->w_x() = w_x;
+        this->w_h() = w_h;
+        this->b() = b;
+        this->w_h_o() = w_h_o;
+        this->b_h_o() = b_h_o;
+
+        this->learning_rate = learning_rate;
+        this->clip = clip;
+        this->seed = seed;
+    }
+
+    LSTM(float learning_rate, float clip, int seed = 42) {
+        this->learning_rate = learning_rate;
+        this->clip = clip;
+        this->seed = seed;
+
+        const float bound = 1.0f / std::sqrt(static_cast<float>(H));
+
+        w_x() = LinearLib::Matrix<GATES * H, F, float>::random(-bound, bound, seed);
+        w_h() = LinearLib::Matrix<GATES * H, H, float>::random(-bound, bound, seed + 1);
+        w_h_o() = LinearLib::Matrix<O, H, float>::random(-bound, bound, seed + 2);
+
+        // A forget bias of one keeps the cell state flowing early in training, the other biases start at zero
+        for (std::size_t j = H; j < 2 * H; j++) {
+            b()[j][0] = 1.0f;
+        }
+    }
+
+    auto& w_x() { return parameters.template value<GATES * H, F>(W_X); }
+    auto& w_h() { return parameters.template value<GATES * H, H>(W_H); }
+    auto& b() { return parameters.template value<GATES * H, 1>(B_GATES); }
+    auto& w_h_o() { return parameters.template value<O, H>(W_H_O); }
+    auto& b_h_o() { return parameters.template value<O, 1>(B_H_O); }
+
+    const auto& w_x() const { return parameters.template value<GATES * H, F>(W_X); }
+    const auto& w_h() const { return parameters.template value<GATES * H, H>(W_H); }
+    const auto& b() const { return parameters.template value<GATES * H, 1>(B_GATES); }
+    const auto& w_h_o() const { return parameters.template value<O, H>(W_H_O); }
+    const auto& b_h_o() const { return parameters.template value<O, 1>(B_H_O); }
+
+    // Sizes the activation stores for batches of B, after which training never allocates
+    template<std::size_t B>
+    void reserve() {
+        states.reserve(B);
+        cells.reserve(B);
+        gates.reserve(B);
+        checkpoints.reserve(B);
+    }
+
+    // Products issued by one training step on a batch of B, used to autotune the GEMM kernel for this model
+    template<std::size_t B>
+    static std::vector<LinearLib::Autotune::Shape> gemmShapes() {
+        return {{GATES * H, I * B, F}, {GATES * H, B, H}, {O, B, H}, {H, B, O}, {O, H, B}, {H, B, GATES * H},
+                {GATES * H, H, I * B}, {GATES * H, F, I * B}};
+    }
+
+    /**
+     * Stores only the hidden and cell state at the start of every interval steps of a window and recomputes the
+     * activations of each segment during backward, trading about one extra forward pass for activation memory that
+     * scales with I / interval + interval instead of I. An interval of I, the default, stores everything.
+     */
+    template<std::size_t B>
+    void checkpoint(std::size_t interval) {
+        interval = std::clamp<std::size_t>(interval, 1, I);
+
+        this->interval = interval;
+        states.resize(interval + 1);
+        cells.resize(interval + 1);
+        gates.resize(interval);
+        checkpoints.resize((I + interval - 1) / interval);
+
+        reserve<B>();
+    }
+
+    // Activation memory of a batch of B windows at the given checkpoint interval
+    template<std::size_t B>
+    static std::size_t activationBytes(const std::size_t interval) {
+        const std::size_t segments = (I + interval - 1) / interval;
+        return (2 * (interval + 1) * H + interval * GATES * H + segments * 2 * H) * B * sizeof(float);
+    }
+
+    /**
+     * Forward pass over a batch of B windows laid out time major in x, one checkpoint segment at a time. Only the
+     * last segment's activations stay in the stores, the states at the start of the others in checkpoints.
+     */
+    template<std::size_t B>
+    LinearLib::Matrix<O, B, float> forward(const LinearLib::Matrix<F, I * B, float>& x) {
+
+        checkpoints.reset(B);
+
+        const std::size_t lc = checkpoints.ld();
+
+        float* zero = checkpoints.push();
+        for (std::size_t j = 0; j < 2 * H; j++) {
+            for (std::size_t k = 0; k < B; k++) {
+                zero[j * lc + k] = 0.0f;
+            }
+        }
+
+        for (std::size_t start = 0; start < I; start += interval) {
+            segment<B>(x, start);
+
+            if (start + interval < I) {
+                const std::size_t ls = states.ld();
+                const float* h = states.at(interval);
+                const float* c = cells.at(interval);
+
+                float* checkpoint = checkpoints.push();
+                for (std::size_t j = 0; j < H; j++) {
+                    for (std::size_t k = 0; k < B; k++) {
+                        checkpoint[j * lc + k] = h[j * ls + k];
+                        checkpoint[(H + j) * lc + k] = c[j * ls + k];
+                    }
+                }
+            }
+        }
+
+        LinearLib::Matrix<O, B, float> y;
+        LinearLib::gemm(false, false, O, B, H, this->w_h_o().raw(), H, states.at(states.count - 1), states.ld(), 0.0f,
+                        y.raw(), B);
+        Cell::addBias(y, this->b_h_o());
+
+        return y;
+    }
+
+    /**
+     * Backpropagation through time for the batch of the last forward, given its input x. Gradients are averaged
+     * over the first count columns, columns past count are padding and must have a zero d_y.
+     *
+     * Segments are visited last to first, each recomputed from its checkpoint unless still held. Each step's gate
+     * gradients are computed in one fused pass from the stored activations and written over them, after which the
+     * stacked weight gradients are single GEMMs over the segment.
+     */
+    template<std::size_t B>
+    void backward(const LinearLib::Matrix<F, I * B, float>& x, const LinearLib::Matrix<O, B, float>& d_y,
+                  const std::size_t count = B) {
+
+        LinearLib::Arena& arena = LinearLib::Arena::current();
+
+        parameters.clearGradients();
+
+        auto& d_w_x = parameters.template gradient<GATES * H, F>(W_X);
+        auto& d_w_h = parameters.template gradient<GATES * H, H>(W_H);
+        auto& d_b = parameters.template gradient<GATES * H, 1>(B_GATES);
+        auto& d_w_h_o = parameters.template gradient<O, H>(W_H_O);
+        auto& d_b_h_o = parameters.template gradient<O, 1>(B_H_O);
+
+        LinearLib::gemm(false, true, O, H, B, d_y.raw(), B, states.at(states.count - 1), states.ld(), 0.0f,
+                        d_w_h_o.raw(), H);
+        Cell::sumColumns(d_y, d_b_h_o);
+
+        auto& d_h = arena.make<LinearLib::Matrix<H, B, float>>();
+        LinearLib::matmulTN(this->w_h_o(), d_y, d_h);
+
+        auto& d_c = arena.make<LinearLib::Matrix<H, B, float>>();
+        d_c.fill(0.0f);
+
+        const std::size_t segments = (I + interval - 1) / interval;
+
+        for (std::size_t s = segments; s-- > 0;) {
+            const std::size_t start = s * interval;
+
+            // The last segment is still held from the forward pass
+            if (s + 1 < segments) {
+                segment<B>(x, start);
+            }
+
+            const std::size_t ls = states.ld();
+            const std::size_t lg = gates.ld();
+            const std::size_t steps = std::min(interval, I - start);
+
+            // Backprop through time
+            for (std::size_t t = steps; t > 0; --t) {
+                float* a = gates.at(t - 1);
+
+                const float* c_prev = cells.at(t - 1);
+                const float* c = cells.at(t);
+
+                for (std::size_t j = 0; j < H; j++) {
+                    float* in = a + j * lg;
+                    float* forget = a + (H + j) * lg;
+                    float* candidate = a + (2 * H + j) * lg;
+                    float* out = a + (3 * H + j) * lg;
+
+                    for (std::size_t k = 0; k < B; k++) {
+                        const float tanh_c = std::tanh(c[j * ls + k]);
+                        const float dh = d_h[j][k];
+                        const float dc = d_c[j][k] + dh * out[k] * (1.0f - tanh_c * tanh_c);
+
+                        const float d_in = dc * candidate[k] * in[k] * (1.0f - in[k]);
+                        const float d_forget = dc * c_prev[j * ls + k] * forget[k] * (1.0f - forget[k]);
+                        const float d_candidate = dc * in[k] * (1.0f - candidate[k] * candidate[k]);
+                        const float d_out = dh * tanh_c * out[k] * (1.0f - out[k]);
+
+                        d_c[j][k] = dc * forget[k];
+
+                        in[k] = d_in;
+                        forget[k] = d_forget;
+                        candidate[k] = d_candidate;
+                        out[k] = d_out;
+                    }
+                }
+
+                if (start + t > 1) {
+                    LinearLib::strassenGemm(true, false, H, B, GATES * H, this->w_h().raw(), H, a, lg, 0.0f,
+                                            d_h.raw(), B);
+                }
+            }
+
+            // A segment fills every store from its first slot, so its steps are contiguous
+            const float* d_a = gates.at(0);
+
+            Cell::sumColumns(GATES * H, steps * B, d_a, lg, d_b.raw());
+
+            LinearLib::strassenGemm(false, true, GATES * H, H, steps * B, d_a, lg, states.at(0), ls, 1.0f,
+                                    d_w_h.raw(), H);
+            LinearLib::gemm(false, true, GATES * H, F, steps * B, d_a, lg, x.raw() + start * B, I * B, 1.0f,
+                            d_w_x.raw(), F);
+        }
+
+        // Average over the batch, clip and apply, one pass over the model
+        optimizer.step();
+        optimizer.update(0, parameters.values(), parameters.gradients(), PARAMETERS, 1.0f / static_cast<float>(count),
+                         this->clip, this->learning_rate);
+    }
+
+    /**
+     * Runs the segment of the window starting at the given step from its checkpoint, refilling the stores with its
+     * states, cells and gates. The input projections of the segment are one GEMM, then each step is one GEMM
+     * against the previous hidden state and one fused pass over the gates.
+     */
+    template<std::size_t B>
+    void segment(const LinearLib::Matrix<F, I * B, float>& x, const std::size_t start) {
+        const std::size_t steps = std::min(interval, I - start);
+
+        states.reset(B);
+        cells.reset(B);
+        gates.reset(B);
+
+        // States and cells share their shape and so their leading dimension
+        const std::size_t ls = states.ld();
+        const std::size_t lg = gates.ld();
+        const std::size_t lc = checkpoints.ld();
+
+        const float* checkpoint = checkpoints.at(start / interval);
+        float* h_0 = states.push();
+        float* c_0 = cells.push();
+        for (std::size_t j = 0; j < H; j++) {
+            for (std::size_t k = 0; k < B; k++) {
+                h_0[j * ls + k] = checkpoint[j * lc + k];
+                c_0[j * ls + k] = checkpoint[(H + j) * lc + k];
+            }
+        }
+
+        float* u = gates.push(steps);
+        LinearLib::gemm(false, false, GATES * H, steps * B, F, this->w_x().raw(), F, x.raw() + start * B, I * B, 0.0f,
+                        u, lg);
+
+        for (std::size_t t = 0; t < steps; t++) {
+            float* a = gates.at(t);
+
+            // h_0 is zero, so the first step of the window has no recurrent term
+            if (start + t > 0) {
+                LinearLib::strassenGemm(false, false, GATES * H, B, H, this->w_h().raw(), H, states.at(t), ls, 1.0f,
+                                        a, lg);
+            }
+
+            const float* c_prev = cells.at(t);
+            float* c = cells.push();
+            float* h = states.push();
+
+            for (std::size_t j = 0; j < H; j++) {
+                float* in = a + j * lg;
+                float* forget = a + (H + j) * lg;
+                float* candidate = a + (2 * H + j) * lg;
+                float* out = a + (3 * H + j) * lg;
+
+                for (std::size_t k = 0; k < B; k++) {
+                    in[k] = Cell::sigmoid(in[k] + this->b()[j][0]);
+                    forget[k] = Cell::sigmoid(forget[k] + this->b()[H + j][0]);
+                    candidate[k] = std::tanh(candidate[k] + this->b()[2 * H + j][0]);
+                    out[k] = Cell::sigmoid(out[k] + this->b()[3 * H + j][0]);
+
+                    c[j * ls + k] = forget[k] * c_prev[j * ls + k] + in[k] * candidate[k];
+                    h[j * ls + k] = out[k] * std::tanh(c[j * ls + k]);
+                }
+            }
+        }
+    }
+
+    // Hidden and cell state of a single stream, carried from one observation to the next, see Session
+    struct State {
+        LinearLib::Matrix<H, 1, float> h = LinearLib::Matrix<H, 1, float>::zeros();
+        LinearLib::Matrix<H, 1, float> c = LinearLib::Matrix<H, 1, float>::zeros();
+    };
+
+    /**
+     * Advances a single stream by one observation, a single cell step from the carried state, and returns the
+     * output read off the new hidden state. The cost is O(H^2) whatever the window length I.
+     */
+    LinearLib::Matrix<O, 1, float> observe(State& state, const LinearLib::Matrix<F, 1, float>& x) const {
+        LinearLib::Matrix<GATES * H, 1, float> a;
+        LinearLib::gemm(false, false, GATES * H, 1, F, this->w_x().raw(), F, x.raw(), 1, 0.0f, a.raw(), 1);
+        LinearLib::gemm(false, false, GATES * H, 1, H, this->w_h().raw(), H, state.h.raw(), 1, 1.0f, a.raw(), 1);
+
+        for (std::size_t j = 0; j < H; j++) {
+            const float in = Cell::sigmoid(a[j][0] + this->b()[j][0]);
+            const float forget = Cell::sigmoid(a[H + j][0] + this->b()[H + j][0]);
+            const float candidate = std::tanh(a[2 * H + j][0] + this->b()[2 * H + j][0]);
+            const float out = Cell::sigmoid(a[3 * H + j][0] + this->b()[3 * H + j][0]);
+
+            state.c[j][0] = forget * state.c[j][0] + in * candidate;
+            state.h[j][0] = out * std::tanh(state.c[j][0]);
+        }
+
+        LinearLib::Matrix<O, 1, float> y;
+        LinearLib::gemm(false, false, O, 1, H, this->w_h_o().raw(), H, state.h.raw(), 1, 0.0f, y.raw(), 1);
+        Cell::addBias(y, this->b_h_o());
+
+        return y;
+    }
+
+    // Drops the stored activations, keeping their memory
+    void clearHistory() {
+        states.reset(states.batch);
+        cells.reset(cells.batch);
+        gates.reset(gates.batch);
+        checkpoints.reset(checkpoints.batch);
+    }
+
+    static LSTM deserialize(const std::string& serialized) {
+        std::stringstream stream(serialized);
+        std::string token;
+
+        std::getline(stream, token, '\x{1E}');
+        assert(token == std::to_string(I) && "Invalid input size!");
+
+        std::getline(stream, token, '\x{1E}');
+        assert(token == std::to_string(H) && "Invalid hidden size!");
+
+        std::getline(stream, token, '\x{1E}');
+        assert(token == std::to_string(O) && "Invalid output size!");
+
+        std::getline(stream, token, '\x{1E}');
+        assert(token == std::to_string(F) && "Invalid feature count!");
+
+        std::getline(stream, token, '\x{1E}');
+        float learning_rate = std::stof(token);
+
+        std::getline(stream, token, '\x{1E}');
+        float clip = std::stof(token);
+
+        std::getline(stream, token, '\x{1E}');
+        int seed = std::stoi(token);
+
+        LinearLib::Matrix<GATES * H, F, float> w_x;
+        Cell::read(stream, w_x);
+
+        LinearLib::Matrix<GATES * H, H, float> w_h;
+        Cell::read(stream, w_h);
+
+        LinearLib::Matrix<GATES * H, 1, float> b;
+        Cell::read(stream, b);
+
+        LinearLib::Matrix<O, H, float> w_h_o;
+        Cell::read(stream, w_h_o);
+
+        LinearLib::Matrix<O, 1, float> b_h_o;
+        Cell::read(stream, b_h_o);
+
+        return LSTM(w_x, w_h, b, w_h_o, b_h_o, learning_rate, clip, seed);
+    }
+
+    [[nodiscard]] std::string serialize() const {
+
+        std::stringstream stream("");
+
+        stream << I << "\x{1E}" << H << "\x{1E}" << O << "\x{1E}" << F << "\x{1E}" << learning_rate << "\x{1E}" << clip << "\x{1E}" << seed << "\x{1E}";
+
+        Cell::write(stream, w_x());
+        Cell::write(stream, w_h());
+        Cell::write(stream, b());
+        Cell::write(stream, w_h_o());
+        Cell::write(stream, b_h_o());
+
+        return stream.str();
+    }
+
+    // Final hidden state of the first window in the last batch
+    LinearLib::Matrix<H, 1, float> get_hidden_state() {
+        LinearLib::Matrix<H, 1, float> res;
+        const float* last = states.at(states.count - 1);
+        for (std::size_t i = 0; i < H; i++) {
+            res[i][0] = last[i * states.ld()];
+        }
+        return res;
+    }
+};
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+
+/**
+ * Training objectives for Environment, mapping the O outputs of a model to TARGETS labels per sample. Each takes the
+ * first n columns of a batch of predictions y, O x ld, and of their labels, TARGETS x ld, and in one pass returns the
+ * summed loss and writes the gradient d_y, O x ld, pointing downhill like everywhere in the models. The loss of each
+ * target is added to targets when given.
+ *
+ * The loss and its gradient come out of the same fused pass along the n columns of each output.
+ */
+namespace Loss {
+    constexpr std::size_t LANES = 16;
+
+    // Sum of term(j) over j < n with independent partial sums, so the reduction vectorizes without reassociating
+    template<typename Term>
+    float accumulate(const std::size_t n, Term&& term) {
+        float partial[LANES] = {};
+        std::size_t j = 0;
+        for (; j + LANES <= n; j += LANES) {
+            for (std::size_t k = 0; k < LANES; k++) {
+                partial[k] += term(j + k);
+            }
+        }
+
+        float sum = 0.0f;
+        for (; j < n; j++) {
+            sum += term(j);
+        }
+        for (const float value: partial) {
+            sum += value;
+        }
+        return sum;
+    }
+
+    /**
+     * Half the squared error of a point forecast per target, one output each.
+     */
+    struct SquaredError {
+        template<std::size_t O>
+        static constexpr std::size_t TARGETS = O;
+
+        template<std::size_t O>
+        static float evaluate(const std::size_t n, const std::size_t ld, const float* y, const float* labels,
+                              float* d_y, float* targets = nullptr) {
+            float loss = 0.0f;
+
+            for (std::size_t o = 0; o < O; o++) {
+                const float sum = accumulate(n, [&](const std::size_t j) {
+                    const float r = labels[o * ld + j] - y[o * ld + j];
+                    d_y[o * ld + j] = r;
+                    return r * r / 2;
+                });
+
+                loss += sum;
+                if (targets != nullptr) {
+                    targets[o] += sum;
+                }
+            }
+
+            return loss;
+        }
+    };
+
+    /**
+     * Pinball loss of the given quantiles, in percent, of every target, so a single model forecasts a whole
+     * distribution, e.g. Quantiles<5, 25, 50, 75, 95> for the median and two intervals. The outputs are one block of
+     * TARGETS rows per quantile, row q * TARGETS + t holding quantile q of target t.
+     *
+     * With residual r = label - y the loss is r * (tau - [r < 0]) and its downhill gradient tau - [r < 0], so the
+     * loss and the gradient of an output come from the same branch free expression.
+     */
+    template<std::size_t... PERCENTILES>
+    struct Quantiles {
+        static constexpr std::size_t COUNT = sizeof...(PERCENTILES);
+        static constexpr std::array<float, COUNT> TAUS = {static_cast<float>(PERCENTILES) / 100.0f ...};
+
+        static_assert(COUNT > 0 && ((PERCENTILES > 0 && PERCENTILES < 100) && ...), "Quantiles lie in (0, 100)");
+
+        template<std::size_t O>
+        static constexpr std::size_t TARGETS = O / COUNT;
+
+        template<std::size_t O>
+        static float evaluate(const std::size_t n, const std::size_t ld, const float* y, const float* labels,
+                              float* d_y, float* targets = nullptr) {
+            static_assert(O % COUNT == 0, "Every target needs an output per quantile");
+
+            float loss = 0.0f;
+
+            for (std::size_t q = 0; q < COUNT; q++) {
+                const float tau = TAUS[q];
+
+                for (std::size_t t = 0; t < TARGETS<O>; t++) {
+                    const std::size_t o = q * TARGETS<O> + t;
+
+                    const float sum = accumulate(n, [&](const std::size_t j) {
+                        const float r = labels[t * ld + j] - y[o * ld + j];
+                        const float d = tau - static_cast<float>(r < 0.0f);
+                        d_y[o * ld + j] = d;
+                        return r * d;
+                    });
+
+                    loss += sum;
+                    if (targets != nullptr) {
+                        targets[t] += sum;
+                    }
+                }
+            }
+
+            return loss;
+        }
+    };
+
+    /**
+     * Negative log likelihood of a Gaussian forecast per target, the mean in row t and the log variance s in row
+     * TARGETS + t. Up to a constant the loss is (s + r^2 e^-s) / 2 with r = label - mean, so the model learns how
+     * uncertain each forecast is along with the forecast itself.
+     */
+    struct Gaussian {
+        template<std::size_t O>
+        static constexpr std::size_t TARGETS = O / 2;
+
+        template<std::size_t O>
+        static float evaluate(const std::size_t n, const std::size_t ld, const float* y, const float* labels,
+                              float* d_y, float* targets = nullptr) {
+            static_assert(O % 2 == 0, "Every target needs a mean and a log variance");
+
+            constexpr std::size_t T = TARGETS<O>;
+
+            float loss = 0.0f;
+
+            for (std::size_t t = 0; t < T; t++) {
+                const float sum = accumulate(n, [&](const std::size_t j) {
+                    const float r = labels[t * ld + j] - y[t * ld + j];
+                    const float s = y[(T + t) * ld + j];
+                    const float precision = std::exp(-s);
+
+                    d_y[t * ld + j] = r * precision;
+                    d_y[(T + t) * ld + j] = (r * r * precision - 1.0f) / 2;
+                    return (s + r * r * precision) / 2;
+                });
+
+                loss += sum;
+                if (targets != nullptr) {
+                    targets[t] += sum;
+                }
+            }
+
+            return loss;
+        }
+    };
+}
@@ -0,0 +1,206 @@
+#pragma once
+
+#include "Cell.hpp"
+#include "Optimizer.hpp"
+#include "Parameters.hpp"
+#include "LinearLib/Arena.hpp"
+#include "LinearLib/Autodiff.hpp"
+#include "LinearLib/Autotune.hpp"
+#include "LinearLib/Matrix.hpp"
+#include <vector>
+#include <cmath>
+
+/**
+ * Minimal gated unit over windows of I time steps with F features each, reading the output off the last hidden state:
+ *
+ *   f = sigmoid(W_xf x + b_f + U_f h)
+ *   c = tanh(W_xc x + b_c + U_c (f * h))
+ *   h' = h + f * (c - h)
+ *
+ * Unlike the hand-written models, only its forward pass is written out: it is recorded on an Autodiff::Tape and
+ * backward replays the tape. The input projections of both gates are one GEMM over the whole window, as in GRU, and
+ * each gate is a fused linear node, so the tape issues the GEMMs a hand-written backward would.
+ *
+ * The tape, its intermediate values and their gradients live in the arena of the step, so the model keeps no
+ * activation stores of its own and the batch x must stay alive until backward.
+ */
+template<std::size_t I, std::size_t H, std::size_t O, std::size_t F = 1>
+struct MGU {
+    static constexpr std::size_t GATES = 2;
+
+    // Offsets of the weights and biases in the flat parameter and gradient buffers
+    static constexpr std::size_t W_X = 0;
+    static constexpr std::size_t B_X = W_X + Parameters::padded(GATES * H * F);
+    static constexpr std::size_t U_F = B_X + Parameters::padded(GATES * H);
+    static constexpr std::size_t U_C = U_F + Parameters::padded(H * H);
+    static constexpr std::size_t W_H_O = U_C + Parameters::padded(H * H);
+    static constexpr std::size_t B_H_O = W_H_O + Parameters::padded(O * H);
+    static constexpr std::size_t PARAMETERS = B_H_O + Parameters::padded(O);
+
+    Parameters parameters = Parameters(PARAMETERS);
+
+    // Operations of the last forward pass and its output, which backward seeds with d_y
+    LinearLib::Autodiff::Tape tape;
+    LinearLib::Autodiff::Var output;
+
+    float learning_rate;
+    float clip;
+
+    // Update rule and its moments, plain SGD unless configured otherwise
+    Optimizer optimizer;
+    int seed;
+
+    MGU(float learning_rate, float clip, int seed = 42) {
+        this->learning_rate = learning_rate;
+        this->clip = clip;
+        this->seed = seed;
+
+        const float bound = 1.0f / std::sqrt(static_cast<float>(H));
+
+        w_x() = LinearLib::Matrix<GATES * H, F, float>::random(-bound, bound, seed);
+        u_f() = LinearLib::Matrix<H, H, float>::random(-bound, bound, seed + 1);
+        u_c() = LinearLib::Matrix<H, H, float>::random(-bound, bound, seed + 2);
+        w_h_o() = LinearLib::Matrix<O, H, float>::random(-bound, bound, seed + 3);
+    }
+
+    // Input weights and biases of the forget gate and the candidate, stacked in that order
+    auto& w_x() { return parameters.template value<GATES * H, F>(W_X); }
+    auto& b_x() { return parameters.template value<GATES * H, 1>(B_X); }
+    auto& u_f() { return parameters.template value<H, H>(U_F); }
+    auto& u_c() { return parameters.template value<H, H>(U_C); }
+    auto& w_h_o() { return parameters.template value<O, H>(W_H_O); }
+    auto& b_h_o() { return parameters.template value<O, 1>(B_H_O); }
+
+    const auto& w_x() const { return parameters.template value<GATES * H, F>(W_X); }
+    const auto& b_x() const { return parameters.template value<GATES * H, 1>(B_X); }
+    const auto& u_f() const { return parameters.template value<H, H>(U_F); }
+    const auto& u_c() const { return parameters.template value<H, H>(U_C); }
+    const auto& w_h_o() const { return parameters.template value<O, H>(W_H_O); }
+    const auto& b_h_o() const { return parameters.template value<O, 1>(B_H_O); }
+
+    // Every activation lives in the step's arena
+    template<std::size_t B>
+    void reserve() {}
+
+    // Products issued by one training step on a batch of B, used to autotune the GEMM kernel for this model
+    template<std::size_t B>
+    static std::vector<LinearLib::Autotune::Shape> gemmShapes() {
+        return {{GATES * H, I * B, F}, {H, B, H}, {O, B, H}, {H, H, B}, {O, H, B}, {GATES * H, F, I * B}};
+    }
+
+    // Parameter bound to its slice of the flat value and gradient buffers
+    LinearLib::Autodiff::Var parameter(const std::size_t offset, const std::size_t rows, const std::size_t cols) {
+        return LinearLib::Autodiff::Tape::parameter(parameters.values() + offset, parameters.gradients() + offset,
+                                                     rows, cols);
+    }
+
+    template<std::size_t B>
+    LinearLib::Matrix<O, B, float> forward(const LinearLib::Matrix<F, I * B, float>& x) {
+        using LinearLib::Autodiff::Activation;
+
+        tape.reset(LinearLib::Arena::current());
+
+        // Both gates' input projections of every step, time major like the batch
+        const auto projections = tape.linear(parameter(W_X, GATES * H, F),
+                                             LinearLib::Autodiff::Tape::constant(x.raw(), F, I * B),
+                                             parameter(B_X, GATES * H, 1));
+
+        const auto u_f = parameter(U_F, H, H);
+        const auto u_c = parameter(U_C, H, H);
+
+        auto h = tape.zeros(H, B);
+        for (std::size_t t = 0; t < I; t++) {
+            const auto step = projections.columns(t * B, B);
+
+            const auto f = tape.linear(u_f, h, {}, Activation::Sigmoid, step.block(0, H));
+            const auto c = tape.linear(u_c, tape.mul(f, h), {}, Activation::Tanh, step.block(H, H));
+            h = tape.lerp(h, c, f);
+        }
+
+        output = tape.linear(parameter(W_H_O, O, H), h, parameter(B_H_O, O, 1));
+
+        LinearLib::Matrix<O, B, float> y;
+        std::copy_n(output.value, O * B, y.raw());
+        return y;
+    }
+
+    /**
+     * Backpropagation through time for the batch of the last forward, replaying its tape. Gradients are averaged
+     * over the first count columns, columns past count are padding and must have a zero d_y.
+     */
+    template<std::size_t B>
+    void backward(const LinearLib::Matrix<F, I * B, float>&, const LinearLib::Matrix<O, B, float>& d_y,
+                  const std::size_t count = B) {
+        assert(tape.last != nullptr && "Backward without a forward pass");
+
+        // The tape accumulates into the parameter gradients
+        parameters.clearGradients();
+
+        std::copy_n(d_y.raw(), O * B, output.grad);
+        tape.backward();
+
+        optimizer.step();
+        optimizer.update(0, parameters.values(), parameters.gradients(), PARAMETERS,
+                         1.0f / static_cast<float>(count), this->clip, this->learning_rate);
+    }
+
+    // Forgets the tape, its memory goes with the arena's scope
+    void clearHistory() {
+        tape.last = nullptr;
+        tape.nodes = 0;
+        output = {};
+    }
+
+    static MGU deserialize(const std::string& serialized) {
+        std::stringstream stream(serialized);
+        std::string token;
+
+        std::getline(stream, token, '\x{1E}');
+        assert(token == std::to_string(I) && "Invalid input size!");
+
+        std::getline(stream, token, '\x{1E}');
+        assert(token == std::to_string(H) && "Invalid hidden size!");
+
+        std::getline(stream, token, '\x{1E}');
+        assert(token == std::to_string(O) && "Invalid output size!");
+
+        std::getline(stream, token, '\x{1E}');
+        assert(token == std::to_string(F) && "Invalid feature count!");
+
+        std::getline(stream, token, '\x{1E}');
+        float learning_rate = std::stof(token);
+
+        std::getline(stream, token, '\x{1E}');
+        float clip = std::stof(token);
+
+        std::getline(stream, token, '\x{1E}');
+        int seed = std::stoi(token);
+
+        MGU mgu(learning_rate, clip, seed);
+
+        Cell::read(stream, mgu.w_x());
+        Cell::read(stream, mgu.b_x());
+        Cell::read(stream, mgu.u_f());
+        Cell::read(stream, mgu.u_c());
+        Cell::read(stream, mgu.w_h_o());
+        Cell::read(stream, mgu.b_h_o());
+
+        return mgu;
+    }
+
+    [[nodiscard]] std::string serialize() const {
+
+        std::stringstream stream("");
+
+        stream << I << "\x{1E}" << H << "\x{1E}" << O << "\x{1E}" << F << "\x{1E}" << learning_rate << "\x{1E}" << clip << "\x{1E}" << seed << "\x{1E}";
+
+        Cell::write(stream, w_x());
+        Cell::write(stream, b_x());
+        Cell::write(stream, u_f());
+        Cell::write(stream, u_c());
+        Cell::write(stream, w_h_o());
+        Cell::write(stream, b_h_o());
+
+        return stream.str();
+    }
+};
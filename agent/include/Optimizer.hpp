@@ -0,0 +1,230 @@
+#pragma once
+
+#include "LinearLib/Matrix.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+/**
+ * Update rule applied to the parameters after every backward pass: SGD with optional momentum, RMSProp, Adam and
+ * AdamW with decoupled weight decay.
+ *
+ * Each parameter has a slot holding its running moments, element for element, so an update is a single fused pass
+ * over the parameter, its gradient and its moments that scales, clips and applies the gradient. Gradients point
+ * downhill, as everywhere in the models, so every rule adds to the parameter.
+ *
+ * Gradients are clipped either to a global L2 norm, which keeps their direction, or element-wise. The models hand
+ * over all their parameters as one flat slot, so the norm is taken over the whole model in one extra reduction pass.
+ *
+ * A slot may carry a pruning mask, after which every update leaves its pruned parameters and their moments at zero.
+ */
+struct Optimizer {
+    enum class Method { SGD, RMSProp, Adam, AdamW };
+
+    enum class Clipping { Norm, Element };
+
+    // Running first and second moments of one parameter, empty until its first update
+    struct Moments {
+        std::vector<float> m;
+        std::vector<float> v;
+    };
+
+    Method method = Method::SGD;
+    Clipping clipping = Clipping::Norm;
+
+    // Velocity decay of SGD, 0 for plain SGD
+    float momentum = 0.0f;
+
+    // Decay of the running gradient average of Adam and of the running squared gradient average of all but SGD
+    float beta1 = 0.9f;
+    float beta2 = 0.999f;
+    float epsilon = 1e-8f;
+
+    // Decoupled weight decay of AdamW, relative to the learning rate
+    float weight_decay = 0.0f;
+
+    // Updates so far, for Adam's bias correction
+    std::size_t steps = 0;
+
+    // L2 norm of the last scaled gradient before clipping it to a norm
+    float norm = 0.0f;
+
+    std::vector<Moments> moments;
+
+    // Parameters each slot keeps, 1 or 0 element for element, empty for slots that are not pruned
+    std::vector<std::vector<float>> masks;
+
+    static Optimizer sgd(const float momentum = 0.0f) {
+        Optimizer optimizer;
+        optimizer.momentum = momentum;
+        return optimizer;
+    }
+
+    static Optimizer rmsProp(const float decay = 0.9f) {
+        Optimizer optimizer;
+        optimizer.method = Method::RMSProp;
+        optimizer.beta2 = decay;
+        return optimizer;
+    }
+
+    static Optimizer adam(const float beta1 = 0.9f, const float beta2 = 0.999f) {
+        Optimizer optimizer;
+        optimizer.method = Method::Adam;
+        optimizer.beta1 = beta1;
+        optimizer.beta2 = beta2;
+        return optimizer;
+    }
+
+    static Optimizer adamW(const float weight_decay = 0.01f, const float beta1 = 0.9f, const float beta2 = 0.999f) {
+        Optimizer optimizer = adam(beta1, beta2);
+        optimizer.method = Method::AdamW;
+        optimizer.weight_decay = weight_decay;
+        return optimizer;
+    }
+
+    // Starts an update of every parameter, to be called once before their update() calls
+    void step() {
+        steps++;
+    }
+
+    // Forgets the moments and the step count, e.g. before training a model again from scratch
+    void reset() {
+        steps = 0;
+        moments.clear();
+    }
+
+    // Prunes the n parameters of the slot to the mask keep from the next update on, see Pruning
+    void mask(const std::size_t slot, const float* keep, const std::size_t n) {
+        if (slot >= masks.size()) {
+            masks.resize(slot + 1);
+        }
+        masks[slot].assign(keep, keep + n);
+    }
+
+    template<std::size_t R, std::size_t C>
+    void update(const std::size_t slot, LinearLib::Matrix<R, C, float>& param,
+                const LinearLib::Matrix<R, C, float>& grad, const float scale, const float clip,
+                const float learning_rate) {
+        update(slot, param.raw(), grad.raw(), R * C, scale, clip, learning_rate);
+    }
+
+    // Sum of squares with independent partial sums, so the reduction vectorizes without reassociating
+    static float squaredNorm(const float* __restrict x, const std::size_t n) {
+        constexpr std::size_t LANES = 16;
+
+        float partial[LANES] = {};
+        std::size_t i = 0;
+        for (; i + LANES <= n; i += LANES) {
+            for (std::size_t j = 0; j < LANES; j++) {
+                partial[j] += x[i + j] * x[i + j];
+            }
+        }
+
+        float sum = 0.0f;
+        for (; i < n; i++) {
+            sum += x[i] * x[i];
+        }
+        for (const float value: partial) {
+            sum += value;
+        }
+        return sum;
+    }
+
+    /**
+     * Applies the raw gradient g of the n parameters p in the given slot, scaled by scale and clipped to a norm of
+     * clip or element-wise to [-clip, clip]. Allocates the slot's moments on its first update only.
+     */
+    void update(const std::size_t slot, float* __restrict p, const float* __restrict g, const std::size_t n,
+                float scale, float clip, const float learning_rate) {
+        // Norm clipping folds into the scale, leaving the element-wise clamp a no-op
+        if (clipping == Clipping::Norm) {
+            norm = scale * std::sqrt(squaredNorm(g, n));
+            if (norm > clip) {
+                scale *= clip / norm;
+            }
+            clip = std::numeric_limits<float>::infinity();
+        }
+
+        if (method == Method::SGD && momentum == 0.0f) {
+            for (std::size_t i = 0; i < n; i++) {
+                p[i] += learning_rate * std::clamp(g[i] * scale, -clip, clip);
+            }
+            prune(slot, p, n);
+            return;
+        }
+
+        if (slot >= moments.size()) {
+            moments.resize(slot + 1);
+        }
+
+        Moments& moment = moments[slot];
+        if (moment.m.size() != n) {
+            moment.m.assign(n, 0.0f);
+            moment.v.assign(n, 0.0f);
+        }
+
+        float* __restrict m = moment.m.data();
+        float* __restrict v = moment.v.data();
+
+        switch (method) {
+            case Method::SGD:
+                for (std::size_t i = 0; i < n; i++) {
+                    m[i] = momentum * m[i] + std::clamp(g[i] * scale, -clip, clip);
+                    p[i] += learning_rate * m[i];
+                }
+                break;
+
+            case Method::RMSProp:
+                for (std::size_t i = 0; i < n; i++) {
+                    const float d = std::clamp(g[i] * scale, -clip, clip);
+                    v[i] = beta2 * v[i] + (1.0f - beta2) * d * d;
+                    p[i] += learning_rate * d / (std::sqrt(v[i]) + epsilon);
+                }
+                break;
+
+            case Method::Adam:
+            case Method::AdamW: {
+                // Bias corrections folded into the step size and the second moment
+                const float t = static_cast<float>(std::max<std::size_t>(steps, 1));
+                const float rate = learning_rate / (1.0f - std::pow(beta1, t));
+                const float correction = 1.0f / (1.0f - std::pow(beta2, t));
+                const float decay = method == Method::AdamW ? 1.0f - learning_rate * weight_decay : 1.0f;
+
+                for (std::size_t i = 0; i < n; i++) {
+                    const float d = std::clamp(g[i] * scale, -clip, clip);
+                    m[i] = beta1 * m[i] + (1.0f - beta1) * d;
+                    v[i] = beta2 * v[i] + (1.0f - beta2) * d * d;
+                    p[i] = decay * p[i] + rate * m[i] / (std::sqrt(v[i] * correction) + epsilon);
+                }
+                break;
+            }
+        }
+
+        prune(slot, p, n);
+    }
+
+    // Zeroes the pruned parameters of the slot again, and their moments so a pruned weight carries no momentum
+    void prune(const std::size_t slot, float* __restrict p, const std::size_t n) {
+        if (slot >= masks.size() || masks[slot].empty()) {
+            return;
+        }
+        assert(masks[slot].size() == n && "The mask does not cover the slot");
+
+        const float* __restrict keep = masks[slot].data();
+        for (std::size_t i = 0; i < n; i++) {
+            p[i] *= keep[i];
+        }
+
+        if (slot < moments.size() && moments[slot].m.size() == n) {
+            float* __restrict m = moments[slot].m.data();
+            float* __restrict v = moments[slot].v.data();
+            for (std::size_t i = 0; i < n; i++) {
+                m[i] *= keep[i];
+                v[i] *= keep[i];
+            }
+        }
+    }
+};
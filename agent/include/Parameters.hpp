@@ -0,0 +1,96 @@
+#pragma once
+
+#include "LinearLib/Matrix.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <new>
+
+/**
+ * Every weight and bias of a model in one flat aligned buffer, followed by their gradients in a second buffer of the
+ * same layout. The model lays its parameters out at fixed offsets and works on them through matrix views, while
+ * whole-model operations such as optimizer updates, clipping, decay, snapshots or averaging are single passes over
+ * contiguous memory.
+ *
+ * Each parameter starts on a cache line, see padded(). The padding stays zero in both buffers, so passes over
+ * everything may include it.
+ */
+struct Parameters {
+    static constexpr std::size_t ALIGNMENT = 64;
+
+    struct Release {
+        void operator()(float* memory) const {
+            ::operator delete[](memory, std::align_val_t(ALIGNMENT));
+        }
+    };
+
+    // Elements a parameter of n elements occupies so the next one starts on a cache line
+    static constexpr std::size_t padded(std::size_t const n) {
+        constexpr std::size_t line = ALIGNMENT / sizeof(float);
+        return (n + line - 1) / line * line;
+    }
+
+    // Elements in each of the two buffers
+    std::size_t size;
+
+    // Values in [0, size), gradients in [size, 2 * size)
+    std::unique_ptr<float[], Release> data;
+
+    explicit Parameters(std::size_t const size) :
+        size(size),
+        data(static_cast<float*>(::operator new[](2 * size * sizeof(float), std::align_val_t(ALIGNMENT)))) {
+        std::fill_n(data.get(), 2 * size, 0.0f);
+    }
+
+    Parameters(const Parameters& other) : Parameters(other.size) {
+        std::copy_n(other.data.get(), 2 * size, data.get());
+    }
+
+    Parameters& operator=(const Parameters& other) {
+        assert(size == other.size && "Parameter buffers differ in layout");
+        std::copy_n(other.data.get(), 2 * size, data.get());
+        return *this;
+    }
+
+    [[nodiscard]] float* values() {
+        return data.get();
+    }
+
+    [[nodiscard]] const float* values() const {
+        return data.get();
+    }
+
+    [[nodiscard]] float* gradients() {
+        return data.get() + size;
+    }
+
+    [[nodiscard]] const float* gradients() const {
+        return data.get() + size;
+    }
+
+    // The R x C parameter at the given offset
+    template<std::size_t R, std::size_t C>
+    LinearLib::Matrix<R, C, float>& value(std::size_t const offset) {
+        assert(offset + R * C <= size && "Parameter lies outside the buffer");
+        return *std::launder(reinterpret_cast<LinearLib::Matrix<R, C, float>*>(values() + offset));
+    }
+
+    template<std::size_t R, std::size_t C>
+    const LinearLib::Matrix<R, C, float>& value(std::size_t const offset) const {
+        assert(offset + R * C <= size && "Parameter lies outside the buffer");
+        return *std::launder(reinterpret_cast<const LinearLib::Matrix<R, C, float>*>(values() + offset));
+    }
+
+    // The gradient of the R x C parameter at the given offset
+    template<std::size_t R, std::size_t C>
+    LinearLib::Matrix<R, C, float>& gradient(std::size_t const offset) {
+        assert(offset + R * C <= size && "Parameter lies outside the buffer");
+        return *std::launder(reinterpret_cast<LinearLib::Matrix<R, C, float>*>(gradients() + offset));
+    }
+
+    // Zeroes every gradient in one pass, before a backward pass accumulates into them
+    void clearGradients() {
+        std::fill_n(gradients(), size, 0.0f);
+    }
+};
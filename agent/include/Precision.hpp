@@ -0,0 +1,51 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+/**
+ * Loss scaling for mixed precision training. The output gradients are multiplied by scale before backward so the
+ * small gradients of the activations stay representable in fp16, and the weight gradients are divided by it again
+ * before the update.
+ *
+ * A dynamic scale halves whenever the gradients of a step overflowed, which skips that step, and doubles after
+ * interval steps in a row without overflow, so it settles just below the largest scale the gradients tolerate.
+ */
+struct LossScale {
+    float scale;
+    bool dynamic;
+    std::size_t interval;
+
+    // Steps without overflow since the scale last changed, and steps skipped for overflow so far
+    std::size_t streak = 0;
+    std::size_t skipped = 0;
+
+    explicit LossScale(const float scale = 1.0f, const bool dynamic = false, const std::size_t interval = 2000) :
+        scale(scale), dynamic(dynamic), interval(interval) {}
+
+    /**
+     * Checks the scaled gradients of a step and adjusts the scale, returning whether the step may be applied.
+     */
+    bool update(const float* gradients, const std::size_t n) {
+        bool finite = true;
+        for (std::size_t i = 0; i < n; i++) {
+            finite &= std::isfinite(gradients[i]);
+        }
+
+        if (!finite) {
+            skipped++;
+            streak = 0;
+            if (dynamic) {
+                scale = std::max(scale / 2.0f, 1.0f);
+            }
+            return false;
+        }
+
+        if (dynamic && ++streak >= interval) {
+            scale *= 2.0f;
+            streak = 0;
+        }
+        return true;
+    }
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+/**
+ * Gradual magnitude pruning: every epoch from begin to end the weights of smallest magnitude are removed, layer by
+ * layer, until target of each weight matrix is zero. Sparsity follows the cubic ramp of Zhu and Gupta, pruning fast
+ * while many redundant weights are left and slowly near the target, so training can recover between steps. Biases
+ * are never pruned.
+ *
+ * Pruned weights stay zero through the optimizer's mask, see Optimizer::mask. A layer whose sparsity passes
+ * threshold switches to sparse kernels, below it the zeros are cheaper to multiply than to skip.
+ */
+struct Pruning {
+    float target = 0.9f;
+    unsigned int begin = 1;
+    unsigned int end = 10;
+    float threshold = 0.8f;
+
+    // Sparsity to reach by the given epoch, counted from 1
+    [[nodiscard]] float sparsity(const unsigned int epoch) const {
+        if (epoch < begin) {
+            return 0.0f;
+        }
+        if (epoch >= end) {
+            return target;
+        }
+
+        const float progress = static_cast<float>(epoch - begin) / static_cast<float>(end - begin);
+        return target * (1.0f - std::pow(1.0f - progress, 3.0f));
+    }
+
+    /**
+     * Marks the n weights w that survive pruning to the given sparsity with 1 in keep and the rest with 0, dropping
+     * those of smallest magnitude. Weights already pruned are zero, so they are the first to go again.
+     */
+    static void mask(const float* w, const std::size_t n, const float sparsity, float* keep) {
+        const auto pruned = static_cast<std::size_t>(std::round(sparsity * static_cast<float>(n)));
+
+        if (pruned == 0) {
+            std::fill_n(keep, n, 1.0f);
+            return;
+        }
+
+        std::vector<float> magnitudes(n);
+        for (std::size_t i = 0; i < n; i++) {
+            magnitudes[i] = std::abs(w[i]);
+        }
+        std::nth_element(magnitudes.begin(), magnitudes.begin() + (pruned - 1), magnitudes.end());
+        const float cutoff = magnitudes[pruned - 1];
+
+        // Ties at the cutoff are pruned in order until exactly the requested number is gone
+        std::size_t below = 0;
+        for (std::size_t i = 0; i < n; i++) {
+            below += std::abs(w[i]) < cutoff;
+        }
+        std::size_t ties = pruned - below;
+
+        for (std::size_t i = 0; i < n; i++) {
+            const float magnitude = std::abs(w[i]);
+            bool drop = magnitude < cutoff;
+            if (!drop && magnitude == cutoff && ties > 0) {
+                drop = true;
+                ties--;
+            }
+            keep[i] = drop ? 0.0f : 1.0f;
+        }
+    }
+};
@@ -1,29 +1,105 @@
 #pragma once
 
+#include "ActivationStore.hpp"
+#include "Cell.hpp"
+#include "Optimizer.hpp"
+#include "Parameters.hpp"
+#include "Precision.hpp"
+#include "Pruning.hpp"
+#include "LinearLib/Arena.hpp"
+#include "LinearLib/Autotune.hpp"
+#include "LinearLib/Half.hpp"
 #include "LinearLib/Matrix.hpp"
+#include "LinearLib/Sparse.hpp"
+#include <array>
+#include <type_traits>
 #include <vector>
 #include <cmath>
 
-template<std::size_t I, std::size_t H, std::size_t O>
+/**
+ * Elman network over windows of I time steps with F features each, h_t = tanh(w_i_h x_t + w_h_h h_{t-1} + b_i_h),
+ * reading the output off the last hidden state.
+ *
+ * A batch of B windows is laid out time major, column t * B + b holds step t of window b. The input projection of
+ * every step is then a single H x F by F x (I * B) GEMM and only the H x H recurrence runs step by step.
+ *
+ * Storage other than float trains in mixed precision, see Mixed: the stored activations and their gradients and a
+ * copy of the weights lowered before every forward are in Storage, so every GEMM of a training step reads half the
+ * bytes and bf16 products run on the bf16 kernel. Pre-activations, products, gradients of the weights, the master
+ * weights and the optimizer state stay float.
+ *
+ * The weight matrices can be pruned by magnitude while training, see prune(). A weight pruned past the threshold
+ * multiplies through a CSR copy and gets its gradient only where it is not pruned, so a step gets cheaper as the
+ * model gets sparser.
+ */
+template<std::size_t I, std::size_t H, std::size_t O, std::size_t F = 1, typename Storage = float>
 struct RNN {
-    LinearLib::Matrix<H, I, float> w_i_h;
-    LinearLib::Matrix<O, H, float> w_h_o;
+    static constexpr bool MIXED = !std::is_same_v<Storage, float>;
+    static_assert(!MIXED || LinearLib::IS_HALF_PRECISION<Storage>, "Activations are stored in float or half precision");
+
+    // Offsets of the weights and biases in the flat parameter and gradient buffers
+    static constexpr std::size_t W_I_H = 0;
+    static constexpr std::size_t W_H_H = W_I_H + Parameters::padded(H * F);
+    static constexpr std::size_t W_H_O = W_H_H + Parameters::padded(H * H);
+    static constexpr std::size_t B_I_H = W_H_O + Parameters::padded(O * H);
+    static constexpr std::size_t B_H_O = B_I_H + Parameters::padded(H);
+    static constexpr std::size_t PARAMETERS = B_H_O + Parameters::padded(O);
+
+    // The weight matrices, which pruning thins out, by offset and shape
+    struct Weight {
+        std::size_t offset;
+        std::size_t rows;
+        std::size_t cols;
+    };
+
+    static constexpr std::array<Weight, 3> WEIGHTS = {{{W_I_H, H, F}, {W_H_H, H, H}, {W_H_O, O, H}}};
+
+    static constexpr std::size_t index(const std::size_t offset) {
+        return offset == W_I_H ? 0 : offset == W_H_H ? 1 : 2;
+    }
+
+    Parameters parameters = Parameters(PARAMETERS);
+
+    // Hidden states h_0 .. h_I of the last forward pass and the pre-activations of steps 1 .. I, in the same time
+    // major layout as the input. Backward overwrites the pre-activations with their gradients. In mixed precision
+    // the pre-activations are summed in a float scratch instead and the store only holds their gradients.
+    BasicActivationStore<Storage> states = BasicActivationStore<Storage>(H, I + 1);
+    BasicActivationStore<Storage> preactivations = BasicActivationStore<Storage>(H, I);
+
+    // Inputs of the last I steps of a series, which truncated backpropagation needs for the input weights
+    ActivationStore inputs = ActivationStore(F, I);
+
+    // Steps per checkpoint segment and the hidden state at the start of each segment of the last forward pass
+    std::size_t interval = I;
+    BasicActivationStore<Storage> checkpoints = BasicActivationStore<Storage>(H, 1);
+
+    // Weights in Storage as of the last forward, laid out like the parameters; empty when training in float
+    std::vector<Storage> lowered = std::vector<Storage>(MIXED ? PARAMETERS : 0);
 
-    LinearLib::Matrix<H, 1, float> b_i_h;
-    LinearLib::Matrix<O, 1, float> b_h_o;
+    // Scale of the output gradients, dynamic for fp16 whose gradients would underflow unscaled, see LossScale
+    LossScale scaling = std::is_same_v<Storage, LinearLib::Half> ? LossScale(65536.0f, true) : LossScale();
 
-    std::vector<LinearLib::Matrix<H, 1, float>> history = {};
+    // CSR copies of the weights pruned past the threshold, in the order of WEIGHTS, empty while a weight runs dense
+    std::array<LinearLib::SparseMatrix<float>, WEIGHTS.size()> sparse;
+
+    // Sparsity from which a pruned weight runs on the sparse kernels, as of the last prune()
+    float threshold = Pruning().threshold;
 
     float learning_rate;
     float clip;
+
+    // Update rule and its moments, plain SGD unless configured otherwise
+    Optimizer optimizer;
     int seed;
 
-    RNN (LinearLib::Matrix<H, I, float> w_i_h, LinearLib::Matrix<O, H, float> w_h_o, LinearLib::Matrix<H, 1, float> b_i_h,
-        LinearLib::Matrix<O, 1, float> b_h_o, float learning_rate, float clip, int seed = 42) {
-        this->w_i_h = w_i_h;
-        this->w_h_o = w_h_o;
-        this->b_i_h = b_i_h;
-        this->b_h_o = b_h_o;
+    RNN (LinearLib::Matrix<H, F, float> w_i_h, LinearLib::Matrix<H, H, float> w_h_h, LinearLib::Matrix<O, H, float> w_h_o,
+        LinearLib::Matrix<H, 1, float> b_i_h, LinearLib::Matrix<O, 1, float> b_h_o, float learning_rate, float clip,
+        int seed = 42) {
+        this->w_i_h() = w_i_h;
+        this->w_h_h() = w_h_h;
+        this->w_h_o() = w_h_o;
+        this->b_i_h() = b_i_h;
+        this->b_h_o() = b_h_o;
 
         this->learning_rate = learning_rate;
         this->clip = clip;
@@ -35,106 +111,625 @@ struct RNN {
         this->clip = clip;
         this->seed = seed;
 
-        w_i_h = LinearLib::Matrix<H, I, float>::random(-1, 1, seed);
-        w_h_o = LinearLib::Matrix<O, H, float>::random(-1, 1, seed);
+        // Scaled by 1 / sqrt(H) so the recurrence neither saturates tanh nor dies out at initialisation
+        const float bound = 1.0f / std::sqrt(static_cast<float>(H));
 
-        b_i_h = LinearLib::Matrix<H, 1, float>::zeros();
-        b_h_o = LinearLib::Matrix<O, 1, float>::zeros();
+        w_i_h() = LinearLib::Matrix<H, F, float>::random(-bound, bound, seed);
+        w_h_h() = LinearLib::Matrix<H, H, float>::random(-bound, bound, seed + 1);
+        w_h_o() = LinearLib::Matrix<O, H, float>::random(-bound, bound, seed + 2);
     }
 
-    LinearLib::Matrix<O, 1, float> forward(const LinearLib::Matrix<I, 1, float>& x) {
+    auto& w_i_h() { return parameters.template value<H, F>(W_I_H); }
+    auto& w_h_h() { return parameters.template value<H, H>(W_H_H); }
+    auto& w_h_o() { return parameters.template value<O, H>(W_H_O); }
+    auto& b_i_h() { return parameters.template value<H, 1>(B_I_H); }
+    auto& b_h_o() { return parameters.template value<O, 1>(B_H_O); }
+
+    const auto& w_i_h() const { return parameters.template value<H, F>(W_I_H); }
+    const auto& w_h_h() const { return parameters.template value<H, H>(W_H_H); }
+    const auto& w_h_o() const { return parameters.template value<O, H>(W_H_O); }
+    const auto& b_i_h() const { return parameters.template value<H, 1>(B_I_H); }
+    const auto& b_h_o() const { return parameters.template value<O, 1>(B_H_O); }
+
+    // Weights at the given offset as the GEMMs of a training step read them, the lowered copy in mixed precision
+    const Storage* weight(const std::size_t offset) const {
+        if constexpr (MIXED) {
+            return lowered.data() + offset;
+        } else {
+            return parameters.values() + offset;
+        }
+    }
 
-        LinearLib::Matrix<H, 1, float> h = LinearLib::Matrix<H, 1, float>::zeros();
+    // Refreshes the lowered copy of the weights from the master weights
+    void lower() {
+        if constexpr (MIXED) {
+            const float* values = parameters.values();
+            for (std::size_t i = 0; i < PARAMETERS; i++) {
+                lowered[i] = values[i];
+            }
+        }
+    }
+
+    // c = beta * c + op(W) * b for the weight W at the given offset and n columns of b, sparse once pruned
+    template<typename T>
+    void multiply(const std::size_t offset, const bool trans, const std::size_t n, const T* b, const std::size_t ldb,
+                  const float beta, float* c, const std::size_t ldc) const {
+        const Weight& w = WEIGHTS[index(offset)];
+        const auto& compressed = sparse[index(offset)];
+
+        if (!compressed.empty()) {
+            LinearLib::spmm(compressed, trans, n, b, ldb, beta, c, ldc);
+        } else if (trans) {
+            LinearLib::strassenGemm(true, false, w.cols, n, w.rows, weight(offset), w.cols, b, ldb, beta, c, ldc);
+        } else {
+            LinearLib::strassenGemm(false, false, w.rows, n, w.cols, weight(offset), w.cols, b, ldb, beta, c, ldc);
+        }
+    }
+
+    /**
+     * Adds d * y^T over n columns to the gradient of the weight at the given offset, only where it is not pruned.
+     * Dense, the H x H recurrent gradient over a multiple of H columns goes through Strassen, see strassenGemm.
+     */
+    template<typename X, typename Y>
+    void outerProduct(const std::size_t offset, const std::size_t n, const X* d, const std::size_t ldd, const Y* y,
+                      const std::size_t ldy) {
+        const Weight& w = WEIGHTS[index(offset)];
+        const auto& compressed = sparse[index(offset)];
+        float* gradient = parameters.gradients() + offset;
+
+        if (!compressed.empty()) {
+            LinearLib::sddmm(compressed, n, d, ldd, y, ldy, gradient, w.cols);
+        } else {
+            LinearLib::strassenGemm(false, true, w.rows, w.cols, n, d, ldd, y, ldy, 1.0f, gradient, w.cols);
+        }
+    }
+
+    /**
+     * Prunes every weight matrix to the given sparsity by magnitude, see Pruning, and holds the pruned weights at
+     * zero through the optimizer from then on. Weights pruned to threshold or beyond switch to the sparse kernels.
+     * Allocates, so it runs between epochs.
+     */
+    void prune(const float sparsity, const float threshold) {
+        std::vector<float> keep(PARAMETERS, 1.0f);
+        float* values = parameters.values();
+
+        for (std::size_t k = 0; k < WEIGHTS.size(); k++) {
+            const auto [offset, rows, cols] = WEIGHTS[k];
+            Pruning::mask(values + offset, rows * cols, sparsity, keep.data() + offset);
+
+            sparse[k] = sparsity >= threshold && sparsity > 0.0f
+                        ? LinearLib::SparseMatrix<float>(rows, cols, values + offset, cols, keep.data() + offset)
+                        : LinearLib::SparseMatrix<float>();
+        }
+
+        this->threshold = threshold;
+        optimizer.mask(0, keep.data(), PARAMETERS);
+        optimizer.prune(0, values, PARAMETERS);
+        gather();
+    }
+
+    /**
+     * Prunes exactly the weights that are zero, restoring the masks and sparse copies of a pruned model read back
+     * from its sparse form, so it keeps running sparse and further training does not regrow them.
+     */
+    void prunePattern(const float threshold) {
+        std::vector<float> keep(PARAMETERS, 1.0f);
+        const float* values = parameters.values();
+
+        for (std::size_t k = 0; k < WEIGHTS.size(); k++) {
+            const auto [offset, rows, cols] = WEIGHTS[k];
+
+            std::size_t pruned = 0;
+            for (std::size_t i = offset; i < offset + rows * cols; i++) {
+                keep[i] = values[i] != 0.0f ? 1.0f : 0.0f;
+                pruned += values[i] == 0.0f;
+            }
+
+            const float sparsity = static_cast<float>(pruned) / static_cast<float>(rows * cols);
+            sparse[k] = sparsity >= threshold && sparsity > 0.0f
+                        ? LinearLib::SparseMatrix<float>(rows, cols, values + offset, cols, keep.data() + offset)
+                        : LinearLib::SparseMatrix<float>();
+        }
+
+        this->threshold = threshold;
+        optimizer.mask(0, keep.data(), PARAMETERS);
+    }
+
+    // Reloads the sparse copies from the weights after an update
+    void gather() {
+        for (std::size_t k = 0; k < WEIGHTS.size(); k++) {
+            if (!sparse[k].empty()) {
+                sparse[k].gather(parameters.values() + WEIGHTS[k].offset, WEIGHTS[k].cols);
+            }
+        }
+    }
 
-        history.push_back(h);
+    // Sizes the activation stores for batches of B, after which training never allocates
+    template<std::size_t B>
+    void reserve() {
+        states.reserve(B);
+        preactivations.reserve(B);
+        inputs.reserve(B);
+        checkpoints.reserve(B);
+    }
+
+    // Products issued by one training step on a batch of B, used to autotune the GEMM kernel for this model
+    template<std::size_t B>
+    static std::vector<LinearLib::Autotune::Shape> gemmShapes() {
+        return {{H, I * B, F}, {H, B, H}, {O, B, H}, {H, B, O}, {O, H, B}, {H, H, I * B}, {H, F, I * B}};
+    }
+
+    /**
+     * Stores only the hidden state at the start of every interval steps of a window and recomputes the activations
+     * of each segment during backward, trading about one extra forward pass for activation memory that scales with
+     * I / interval + interval instead of I. An interval of I, the default, stores everything. The interval also
+     * bounds the window of truncated backpropagation.
+     */
+    template<std::size_t B>
+    void checkpoint(std::size_t interval) {
+        interval = std::clamp<std::size_t>(interval, 1, I);
+
+        this->interval = interval;
+        states.resize(interval + 1);
+        preactivations.resize(interval);
+        inputs.resize(interval);
+        checkpoints.resize((I + interval - 1) / interval);
+
+        reserve<B>();
+    }
+
+    // Activation memory of a batch of B windows at the given checkpoint interval
+    template<std::size_t B>
+    static std::size_t activationBytes(const std::size_t interval) {
+        const std::size_t segments = (I + interval - 1) / interval;
+        return ((interval + 1) * H + interval * H + segments * H) * B * sizeof(Storage)
+               + interval * F * B * sizeof(float);
+    }
+
+    /**
+     * Forward pass over a batch of B windows laid out time major in x, one checkpoint segment at a time. Only the
+     * last segment's activations stay in the stores, the states at the start of the others in checkpoints.
+     */
+    template<std::size_t B>
+    LinearLib::Matrix<O, B, float> forward(const LinearLib::Matrix<F, I * B, float>& x) {
+
+        lower();
+        checkpoints.reset(B);
+
+        const std::size_t lc = checkpoints.ld();
+
+        auto* h_0 = checkpoints.push();
+        for (std::size_t i = 0; i < H; i++) {
+            for (std::size_t b = 0; b < B; b++) {
+                h_0[i * lc + b] = 0.0f;
+            }
+        }
 
-        for (std::size_t i = 0; i < I; i++) {
-            h = (this->w_i_h & x) + this->b_i_h;
-            sigmoid(h);
-            history.push_back(h);
+        for (std::size_t start = 0; start < I; start += interval) {
+            segment<B>(x, start);
+
+            if (start + interval < I) {
+                const auto* h = states.at(interval);
+                auto* checkpoint = checkpoints.push();
+                for (std::size_t i = 0; i < H; i++) {
+                    for (std::size_t b = 0; b < B; b++) {
+                        checkpoint[i * lc + b] = h[i * states.ld() + b];
+                    }
+                }
+            }
         }
 
-        LinearLib::Matrix<1, O, float> y = (this->w_h_o & h) + this->b_h_o;
+        LinearLib::Matrix<O, B, float> y;
+        multiply(W_H_O, false, B, states.at(states.count - 1), states.ld(), 0.0f, y.raw(), B);
+        Cell::addBias(y, this->b_h_o());
 
         return y;
     }
 
-    void backward(LinearLib::Matrix<O, 1, float> d_y) {
+    /**
+     * Backpropagation through time for the batch of the last forward, given its input x. Gradients are averaged
+     * over the first count columns, columns past count are padding and must have a zero d_y.
+     *
+     * Segments are visited last to first, each recomputed from its checkpoint unless still held. Within a segment
+     * the pre-activation gradients are kept side by side, so the input and recurrent weight gradients come out of
+     * one GEMM per segment once its sequential pass is done.
+     */
+    template<std::size_t B>
+    void backward(const LinearLib::Matrix<F, I * B, float>& x, const LinearLib::Matrix<O, B, float>& unscaled,
+                  const std::size_t count = B) {
+
+        LinearLib::Arena& arena = LinearLib::Arena::current();
+
+        const LinearLib::Matrix<O, B, float>& d_y = scaled(arena, unscaled);
+
+        parameters.clearGradients();
 
-        // Init derivatives
-        LinearLib::Matrix<O, H, float> d_w_h_o = LinearLib::Matrix<O, H, float>::zeros();
-        LinearLib::Matrix<H, I, float> d_w_i_h = LinearLib::Matrix<H, I, float>::zeros();
+        auto& d_b_i_h = parameters.template gradient<H, 1>(B_I_H);
+        auto& d_b_h_o = parameters.template gradient<O, 1>(B_H_O);
 
-        LinearLib::Matrix<O, 1, float> d_b_h_o = LinearLib::Matrix<O, 1, float>::zeros();
-        LinearLib::Matrix<H, 1, float> d_b_i_h = LinearLib::Matrix<H, 1, float>::zeros();
+        // Output layer, summed over the batch in the GEMM
+        outerProduct(W_H_O, B, d_y.raw(), B, states.at(states.count - 1), states.ld());
+        Cell::sumColumns(d_y, d_b_h_o);
 
-        LinearLib::Matrix<H, 1, float> d_h = this->w_h_o.transpose() & d_y;
+        auto& d_h = arena.make<LinearLib::Matrix<H, B, float>>();
+        multiply(W_H_O, true, B, d_y.raw(), B, 0.0f, d_h.raw(), B);
 
-        // Backprop through time
-        for (std::size_t t = this->history.size(); t > 0; --t) {
+        const std::size_t segments = (I + interval - 1) / interval;
 
-            LinearLib::Matrix<H, 1, float> h_sq = LinearLib::Matrix<H, 1, float>::zeros();
-            h_sq.forEach([this](float& val) {
-                val = static_cast<float>(std::pow(val, 2));
-            });
+        for (std::size_t j = segments; j-- > 0;) {
+            const std::size_t start = j * interval;
 
-            LinearLib::Matrix<H, 1, float> d_l_h = (LinearLib::Matrix<H, 1, float>::ones() - h_sq) * d_h;
+            // The last segment is still held from the forward pass
+            if (j + 1 < segments) {
+                segment<B>(x, start);
+            }
+
+            const std::size_t ls = states.ld();
+            const std::size_t lp = preactivations.ld();
+            const std::size_t steps = std::min(interval, I - start);
+
+            // Backprop through time
+            for (std::size_t t = steps; t > 0; --t) {
+                auto* d_a = preactivations.at(t - 1);
+                const auto* h = states.at(t);
+
+                for (std::size_t i = 0; i < H; i++) {
+                    for (std::size_t b = 0; b < B; b++) {
+                        const float val = h[i * ls + b];
+                        d_a[i * lp + b] = d_h[i][b] * (1.0f - val * val);
+                    }
+                }
+
+                if (start + t > 1) {
+                    multiply(W_H_H, true, B, d_a, lp, 0.0f, d_h.raw(), B);
+                }
+            }
 
-            d_b_i_h = d_b_i_h + d_l_h;
-            d_b_h_o = d_b_h_o + (this->w_h_o & d_l_h);
+            // A segment fills both stores from their first slot, so its steps are contiguous
+            const auto* d_a = preactivations.at(0);
 
-            // For hidden to output weights
-            d_w_h_o = d_w_h_o + (d_y & this->history[t-1].transpose());
+            Cell::sumColumns(H, steps * B, d_a, lp, d_b_i_h.raw());
+
+            // dL/dw_h_h = sum_t d_a_t h_{t-1}^T, the columns of h_{t-1} line up with those of d_a
+            outerProduct(W_H_H, steps * B, d_a, lp, states.at(0), ls);
+
+            // dL/dw_i_h = sum_t d_a_t x_t^T
+            outerProduct(W_I_H, steps * B, d_a, lp, x.raw() + start * B, I * B);
         }
 
-        // Apply gradient clipping
-        const auto clipGradient = [this](float& val) {
-            if (val > this->clip) {
-                val = this->clip;
-            } else if (val < -this->clip) {
-                val = -this->clip;
+        apply(1.0f / static_cast<float>(count));
+    }
+
+    /**
+     * Runs the segment of the window starting at the given step from its checkpoint, refilling the stores with its
+     * states and pre-activations. The input projections of the segment are one GEMM.
+     */
+    template<std::size_t B>
+    void segment(const LinearLib::Matrix<F, I * B, float>& x, const std::size_t start) {
+        const std::size_t steps = std::min(interval, I - start);
+
+        states.reset(B);
+        preactivations.reset(B);
+
+        const std::size_t ls = states.ld();
+        const std::size_t lc = checkpoints.ld();
+
+        const auto* checkpoint = checkpoints.at(start / interval);
+        auto* h = states.push();
+        for (std::size_t i = 0; i < H; i++) {
+            for (std::size_t b = 0; b < B; b++) {
+                h[i * ls + b] = checkpoint[i * lc + b];
             }
-        };
+        }
+
+        // Mixed precision sums the pre-activations in float scratch from the caller's arena, the slots of the store
+        // wait for their gradients
+        auto* slots = preactivations.push(steps);
+
+        float* u;
+        std::size_t lu;
+        if constexpr (MIXED) {
+            u = LinearLib::Arena::current().template allocate<float>(H * steps * B);
+            lu = steps * B;
+        } else {
+            u = slots;
+            lu = preactivations.ld();
+        }
 
-        // Clip
-        d_w_h_o.forEach(clipGradient);
-        d_w_i_h.forEach(clipGradient);
-        d_b_h_o.forEach(clipGradient);
-        d_b_i_h.forEach(clipGradient);
+        multiply(W_I_H, false, steps * B, x.raw() + start * B, I * B, 0.0f, u, lu);
 
-        // Apply updates (missing from your original code)
-        this->w_h_o = this->w_h_o + d_w_h_o * this->learning_rate;
-        this->w_i_h = this->w_i_h + d_w_i_h * this->learning_rate;
-        this->b_h_o = this->b_h_o + d_b_h_o * this->learning_rate;
-        this->b_i_h = this->b_i_h + d_b_i_h * this->learning_rate;
+        // h_0 is zero, so the first step of the window has no recurrent term
+        for (std::size_t t = 0; t < steps; t++) {
+            recur<B>(t, start + t > 0, u + t * B, lu);
+        }
     }
 
-    void clearHistory() {
-        history.clear();
+    /**
+     * Starts a new series of B parallel streams for truncated backpropagation through time, from a zero state.
+     */
+    template<std::size_t B>
+    void begin() {
+        states.reset(B);
+        preactivations.reset(B);
+        inputs.reset(B);
+
+        const std::size_t ls = states.ld();
+
+        auto* h_0 = states.push();
+        for (std::size_t i = 0; i < H; i++) {
+            for (std::size_t b = 0; b < B; b++) {
+                h_0[i * ls + b] = 0.0f;
+            }
+        }
     }
 
-    static void tanh(LinearLib::Matrix<H, 1, float>& x) {
-        x.forEach([](float& val) {
-            val = std::tanh(val);
-        });
+    /**
+     * Advances the carried state of the series by the given number of steps of x, F x (steps * B) time major, and
+     * writes the output of every step to y, O x (steps * B). Only the last I steps stay available to backward.
+     */
+    template<std::size_t B>
+    void advance(const float* x, const std::size_t steps, float* y) {
+
+        lower();
+
+        const std::size_t ls = states.ld();
+        const std::size_t lp = preactivations.ld();
+        const std::size_t li = inputs.ld();
+        const std::size_t first = preactivations.count;
+
+        // Float scratch for the pre-activations of the chunk in mixed precision, time major over its steps
+        float* scratch = nullptr;
+        if constexpr (MIXED) {
+            scratch = LinearLib::Arena::current().template allocate<float>(H * steps * B);
+        }
+
+        // Input projections of the chunk in one GEMM per stretch of the ring
+        for (std::size_t offset = 0; offset < steps;) {
+            const std::size_t n = std::min(steps - offset, preactivations.run(preactivations.count));
+
+            auto* u = preactivations.push(n);
+            float* stored = inputs.push(n);
+
+            for (std::size_t f = 0; f < F; f++) {
+                for (std::size_t j = 0; j < n * B; j++) {
+                    stored[f * li + j] = x[f * steps * B + offset * B + j];
+                }
+            }
+
+            if constexpr (MIXED) {
+                multiply(W_I_H, false, n * B, stored, li, 0.0f, scratch + offset * B, steps * B);
+            } else {
+                multiply(W_I_H, false, n * B, stored, li, 0.0f, u, lp);
+            }
+            offset += n;
+        }
+
+        for (std::size_t s = 0; s < steps; s++) {
+            if constexpr (MIXED) {
+                recur<B>(first + s, true, scratch + s * B, steps * B);
+            } else {
+                recur<B>(first + s, true, preactivations.at(first + s), lp);
+            }
+
+            float* out = y + s * B;
+            multiply(W_H_O, false, B, states.at(first + s + 1), ls, 0.0f, out, steps * B);
+            for (std::size_t o = 0; o < O; o++) {
+                for (std::size_t b = 0; b < B; b++) {
+                    out[o * steps * B + b] += this->b_h_o()[o][0];
+                }
+            }
+        }
     }
 
-    static void sigmoid(LinearLib::Matrix<H, 1, float>& x) {
-        x.forEach([](float& val) {
-            val = 1 / (1 + std::exp(-val));
+    /**
+     * Truncated backpropagation through time after advance, TBPTT(k1, k2) with k1 = steps: d_y holds the output
+     * gradients of the last steps, O x (steps * B), and the error flows back through the last k2 steps only, at
+     * most I. Older steps of the series are treated as constants, so the cost is independent of its length.
+     * Gradients are averaged over count scored outputs.
+     */
+    template<std::size_t B>
+    void truncatedBackward(const float* unscaled, const std::size_t steps, std::size_t k2, const std::size_t count) {
+
+        LinearLib::Arena& arena = LinearLib::Arena::current();
+
+        const float* d_y = scaled(arena, unscaled, O * steps * B);
+
+        const std::size_t ls = states.ld();
+        const std::size_t lp = preactivations.ld();
+        const std::size_t li = inputs.ld();
+
+        const std::size_t last = preactivations.count;
+        k2 = std::min({k2, last - preactivations.first(), last - states.first()});
+        assert(steps <= k2 && "The backpropagation window must cover every scored step");
+
+        const std::size_t begin = last - k2;
+        const std::size_t scored = last - steps;
+
+        parameters.clearGradients();
+
+        auto& d_b_i_h = parameters.template gradient<H, 1>(B_I_H);
+        auto& d_b_h_o = parameters.template gradient<O, 1>(B_H_O);
+
+        Cell::sumColumns(O, steps * B, d_y, steps * B, d_b_h_o.raw());
+
+        auto& d_h = arena.make<LinearLib::Matrix<H, B, float>>();
+        d_h.fill(0.0f);
+
+        for (std::size_t t = last; t-- > begin;) {
+            // Scored steps inject their output error on top of the one flowing back from later steps
+            if (t >= scored) {
+                const float* d_y_t = d_y + (t - scored) * B;
+                outerProduct(W_H_O, B, d_y_t, steps * B, states.at(t + 1), ls);
+                multiply(W_H_O, true, B, d_y_t, steps * B, 1.0f, d_h.raw(), B);
+            }
+
+            auto* d_a = preactivations.at(t);
+            const auto* h = states.at(t + 1);
+
+            for (std::size_t i = 0; i < H; i++) {
+                for (std::size_t b = 0; b < B; b++) {
+                    const float val = h[i * ls + b];
+                    d_a[i * lp + b] = d_h[i][b] * (1.0f - val * val);
+                }
+            }
+
+            if (t > begin) {
+                multiply(W_H_H, true, B, d_a, lp, 0.0f, d_h.raw(), B);
+            }
+        }
+
+        // The window may wrap around the rings, one GEMM per contiguous stretch
+        ActivationStore::forEachRun(preactivations, begin, states, begin, k2, [&](std::size_t offset, std::size_t n) {
+            const auto* d_a = preactivations.at(begin + offset);
+            Cell::sumColumns(H, n * B, d_a, lp, d_b_i_h.raw());
+            outerProduct(W_H_H, n * B, d_a, lp, states.at(begin + offset), ls);
         });
-    }
 
-    static void relu(LinearLib::Matrix<H, 1, float>& x) {
-        x.forEach([](float& val) {
-            val = std::max(0.0f, val);
+        ActivationStore::forEachRun(preactivations, begin, inputs, begin, k2, [&](std::size_t offset, std::size_t n) {
+            outerProduct(W_I_H, n * B, preactivations.at(begin + offset), lp, inputs.at(begin + offset), li);
         });
+
+        apply(1.0f / static_cast<float>(count));
+    }
+
+    /**
+     * Averages the raw gradients by scale, clips them and applies them with the optimizer, one pass over the model.
+     * In mixed precision the loss scale is divided out too, and a step whose gradients overflowed is skipped.
+     */
+    void apply(float scale) {
+        if constexpr (MIXED) {
+            const float applied = scaling.scale;
+            if (!scaling.update(parameters.gradients(), PARAMETERS)) {
+                return;
+            }
+            scale /= applied;
+        }
+
+        optimizer.step();
+        optimizer.update(0, parameters.values(), parameters.gradients(), PARAMETERS, scale, this->clip,
+                         this->learning_rate);
+        gather();
+    }
+
+    // The output gradients times the loss scale in an arena copy, or the gradients themselves when unscaled
+    template<std::size_t B>
+    const LinearLib::Matrix<O, B, float>& scaled(LinearLib::Arena& arena, const LinearLib::Matrix<O, B, float>& d_y) {
+        if (!MIXED || scaling.scale == 1.0f) {
+            return d_y;
+        }
+        auto& res = arena.make<LinearLib::Matrix<O, B, float>>();
+        for (std::size_t i = 0; i < O * B; i++) {
+            res.raw()[i] = d_y.raw()[i] * scaling.scale;
+        }
+        return res;
+    }
+
+    const float* scaled(LinearLib::Arena& arena, const float* d_y, const std::size_t n) {
+        if (!MIXED || scaling.scale == 1.0f) {
+            return d_y;
+        }
+        float* res = arena.allocate<float>(n);
+        for (std::size_t i = 0; i < n; i++) {
+            res[i] = d_y[i] * scaling.scale;
+        }
+        return res;
+    }
+
+    /**
+     * Runs step t of the recurrence on top of its input projection, which is already in pre with leading dimension
+     * lp, h_{t+1} = tanh(u_t + w_h_h h_t + b_i_h). The recurrent product is skipped when h_t is known to be zero.
+     */
+    template<std::size_t B>
+    void recur(const std::size_t t, const bool recurrent, float* pre, const std::size_t lp) {
+        const std::size_t ls = states.ld();
+
+        if (recurrent) {
+            multiply(W_H_H, false, B, states.at(t), ls, 1.0f, pre, lp);
+        }
+
+        auto* h = states.push();
+        for (std::size_t i = 0; i < H; i++) {
+            for (std::size_t b = 0; b < B; b++) {
+                pre[i * lp + b] += this->b_i_h()[i][0];
+                h[i * ls + b] = std::tanh(pre[i * lp + b]);
+            }
+        }
+    }
+
+    // Hidden state of a single stream, carried from one observation to the next, see Session
+    struct State {
+        LinearLib::Matrix<H, 1, float> h = LinearLib::Matrix<H, 1, float>::zeros();
+    };
+
+    /**
+     * Advances a single stream by one observation, a single step of the recurrence from the carried state, and
+     * returns the output read off the new hidden state. The cost is O(H^2) whatever the window length I.
+     */
+    LinearLib::Matrix<O, 1, float> observe(State& state, const LinearLib::Matrix<F, 1, float>& x) const {
+        LinearLib::Matrix<H, 1, float> a;
+        LinearLib::gemm(false, false, H, 1, F, this->w_i_h().raw(), F, x.raw(), 1, 0.0f, a.raw(), 1);
+        LinearLib::gemm(false, false, H, 1, H, this->w_h_h().raw(), H, state.h.raw(), 1, 1.0f, a.raw(), 1);
+
+        for (std::size_t i = 0; i < H; i++) {
+            state.h[i][0] = std::tanh(a[i][0] + this->b_i_h()[i][0]);
+        }
+
+        LinearLib::Matrix<O, 1, float> y;
+        LinearLib::gemm(false, false, O, 1, H, this->w_h_o().raw(), H, state.h.raw(), 1, 0.0f, y.raw(), 1);
+        Cell::addBias(y, this->b_h_o());
+
+        return y;
+    }
+
+    // Drops the stored activations, keeping their memory
+    void clearHistory() {
+        states.reset(states.batch);
+        preactivations.reset(preactivations.batch);
+        inputs.reset(inputs.batch);
+        checkpoints.reset(checkpoints.batch);
+    }
+
+    // Activations run over the raw batch storage so the loops vectorize instead of going through forEach
+    template<std::size_t B>
+    static void tanh(LinearLib::Matrix<H, B, float>& x) {
+        float* val = x.raw();
+        for (std::size_t i = 0; i < H * B; i++) {
+            val[i] = std::tanh(val[i]);
+        }
     }
 
-    static RNN deserialize(const std::string& serialized) {
+    template<std::size_t B>
+    static void sigmoid(LinearLib::Matrix<H, B, float>& x) {
+        float* val = x.raw();
+        for (std::size_t i = 0; i < H * B; i++) {
+            val[i] = 1 / (1 + std::exp(-val[i]));
+        }
+    }
+
+    template<std::size_t B>
+    static void relu(LinearLib::Matrix<H, B, float>& x) {
+        float* val = x.raw();
+        for (std::size_t i = 0; i < H * B; i++) {
+            val[i] = std::max(0.0f, val[i]);
+        }
+    }
+
+    /**
+     * Reads a model written by serialize(). The sparse form is read back pruned as written, with its zero weights
+     * held at zero and those past the threshold on the sparse kernels, see prunePattern().
+     */
+    static RNN deserialize(const std::string& serialized, const bool sparse = false) {
         std::stringstream stream(serialized);
         std::string token;
 
+        const auto read = [&](auto& mat) {
+            if (sparse) {
+                Cell::readSparse(stream, mat);
+            } else {
+                Cell::read(stream, mat);
+            }
+        };
+
         std::getline(stream, token, '\x{1E}');
         assert(token == std::to_string(I) && "Invalid input size!");
 
@@ -144,6 +739,9 @@ struct RNN {
         std::getline(stream, token, '\x{1E}');
         assert(token == std::to_string(O) && "Invalid output size!");
 
+        std::getline(stream, token, '\x{1E}');
+        assert(token == std::to_string(F) && "Invalid feature count!");
+
         std::getline(stream, token, '\x{1E}');
         float learning_rate = std::stof(token);
 
@@ -153,67 +751,80 @@ struct RNN {
         std::getline(stream, token, '\x{1E}');
         int seed = std::stoi(token);
 
-        LinearLib::Matrix<H, I, float> w_i_h;
-        for (std::size_t i = 0; i < H; i++) {
-            for (std::size_t j = 0; j < I; j++) {
-                std::getline(stream, token, '\x{1E}');
-                w_i_h[i][j] = std::stof(token);
-            }
+        float threshold = Pruning().threshold;
+        if (sparse) {
+            std::getline(stream, token, '\x{1E}');
+            threshold = std::stof(token);
         }
 
+        LinearLib::Matrix<H, F, float> w_i_h;
+        read(w_i_h);
+
+        LinearLib::Matrix<H, H, float> w_h_h;
+        read(w_h_h);
+
         LinearLib::Matrix<H, 1, float> b_i_h;
-        for (std::size_t i = 0; i < H; i++) {
-            std::getline(stream, token, '\x{1E}');
-            b_i_h[i][0] = std::stof(token);
-        }
+        read(b_i_h);
 
-        LinearLib::Matrix<H, 1, float> w_h_o;
-        for (std::size_t i = 0; i < O; i++) {
-            for (std::size_t j = 0; j < H; j++) {
-                std::getline(stream, token, '\x{1E}');
-                w_h_o[i][j] = std::stof(token);
-            }
-        }
+        LinearLib::Matrix<O, H, float> w_h_o;
+        read(w_h_o);
 
         LinearLib::Matrix<O, 1, float> b_h_o;
-        for (std::size_t i = 0; i < O; i++) {
-            std::getline(stream, token, '\x{1E}');
-            b_h_o[i][0] = std::stof(token);
+        read(b_h_o);
+
+        RNN res(w_i_h, w_h_h, w_h_o, b_i_h, b_h_o, learning_rate, clip, seed);
+        if (sparse) {
+            res.prunePattern(threshold);
         }
 
-        return RNN(w_i_h, w_h_o, b_i_h, b_h_o, learning_rate, clip, seed);
+        return res;
     }
 
-    [[nodiscard]] std::string serialize() const {
+    // Sparse form writes only the nonzero weights with their indices and the threshold of the sparse kernels, e.g.
+    // for a model pruned to a high sparsity
+    [[nodiscard]] std::string serialize(const bool sparse = false) const {
 
         std::stringstream stream("");
 
-        stream << I << "\x{1E}" << H << "\x{1E}" << O << "\x{1E}" << learning_rate << "\x{1E}" << clip << "\x{1E}" << seed << "\x{1E}";
-
-        for (std::size_t i = 0; i < H; i++) {
-            for (std::size_t j = 0; j < I; j++) {
-                stream << w_i_h[i][j] << "\x{1E}";
+        const auto write = [&](const auto& mat) {
+            if (sparse) {
+                Cell::writeSparse(stream, mat);
+            } else {
+                Cell::write(stream, mat);
             }
-        }
+        };
 
-        for (std::size_t i = 0; i < H; i++) {
-            stream << b_i_h[i][0] << "\x{1E}";
+        stream << I << "\x{1E}" << H << "\x{1E}" << O << "\x{1E}" << F << "\x{1E}" << learning_rate << "\x{1E}" << clip << "\x{1E}" << seed << "\x{1E}";
+        if (sparse) {
+            stream << threshold << "\x{1E}";
         }
 
-        for (std::size_t i = 0; i < O; i++) {
-            for (std::size_t j = 0; j < H; j++) {
-                stream << w_h_o[i][j] << "\x{1E}";
-            }
-        }
-
-        for (std::size_t i = 0; i < O; i++) {
-            stream << b_h_o[i][0] << "\x{1E}";
-        }
+        write(w_i_h());
+        write(w_h_h());
+        write(b_i_h());
+        write(w_h_o());
+        write(b_h_o());
 
         return stream.str();
     }
 
+    // Final hidden state of the first window in the last batch
     LinearLib::Matrix<H, 1, float> get_hidden_state() {
-        return history.back();
+        LinearLib::Matrix<H, 1, float> res;
+        const auto* last = states.at(states.count - 1);
+        for (std::size_t i = 0; i < H; i++) {
+            res[i][0] = last[i * states.ld()];
+        }
+        return res;
     }
 };
+
+/**
+ * The RNN trained in mixed precision with activations stored as Storage, as a model for Environment, e.g.
+ * Environment<I, H, O, B, F, Mixed<LinearLib::BFloat16>::RNN>.
+ */
+template<typename Storage>
+struct Mixed {
+    template<std::size_t I, std::size_t H, std::size_t O, std::size_t F>
+    using RNN = ::RNN<I, H, O, F, Storage>;
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "LinearLib/Matrix.hpp"
+
+/**
+ * Stateful inference over a live series: keeps the recurrent state of a single stream and advances it by one cell
+ * step per new observation, so the latency of a forecast does not depend on the lookback I. The model is shared,
+ * not copied, and must outlive the session.
+ *
+ * The state is a plain value, so snapshot() and restore() allow what-if forecasts, e.g. feeding hypothetical
+ * observations and rolling back to the real state afterwards.
+ */
+template<typename Model>
+struct Session {
+    using State = typename Model::State;
+
+    const Model& model;
+    State state;
+
+    explicit Session(const Model& model) : model(model) {}
+
+    // Ingests the next observation and returns the forecast that follows it
+    template<std::size_t F>
+    auto observe(const LinearLib::Matrix<F, 1, float>& x) {
+        return model.observe(state, x);
+    }
+
+    [[nodiscard]] State snapshot() const {
+        return state;
+    }
+
+    void restore(const State& snapshot) {
+        state = snapshot;
+    }
+
+    // Starts over from the zero state the models are trained from
+    void reset() {
+        state = State();
+    }
+};
@@ -0,0 +1,411 @@
+#pragma once
+
+#include "ActivationStore.hpp"
+#include "Cell.hpp"
+#include "Optimizer.hpp"
+#include "Parameters.hpp"
+#include "Wavefront.hpp"
+#include "LinearLib/Arena.hpp"
+#include "LinearLib/Autotune.hpp"
+#include "LinearLib/Matrix.hpp"
+#include <vector>
+#include <cmath>
+
+/**
+ * Stack of LAYERS Elman layers over windows of I time steps with F features each, reading the output off the last
+ * hidden state of the top layer. Layer 0 reads the input, every layer above reads the hidden state of the one below
+ *
+ *   h^l_t = tanh(w_x^l h^{l-1}_t + w_h^l h^l_{t-1} + b^l),   h^{-1}_t = x_t
+ *
+ * Layer l only needs step t of layer l - 1, so the layers run as a Wavefront, one thread each: layer l is on step t
+ * while layer l - 1 is on step t + 1, and backward runs the same wavefront top down. On a host with a core per layer
+ * a deep stack then takes little longer than a single layer.
+ *
+ * The hidden states and pre-activations of all layers live in one shared store each, step t of layer l being the H
+ * row block l of step t, in the time major layout of RNN. Layers hand their activations to one another through
+ * these stores alone, so a training step allocates nothing.
+ */
+template<std::size_t I, std::size_t H, std::size_t O, std::size_t F = 1, std::size_t LAYERS = 2>
+struct StackedRNN {
+    static_assert(LAYERS > 0, "A stack needs at least one layer");
+
+    // Offsets of the weights and biases in the flat parameter and gradient buffers. Layer 0 reads F features, the
+    // layers above it H, so they are LAYER apart from the end of layer 0 on.
+    static constexpr std::size_t FIRST = Parameters::padded(H * F) + Parameters::padded(H * H) + Parameters::padded(H);
+    static constexpr std::size_t LAYER = 2 * Parameters::padded(H * H) + Parameters::padded(H);
+
+    static constexpr std::size_t W_X(const std::size_t l) {
+        return l == 0 ? 0 : FIRST + (l - 1) * LAYER;
+    }
+
+    static constexpr std::size_t W_H(const std::size_t l) {
+        return W_X(l) + Parameters::padded(H * (l == 0 ? F : H));
+    }
+
+    static constexpr std::size_t B_H(const std::size_t l) {
+        return W_H(l) + Parameters::padded(H * H);
+    }
+
+    static constexpr std::size_t W_H_O = W_X(LAYERS);
+    static constexpr std::size_t B_H_O = W_H_O + Parameters::padded(O * H);
+    static constexpr std::size_t PARAMETERS = B_H_O + Parameters::padded(O);
+
+    Parameters parameters = Parameters(PARAMETERS);
+
+    // Hidden states h_0 .. h_I and pre-activations of steps 1 .. I of every layer, as LAYERS row blocks of H. Backward
+    // overwrites the pre-activations with their gradients.
+    ActivationStore states = ActivationStore(LAYERS * H, I + 1);
+    ActivationStore preactivations = ActivationStore(LAYERS * H, I);
+
+    Wavefront wavefront = Wavefront(LAYERS);
+
+    float learning_rate;
+    float clip;
+
+    // Update rule and its moments, plain SGD unless configured otherwise
+    Optimizer optimizer;
+    int seed;
+
+    StackedRNN(float learning_rate, float clip, int seed = 42) {
+        this->learning_rate = learning_rate;
+        this->clip = clip;
+        this->seed = seed;
+
+        // Scaled by 1 / sqrt(H) so the recurrence neither saturates tanh nor dies out at initialisation
+        const float bound = 1.0f / std::sqrt(static_cast<float>(H));
+
+        w_i_h() = LinearLib::Matrix<H, F, float>::random(-bound, bound, seed);
+        for (std::size_t l = 0; l < LAYERS; l++) {
+            const int layer = seed + 1 + 2 * static_cast<int>(l);
+
+            if (l > 0) {
+                w_x(l) = LinearLib::Matrix<H, H, float>::random(-bound, bound, layer - 1);
+            }
+            w_h(l) = LinearLib::Matrix<H, H, float>::random(-bound, bound, layer);
+        }
+        w_h_o() = LinearLib::Matrix<O, H, float>::random(-bound, bound, seed + 1 + 2 * static_cast<int>(LAYERS));
+    }
+
+    // Input weights of layer 0
+    auto& w_i_h() { return parameters.template value<H, F>(W_X(0)); }
+    auto& w_h_o() { return parameters.template value<O, H>(W_H_O); }
+    auto& b_h_o() { return parameters.template value<O, 1>(B_H_O); }
+
+    const auto& w_i_h() const { return parameters.template value<H, F>(W_X(0)); }
+    const auto& w_h_o() const { return parameters.template value<O, H>(W_H_O); }
+    const auto& b_h_o() const { return parameters.template value<O, 1>(B_H_O); }
+
+    // Input weights of layer l > 0 applied to the layer below, its recurrent weights and its bias
+    auto& w_x(const std::size_t l) { return parameters.template value<H, H>(layerAbove(l)); }
+    auto& w_h(const std::size_t l) { return parameters.template value<H, H>(W_H(l)); }
+    auto& b_h(const std::size_t l) { return parameters.template value<H, 1>(B_H(l)); }
+
+    const auto& w_x(const std::size_t l) const { return parameters.template value<H, H>(layerAbove(l)); }
+    const auto& w_h(const std::size_t l) const { return parameters.template value<H, H>(W_H(l)); }
+    const auto& b_h(const std::size_t l) const { return parameters.template value<H, 1>(B_H(l)); }
+
+    static std::size_t layerAbove(const std::size_t l) {
+        assert(l > 0 && l < LAYERS && "Only the layers above the first read a hidden state");
+        return W_X(l);
+    }
+
+    // Sizes the activation stores for batches of B, after which training never allocates
+    template<std::size_t B>
+    void reserve() {
+        states.reserve(B);
+        preactivations.reserve(B);
+    }
+
+    // Products issued by one training step on a batch of B, used to autotune the GEMM kernel for this model
+    template<std::size_t B>
+    static std::vector<LinearLib::Autotune::Shape> gemmShapes() {
+        return {{H, I * B, F}, {H, B, H}, {O, B, H}, {H, B, O}, {O, H, B}, {H, H, I * B}, {H, F, I * B}};
+    }
+
+    template<std::size_t B>
+    LinearLib::Matrix<O, B, float> forward(const LinearLib::Matrix<F, I * B, float>& x) {
+
+        states.reset(B);
+        preactivations.reset(B);
+
+        float* h_0 = states.push(I + 1);
+        preactivations.push(I);
+
+        const std::size_t ls = states.ld();
+        for (std::size_t i = 0; i < LAYERS * H; i++) {
+            for (std::size_t b = 0; b < B; b++) {
+                h_0[i * ls + b] = 0.0f;
+            }
+        }
+
+        wavefront.run([&](const std::size_t l) {
+            layer<B>(x, l);
+        });
+
+        LinearLib::Matrix<O, B, float> y;
+        LinearLib::gemm(false, false, O, B, H, this->w_h_o().raw(), H, hidden(I, LAYERS - 1), ls, 0.0f, y.raw(), B);
+        Cell::addBias(y, this->b_h_o());
+
+        return y;
+    }
+
+    /**
+     * Runs every step of layer l of the forward pass, each as soon as the layer below has published it. The input
+     * projections of layer 0 are one GEMM over the whole window.
+     */
+    template<std::size_t B>
+    void layer(const LinearLib::Matrix<F, I * B, float>& x, const std::size_t l) {
+        const std::size_t ls = states.ld();
+        const std::size_t lp = preactivations.ld();
+
+        if (l == 0) {
+            LinearLib::gemm(false, false, H, I * B, F, this->w_i_h().raw(), F, x.raw(), I * B, 0.0f,
+                            preactivation(0, 0), lp);
+        }
+
+        for (std::size_t t = 0; t < I; t++) {
+            float* pre = preactivation(t, l);
+
+            if (l > 0) {
+                wavefront.await(l - 1, t + 1);
+                LinearLib::strassenGemm(false, false, H, B, H, w_x(l).raw(), H, hidden(t + 1, l - 1), ls, 0.0f,
+                                        pre, lp);
+            }
+
+            // h_0 is zero, so the first step of the window has no recurrent term
+            if (t > 0) {
+                LinearLib::strassenGemm(false, false, H, B, H, w_h(l).raw(), H, hidden(t, l), ls, 1.0f, pre, lp);
+            }
+
+            float* h = hidden(t + 1, l);
+            const auto& bias = b_h(l);
+            for (std::size_t i = 0; i < H; i++) {
+                for (std::size_t b = 0; b < B; b++) {
+                    pre[i * lp + b] += bias[i][0];
+                    h[i * ls + b] = std::tanh(pre[i * lp + b]);
+                }
+            }
+
+            wavefront.publish(l, t + 1);
+        }
+    }
+
+    /**
+     * Backpropagation through time for the batch of the last forward, given its input x. Gradients are averaged
+     * over the first count columns, columns past count are padding and must have a zero d_y.
+     *
+     * The error enters at the top layer and runs down the stack as a wavefront too: stage s backpropagates layer
+     * LAYERS - 1 - s, picking up the gradient of step t from the layer above once that layer has published it.
+     */
+    template<std::size_t B>
+    void backward(const LinearLib::Matrix<F, I * B, float>& x, const LinearLib::Matrix<O, B, float>& d_y,
+                  const std::size_t count = B) {
+
+        LinearLib::Arena& arena = LinearLib::Arena::current();
+
+        parameters.clearGradients();
+
+        auto& d_w_h_o = parameters.template gradient<O, H>(W_H_O);
+        auto& d_b_h_o = parameters.template gradient<O, 1>(B_H_O);
+
+        // Output layer, summed over the batch in the GEMM
+        LinearLib::gemm(false, true, O, H, B, d_y.raw(), B, hidden(I, LAYERS - 1), states.ld(), 0.0f, d_w_h_o.raw(),
+                        H);
+        Cell::sumColumns(d_y, d_b_h_o);
+
+        // The hidden state gradient each layer carries back through time, taken before the threads start
+        float* d_h = arena.allocate<float>(LAYERS * H * B);
+        std::fill_n(d_h, LAYERS * H * B, 0.0f);
+        LinearLib::gemm(true, false, H, B, O, this->w_h_o().raw(), H, d_y.raw(), B, 0.0f, d_h + (LAYERS - 1) * H * B,
+                        B);
+
+        wavefront.run([&](const std::size_t s) {
+            layerBackward<B>(x, LAYERS - 1 - s, d_h + (LAYERS - 1 - s) * H * B);
+        });
+
+        apply(1.0f / static_cast<float>(count));
+    }
+
+    /**
+     * Backpropagates layer l through time, d_h holding the gradient of its last hidden state, then takes its weight
+     * gradients with one GEMM each over the whole window.
+     */
+    template<std::size_t B>
+    void layerBackward(const LinearLib::Matrix<F, I * B, float>& x, const std::size_t l, float* d_h) {
+        const std::size_t ls = states.ld();
+        const std::size_t lp = preactivations.ld();
+        const std::size_t stage = LAYERS - 1 - l;
+
+        for (std::size_t t = I; t > 0; --t) {
+            // The layer above reads h_t of this layer, so its input gradient at step t adds to d_h
+            if (l + 1 < LAYERS) {
+                wavefront.await(stage - 1, I - t + 1);
+                LinearLib::strassenGemm(true, false, H, B, H, w_x(l + 1).raw(), H, preactivation(t - 1, l + 1), lp,
+                                        1.0f, d_h, B);
+            }
+
+            float* d_a = preactivation(t - 1, l);
+            const float* h = hidden(t, l);
+
+            for (std::size_t i = 0; i < H; i++) {
+                for (std::size_t b = 0; b < B; b++) {
+                    const float val = h[i * ls + b];
+                    d_a[i * lp + b] = d_h[i * B + b] * (1.0f - val * val);
+                }
+            }
+
+            wavefront.publish(stage, I - t + 1);
+
+            if (t > 1) {
+                LinearLib::strassenGemm(true, false, H, B, H, w_h(l).raw(), H, d_a, lp, 0.0f, d_h, B);
+            }
+        }
+
+        float* gradients = parameters.gradients();
+        const float* d_a = preactivation(0, l);
+
+        Cell::sumColumns(H, I * B, d_a, lp, gradients + B_H(l));
+
+        // dL/dw_h = sum_t d_a_t h_{t-1}^T, the columns of h_{t-1} line up with those of d_a
+        LinearLib::strassenGemm(false, true, H, H, I * B, d_a, lp, hidden(0, l), ls, 0.0f, gradients + W_H(l), H);
+
+        // dL/dw_x = sum_t d_a_t x_t^T, the input being the layer below from layer 1 on
+        if (l == 0) {
+            LinearLib::gemm(false, true, H, F, I * B, d_a, lp, x.raw(), I * B, 0.0f, gradients + W_X(0), F);
+        } else {
+            LinearLib::strassenGemm(false, true, H, H, I * B, d_a, lp, hidden(1, l - 1), ls, 0.0f,
+                                    gradients + W_X(l), H);
+        }
+    }
+
+    // Averages the raw gradients by scale, clips them and applies them with the optimizer, one pass over the model
+    void apply(const float scale) {
+        optimizer.step();
+        optimizer.update(0, parameters.values(), parameters.gradients(), PARAMETERS, scale, this->clip,
+                         this->learning_rate);
+    }
+
+    // Hidden state h_t of layer l, H rows of the shared store
+    float* hidden(const std::size_t t, const std::size_t l) {
+        return states.at(t) + l * H * states.ld();
+    }
+
+    // Pre-activation, or after backward its gradient, of step t of layer l
+    float* preactivation(const std::size_t t, const std::size_t l) {
+        return preactivations.at(t) + l * H * preactivations.ld();
+    }
+
+    // Hidden states of every layer of a single stream, carried from one observation to the next, see Session
+    struct State {
+        LinearLib::Matrix<LAYERS * H, 1, float> h = LinearLib::Matrix<LAYERS * H, 1, float>::zeros();
+    };
+
+    /**
+     * Advances a single stream by one observation, one step of every layer from the carried states, and returns
+     * the output read off the new state of the top layer.
+     */
+    LinearLib::Matrix<O, 1, float> observe(State& state, const LinearLib::Matrix<F, 1, float>& x) const {
+        LinearLib::Matrix<H, 1, float> a;
+
+        for (std::size_t l = 0; l < LAYERS; l++) {
+            float* h = state.h.raw() + l * H;
+
+            if (l == 0) {
+                LinearLib::gemm(false, false, H, 1, F, this->w_i_h().raw(), F, x.raw(), 1, 0.0f, a.raw(), 1);
+            } else {
+                LinearLib::gemm(false, false, H, 1, H, w_x(l).raw(), H, h - H, 1, 0.0f, a.raw(), 1);
+            }
+            LinearLib::gemm(false, false, H, 1, H, w_h(l).raw(), H, h, 1, 1.0f, a.raw(), 1);
+
+            for (std::size_t i = 0; i < H; i++) {
+                h[i] = std::tanh(a[i][0] + b_h(l)[i][0]);
+            }
+        }
+
+        LinearLib::Matrix<O, 1, float> y;
+        LinearLib::gemm(false, false, O, 1, H, this->w_h_o().raw(), H, state.h.raw() + (LAYERS - 1) * H, 1, 0.0f,
+                        y.raw(), 1);
+        Cell::addBias(y, this->b_h_o());
+
+        return y;
+    }
+
+    // Drops the stored activations, keeping their memory
+    void clearHistory() {
+        states.reset(states.batch);
+        preactivations.reset(preactivations.batch);
+    }
+
+    static StackedRNN deserialize(const std::string& serialized) {
+        std::stringstream stream(serialized);
+        std::string token;
+
+        std::getline(stream, token, '\x{1E}');
+        assert(token == std::to_string(I) && "Invalid input size!");
+
+        std::getline(stream, token, '\x{1E}');
+        assert(token == std::to_string(H) && "Invalid hidden size!");
+
+        std::getline(stream, token, '\x{1E}');
+        assert(token == std::to_string(O) && "Invalid output size!");
+
+        std::getline(stream, token, '\x{1E}');
+        assert(token == std::to_string(F) && "Invalid feature count!");
+
+        std::getline(stream, token, '\x{1E}');
+        assert(token == std::to_string(LAYERS) && "Invalid layer count!");
+
+        std::getline(stream, token, '\x{1E}');
+        float learning_rate = std::stof(token);
+
+        std::getline(stream, token, '\x{1E}');
+        float clip = std::stof(token);
+
+        std::getline(stream, token, '\x{1E}');
+        int seed = std::stoi(token);
+
+        StackedRNN rnn(learning_rate, clip, seed);
+
+        Cell::read(stream, rnn.w_i_h());
+        for (std::size_t l = 0; l < LAYERS; l++) {
+            if (l > 0) {
+                Cell::read(stream, rnn.w_x(l));
+            }
+            Cell::read(stream, rnn.w_h(l));
+            Cell::read(stream, rnn.b_h(l));
+        }
+        Cell::read(stream, rnn.w_h_o());
+        Cell::read(stream, rnn.b_h_o());
+
+        return rnn;
+    }
+
+    [[nodiscard]] std::string serialize() const {
+
+        std::stringstream stream("");
+
+        stream << I << "\x{1E}" << H << "\x{1E}" << O << "\x{1E}" << F << "\x{1E}" << LAYERS << "\x{1E}" << learning_rate << "\x{1E}" << clip << "\x{1E}" << seed << "\x{1E}";
+
+        Cell::write(stream, w_i_h());
+        for (std::size_t l = 0; l < LAYERS; l++) {
+            if (l > 0) {
+                Cell::write(stream, w_x(l));
+            }
+            Cell::write(stream, w_h(l));
+            Cell::write(stream, b_h(l));
+        }
+        Cell::write(stream, w_h_o());
+        Cell::write(stream, b_h_o());
+
+        return stream.str();
+    }
+};
+
+/**
+ * A stack of the given depth as a model for Environment, e.g. Environment<I, H, O, B, F, Stacked<3>::RNN>.
+ */
+template<std::size_t LAYERS>
+struct Stacked {
+    template<std::size_t I, std::size_t H, std::size_t O, std::size_t F>
+    using RNN = StackedRNN<I, H, O, F, LAYERS>;
+};
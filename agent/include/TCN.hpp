@@ -0,0 +1,270 @@
+#pragma once
+
+#include "ActivationStore.hpp"
+#include "Cell.hpp"
+#include "Optimizer.hpp"
+#include "Parameters.hpp"
+#include "LinearLib/Arena.hpp"
+#include "LinearLib/Autotune.hpp"
+#include "LinearLib/Convolution.hpp"
+#include "LinearLib/Matrix.hpp"
+#include <vector>
+#include <cmath>
+
+/**
+ * Temporal convolutional network over windows of I time steps with F features each, reading the output off the last
+ * step. A 1 x 1 convolution lifts the input to H channels, followed by LEVELS residual blocks
+ *
+ *   a_{l+1} = a_l + relu(conv_l(a_l) + b_l)
+ *
+ * where conv_l is a causal convolution of TAPS taps dilated by 2^l, so the receptive field of the last step covers
+ * the whole window. Unlike the recurrent cells every step of a level is computed at once, each tap being one GEMM
+ * over the I * B columns of the batch, in the same time major layout as RNN.
+ */
+template<std::size_t I, std::size_t H, std::size_t O, std::size_t F = 1>
+struct TCN {
+    static constexpr std::size_t TAPS = 2;
+
+    // Fewest levels whose receptive field 1 + (TAPS - 1) * (2^LEVELS - 1) reaches back over the window
+    static constexpr std::size_t levels() {
+        std::size_t levels = 1;
+        while (1 + (TAPS - 1) * ((std::size_t{1} << levels) - 1) < I) {
+            levels++;
+        }
+        return levels;
+    }
+
+    static constexpr std::size_t LEVELS = levels();
+
+    // Offsets of the weights and biases in the flat parameter and gradient buffers, the levels one LEVEL apart
+    static constexpr std::size_t W_IN = 0;
+    static constexpr std::size_t B_IN = W_IN + Parameters::padded(H * F);
+    static constexpr std::size_t CONV = B_IN + Parameters::padded(H);
+    static constexpr std::size_t CONV_BIAS = CONV + Parameters::padded(TAPS * H * H);
+    static constexpr std::size_t LEVEL = Parameters::padded(TAPS * H * H) + Parameters::padded(H);
+    static constexpr std::size_t W_H_O = CONV + LEVELS * LEVEL;
+    static constexpr std::size_t B_H_O = W_H_O + Parameters::padded(O * H);
+    static constexpr std::size_t PARAMETERS = B_H_O + Parameters::padded(O);
+
+    Parameters parameters = Parameters(PARAMETERS);
+
+    // The input of every level and the output of its convolution branch, a_0, z_0, a_1, .. z_{LEVELS - 1}, a_LEVELS,
+    // as consecutive H row blocks of a single step of I columns per window. Backward overwrites each z with its
+    // gradient.
+    ActivationStore activations = ActivationStore((2 * LEVELS + 1) * H, I);
+
+    float learning_rate;
+    float clip;
+
+    // Update rule and its moments, plain SGD unless configured otherwise
+    Optimizer optimizer;
+    int seed;
+
+    TCN(float learning_rate, float clip, int seed = 42) {
+        this->learning_rate = learning_rate;
+        this->clip = clip;
+        this->seed = seed;
+
+        // Scaled by the fan in of each layer, the biases start at zero
+        w_in() = LinearLib::Matrix<H, F, float>::random(-1.0f / std::sqrt(static_cast<float>(F)),
+                                                        1.0f / std::sqrt(static_cast<float>(F)), seed);
+        w_h_o() = LinearLib::Matrix<O, H, float>::random(-1.0f / std::sqrt(static_cast<float>(H)),
+                                                         1.0f / std::sqrt(static_cast<float>(H)), seed + 1);
+
+        const float bound = 1.0f / std::sqrt(static_cast<float>(TAPS * H));
+        for (std::size_t l = 0; l < LEVELS; l++) {
+            conv(l) = LinearLib::Matrix<TAPS * H, H, float>::random(-bound, bound, seed + 2 + static_cast<int>(l));
+        }
+    }
+
+    auto& w_in() { return parameters.template value<H, F>(W_IN); }
+    auto& b_in() { return parameters.template value<H, 1>(B_IN); }
+    auto& w_h_o() { return parameters.template value<O, H>(W_H_O); }
+    auto& b_h_o() { return parameters.template value<O, 1>(B_H_O); }
+
+    const auto& w_in() const { return parameters.template value<H, F>(W_IN); }
+    const auto& b_in() const { return parameters.template value<H, 1>(B_IN); }
+    const auto& w_h_o() const { return parameters.template value<O, H>(W_H_O); }
+    const auto& b_h_o() const { return parameters.template value<O, 1>(B_H_O); }
+
+    // Taps of level l stacked as TAPS row blocks, the first applying to the current step
+    auto& conv(const std::size_t l) { return parameters.template value<TAPS * H, H>(CONV + l * LEVEL); }
+    auto& convBias(const std::size_t l) { return parameters.template value<H, 1>(CONV_BIAS + l * LEVEL); }
+
+    const auto& conv(const std::size_t l) const { return parameters.template value<TAPS * H, H>(CONV + l * LEVEL); }
+    const auto& convBias(const std::size_t l) const { return parameters.template value<H, 1>(CONV_BIAS + l * LEVEL); }
+
+    // Sizes the activation store for batches of B, after which training never allocates
+    template<std::size_t B>
+    void reserve() {
+        activations.reserve(B);
+    }
+
+    // Products issued by one training step on a batch of B, used to autotune the GEMM kernel for this model
+    template<std::size_t B>
+    static std::vector<LinearLib::Autotune::Shape> gemmShapes() {
+        return {{H, I * B, F}, {H, I * B, H}, {O, B, H}, {H, B, O}, {O, H, B}, {H, H, I * B}, {H, F, I * B}};
+    }
+
+    template<std::size_t B>
+    LinearLib::Matrix<O, B, float> forward(const LinearLib::Matrix<F, I * B, float>& x) {
+
+        activations.reset(B);
+        float* a = activations.push(I);
+
+        const std::size_t ld = activations.ld();
+        const std::size_t block = H * ld;
+
+        LinearLib::gemm(false, false, H, I * B, F, this->w_in().raw(), F, x.raw(), I * B, 0.0f, a, ld);
+        for (std::size_t i = 0; i < H; i++) {
+            for (std::size_t j = 0; j < I * B; j++) {
+                a[i * ld + j] += this->b_in()[i][0];
+            }
+        }
+
+        for (std::size_t l = 0; l < LEVELS; l++) {
+            float* z = a + block;
+            float* next = z + block;
+
+            LinearLib::causalConv(TAPS, std::size_t{1} << l, H, H, I, B, this->conv(l).raw(), a, ld, 0.0f, z, ld);
+
+            const auto& bias = this->convBias(l);
+            for (std::size_t i = 0; i < H; i++) {
+                for (std::size_t j = 0; j < I * B; j++) {
+                    z[i * ld + j] = std::max(0.0f, z[i * ld + j] + bias[i][0]);
+                    next[i * ld + j] = a[i * ld + j] + z[i * ld + j];
+                }
+            }
+
+            a = next;
+        }
+
+        LinearLib::Matrix<O, B, float> y;
+        LinearLib::gemm(false, false, O, B, H, this->w_h_o().raw(), H, a + (I - 1) * B, ld, 0.0f, y.raw(), B);
+        Cell::addBias(y, this->b_h_o());
+
+        return y;
+    }
+
+    /**
+     * Backpropagation for the batch of the last forward, given its input x. Gradients are averaged over the first
+     * count columns, columns past count are padding and must have a zero d_y.
+     *
+     * The gradient of the level inputs flows back through the residual connections unchanged, each level adding the
+     * transposed convolution of its branch gradient on top in place.
+     */
+    template<std::size_t B>
+    void backward(const LinearLib::Matrix<F, I * B, float>& x, const LinearLib::Matrix<O, B, float>& d_y,
+                  const std::size_t count = B) {
+
+        LinearLib::Arena& arena = LinearLib::Arena::current();
+
+        parameters.clearGradients();
+
+        auto& d_w_in = parameters.template gradient<H, F>(W_IN);
+        auto& d_b_in = parameters.template gradient<H, 1>(B_IN);
+        auto& d_w_h_o = parameters.template gradient<O, H>(W_H_O);
+        auto& d_b_h_o = parameters.template gradient<O, 1>(B_H_O);
+
+        const std::size_t ld = activations.ld();
+        const std::size_t block = H * ld;
+        const float* top = activations.at(0) + 2 * LEVELS * block;
+
+        LinearLib::gemm(false, true, O, H, B, d_y.raw(), B, top + (I - 1) * B, ld, 0.0f, d_w_h_o.raw(), H);
+        Cell::sumColumns(d_y, d_b_h_o);
+
+        // Only the last step feeds the head
+        float* d_a = arena.allocate<float>(H * I * B);
+        for (std::size_t i = 0; i < H; i++) {
+            std::fill_n(d_a + i * I * B, (I - 1) * B, 0.0f);
+        }
+        LinearLib::gemm(true, false, H, B, O, this->w_h_o().raw(), H, d_y.raw(), B, 0.0f, d_a + (I - 1) * B, I * B);
+
+        for (std::size_t l = LEVELS; l-- > 0;) {
+            const float* a = activations.at(0) + 2 * l * block;
+            float* z = activations.at(0) + (2 * l + 1) * block;
+
+            for (std::size_t i = 0; i < H; i++) {
+                for (std::size_t j = 0; j < I * B; j++) {
+                    z[i * ld + j] = z[i * ld + j] > 0.0f ? d_a[i * I * B + j] : 0.0f;
+                }
+            }
+
+            Cell::sumColumns(H, I * B, z, ld, parameters.gradients() + CONV_BIAS + l * LEVEL);
+            LinearLib::causalConvBackwardWeights(TAPS, std::size_t{1} << l, H, H, I, B, z, ld, a, ld, 0.0f,
+                                                 parameters.gradients() + CONV + l * LEVEL);
+            LinearLib::causalConvBackwardData(TAPS, std::size_t{1} << l, H, H, I, B, this->conv(l).raw(), z, ld, 1.0f,
+                                              d_a, I * B);
+        }
+
+        Cell::sumColumns(H, I * B, d_a, I * B, d_b_in.raw());
+        LinearLib::gemm(false, true, H, F, I * B, d_a, I * B, x.raw(), I * B, 0.0f, d_w_in.raw(), F);
+
+        // Average over the batch, clip and apply, one pass over the model
+        optimizer.step();
+        optimizer.update(0, parameters.values(), parameters.gradients(), PARAMETERS, 1.0f / static_cast<float>(count),
+                         this->clip, this->learning_rate);
+    }
+
+    // Drops the stored activations, keeping their memory
+    void clearHistory() {
+        activations.reset(activations.batch);
+    }
+
+    static TCN deserialize(const std::string& serialized) {
+        std::stringstream stream(serialized);
+        std::string token;
+
+        std::getline(stream, token, '\x{1E}');
+        assert(token == std::to_string(I) && "Invalid input size!");
+
+        std::getline(stream, token, '\x{1E}');
+        assert(token == std::to_string(H) && "Invalid hidden size!");
+
+        std::getline(stream, token, '\x{1E}');
+        assert(token == std::to_string(O) && "Invalid output size!");
+
+        std::getline(stream, token, '\x{1E}');
+        assert(token == std::to_string(F) && "Invalid feature count!");
+
+        std::getline(stream, token, '\x{1E}');
+        float learning_rate = std::stof(token);
+
+        std::getline(stream, token, '\x{1E}');
+        float clip = std::stof(token);
+
+        std::getline(stream, token, '\x{1E}');
+        int seed = std::stoi(token);
+
+        TCN tcn(learning_rate, clip, seed);
+
+        Cell::read(stream, tcn.w_in());
+        Cell::read(stream, tcn.b_in());
+        for (std::size_t l = 0; l < LEVELS; l++) {
+            Cell::read(stream, tcn.conv(l));
+            Cell::read(stream, tcn.convBias(l));
+        }
+        Cell::read(stream, tcn.w_h_o());
+        Cell::read(stream, tcn.b_h_o());
+
+        return tcn;
+    }
+
+    [[nodiscard]] std::string serialize() const {
+
+        std::stringstream stream("");
+
+        stream << I << "\x{1E}" << H << "\x{1E}" << O << "\x{1E}" << F << "\x{1E}" << learning_rate << "\x{1E}" << clip << "\x{1E}" << seed << "\x{1E}";
+
+        Cell::write(stream, w_in());
+        Cell::write(stream, b_in());
+        for (std::size_t l = 0; l < LEVELS; l++) {
+            Cell::write(stream, conv(l));
+            Cell::write(stream, convBias(l));
+        }
+        Cell::write(stream, w_h_o());
+        Cell::write(stream, b_h_o());
+
+        return stream.str();
+    }
+};
@@ -0,0 +1,474 @@
+#pragma once
+
+#include "ActivationStore.hpp"
+#include "Cell.hpp"
+#include "Optimizer.hpp"
+#include "Parameters.hpp"
+#include "LinearLib/Arena.hpp"
+#include "LinearLib/Attention.hpp"
+#include "LinearLib/Autotune.hpp"
+#include "LinearLib/Matrix.hpp"
+#include <vector>
+#include <cmath>
+
+/**
+ * Small transformer encoder over windows of I time steps with F features each, reading the output off the last
+ * step. The input is projected to H channels plus a learned embedding of its position, followed by LAYERS pre-norm
+ * blocks
+ *
+ *   x = x + W_o attention(W_qkv norm_1(x))
+ *   x = x + W_2 relu(W_1 norm_2(x))
+ *
+ * with HEADS heads of causal self-attention, so step t only attends to steps up to t, and an MLP of EXPANSION * H
+ * hidden units. Every projection is one GEMM over the I * B columns of the batch. Attention runs per window and head
+ * through LinearLib::attention, which tiles over the keys with an online softmax instead of forming the I x I scores.
+ *
+ * Inside the model the columns are batch major, column b * I + t holding step t of window b, so the queries, keys and
+ * values of one window and head are plain strided blocks for the attention kernel.
+ */
+template<std::size_t I, std::size_t H, std::size_t O, std::size_t F = 1>
+struct Transformer {
+    static constexpr std::size_t LAYERS = 2;
+    static constexpr std::size_t HEADS = 4;
+    static constexpr std::size_t EXPANSION = 4;
+
+    static constexpr std::size_t HEAD = H / HEADS;
+    static constexpr std::size_t MLP = EXPANSION * H;
+
+    static_assert(H % HEADS == 0, "Channels must split evenly over the heads");
+
+    // Offsets of the weights and biases in the flat parameter and gradient buffers, the blocks one LAYER apart
+    static constexpr std::size_t W_IN = 0;
+    static constexpr std::size_t B_IN = W_IN + Parameters::padded(H * F);
+    static constexpr std::size_t POSITION = B_IN + Parameters::padded(H);
+    static constexpr std::size_t BLOCKS = POSITION + Parameters::padded(H * I);
+
+    // Offsets within a block
+    static constexpr std::size_t GAMMA_1 = 0;
+    static constexpr std::size_t BETA_1 = GAMMA_1 + Parameters::padded(H);
+    static constexpr std::size_t W_QKV = BETA_1 + Parameters::padded(H);
+    static constexpr std::size_t B_QKV = W_QKV + Parameters::padded(3 * H * H);
+    static constexpr std::size_t W_O = B_QKV + Parameters::padded(3 * H);
+    static constexpr std::size_t B_O = W_O + Parameters::padded(H * H);
+    static constexpr std::size_t GAMMA_2 = B_O + Parameters::padded(H);
+    static constexpr std::size_t BETA_2 = GAMMA_2 + Parameters::padded(H);
+    static constexpr std::size_t W_1 = BETA_2 + Parameters::padded(H);
+    static constexpr std::size_t B_1 = W_1 + Parameters::padded(MLP * H);
+    static constexpr std::size_t W_2 = B_1 + Parameters::padded(MLP);
+    static constexpr std::size_t B_2 = W_2 + Parameters::padded(H * MLP);
+    static constexpr std::size_t LAYER = B_2 + Parameters::padded(H);
+
+    static constexpr std::size_t W_H_O = BLOCKS + LAYERS * LAYER;
+    static constexpr std::size_t B_H_O = W_H_O + Parameters::padded(O * H);
+    static constexpr std::size_t PARAMETERS = B_H_O + Parameters::padded(O);
+
+    // Rows each block keeps for backpropagation: both normalised inputs before and after their affine map, the
+    // queries, keys and values, the attention output, the MLP's hidden units, the reciprocal standard deviations of
+    // both norms and the log-sum-exp of every head
+    static constexpr std::size_t X_HAT_1 = 0;
+    static constexpr std::size_t NORM_1 = X_HAT_1 + H;
+    static constexpr std::size_t QKV = NORM_1 + H;
+    static constexpr std::size_t CONTEXT = QKV + 3 * H;
+    static constexpr std::size_t X_HAT_2 = CONTEXT + H;
+    static constexpr std::size_t NORM_2 = X_HAT_2 + H;
+    static constexpr std::size_t HIDDEN = NORM_2 + H;
+    static constexpr std::size_t RSTD_1 = HIDDEN + MLP;
+    static constexpr std::size_t RSTD_2 = RSTD_1 + 1;
+    static constexpr std::size_t LSE = RSTD_2 + 1;
+    static constexpr std::size_t ROWS = LSE + HEADS;
+
+    // The residual stream, overwritten block by block, follows the blocks
+    static constexpr std::size_t STREAM = LAYERS * ROWS;
+
+    Parameters parameters = Parameters(PARAMETERS);
+
+    // A single step of I columns per window, see the layout above
+    ActivationStore activations = ActivationStore(STREAM + H, I);
+
+    float learning_rate;
+    float clip;
+
+    // Update rule and its moments, plain SGD unless configured otherwise
+    Optimizer optimizer;
+    int seed;
+
+    Transformer(float learning_rate, float clip, int seed = 42) {
+        this->learning_rate = learning_rate;
+        this->clip = clip;
+        this->seed = seed;
+
+        // Scaled by the fan in of each layer, the norms start as the identity and the biases at zero
+        const float input = 1.0f / std::sqrt(static_cast<float>(F));
+        const float hidden = 1.0f / std::sqrt(static_cast<float>(H));
+        const float expanded = 1.0f / std::sqrt(static_cast<float>(MLP));
+
+        w_in() = LinearLib::Matrix<H, F, float>::random(-input, input, seed);
+        position() = LinearLib::Matrix<H, I, float>::random(-0.1f, 0.1f, seed + 1);
+        w_h_o() = LinearLib::Matrix<O, H, float>::random(-hidden, hidden, seed + 2);
+
+        for (std::size_t l = 0; l < LAYERS; l++) {
+            const int layer = seed + 3 + 4 * static_cast<int>(l);
+
+            w_qkv(l) = LinearLib::Matrix<3 * H, H, float>::random(-hidden, hidden, layer);
+            w_o(l) = LinearLib::Matrix<H, H, float>::random(-hidden, hidden, layer + 1);
+            w_1(l) = LinearLib::Matrix<MLP, H, float>::random(-hidden, hidden, layer + 2);
+            w_2(l) = LinearLib::Matrix<H, MLP, float>::random(-expanded, expanded, layer + 3);
+
+            gamma_1(l).fill(1.0f);
+            gamma_2(l).fill(1.0f);
+        }
+    }
+
+    auto& w_in() { return parameters.template value<H, F>(W_IN); }
+    auto& b_in() { return parameters.template value<H, 1>(B_IN); }
+    auto& position() { return parameters.template value<H, I>(POSITION); }
+    auto& w_h_o() { return parameters.template value<O, H>(W_H_O); }
+    auto& b_h_o() { return parameters.template value<O, 1>(B_H_O); }
+
+    const auto& w_in() const { return parameters.template value<H, F>(W_IN); }
+    const auto& b_in() const { return parameters.template value<H, 1>(B_IN); }
+    const auto& position() const { return parameters.template value<H, I>(POSITION); }
+    const auto& w_h_o() const { return parameters.template value<O, H>(W_H_O); }
+    const auto& b_h_o() const { return parameters.template value<O, 1>(B_H_O); }
+
+    // Parameters of block l, the queries, keys and values stacked as row blocks of w_qkv
+    auto& gamma_1(const std::size_t l) { return block<H, 1>(l, GAMMA_1); }
+    auto& beta_1(const std::size_t l) { return block<H, 1>(l, BETA_1); }
+    auto& w_qkv(const std::size_t l) { return block<3 * H, H>(l, W_QKV); }
+    auto& b_qkv(const std::size_t l) { return block<3 * H, 1>(l, B_QKV); }
+    auto& w_o(const std::size_t l) { return block<H, H>(l, W_O); }
+    auto& b_o(const std::size_t l) { return block<H, 1>(l, B_O); }
+    auto& gamma_2(const std::size_t l) { return block<H, 1>(l, GAMMA_2); }
+    auto& beta_2(const std::size_t l) { return block<H, 1>(l, BETA_2); }
+    auto& w_1(const std::size_t l) { return block<MLP, H>(l, W_1); }
+    auto& b_1(const std::size_t l) { return block<MLP, 1>(l, B_1); }
+    auto& w_2(const std::size_t l) { return block<H, MLP>(l, W_2); }
+    auto& b_2(const std::size_t l) { return block<H, 1>(l, B_2); }
+
+    const auto& gamma_1(const std::size_t l) const { return block<H, 1>(l, GAMMA_1); }
+    const auto& beta_1(const std::size_t l) const { return block<H, 1>(l, BETA_1); }
+    const auto& w_qkv(const std::size_t l) const { return block<3 * H, H>(l, W_QKV); }
+    const auto& b_qkv(const std::size_t l) const { return block<3 * H, 1>(l, B_QKV); }
+    const auto& w_o(const std::size_t l) const { return block<H, H>(l, W_O); }
+    const auto& b_o(const std::size_t l) const { return block<H, 1>(l, B_O); }
+    const auto& gamma_2(const std::size_t l) const { return block<H, 1>(l, GAMMA_2); }
+    const auto& beta_2(const std::size_t l) const { return block<H, 1>(l, BETA_2); }
+    const auto& w_1(const std::size_t l) const { return block<MLP, H>(l, W_1); }
+    const auto& b_1(const std::size_t l) const { return block<MLP, 1>(l, B_1); }
+    const auto& w_2(const std::size_t l) const { return block<H, MLP>(l, W_2); }
+    const auto& b_2(const std::size_t l) const { return block<H, 1>(l, B_2); }
+
+    template<std::size_t R, std::size_t C>
+    auto& block(const std::size_t l, const std::size_t offset) {
+        return parameters.template value<R, C>(BLOCKS + l * LAYER + offset);
+    }
+
+    template<std::size_t R, std::size_t C>
+    const auto& block(const std::size_t l, const std::size_t offset) const {
+        return parameters.template value<R, C>(BLOCKS + l * LAYER + offset);
+    }
+
+    // Sizes the activation store for batches of B, after which training never allocates
+    template<std::size_t B>
+    void reserve() {
+        activations.reserve(B);
+    }
+
+    // Products issued by one training step on a batch of B, used to autotune the GEMM kernel for this model
+    template<std::size_t B>
+    static std::vector<LinearLib::Autotune::Shape> gemmShapes() {
+        constexpr std::size_t tile = std::min(I, LinearLib::ATTENTION_BLOCK);
+        return {{3 * H, I * B, H}, {H, I * B, H}, {MLP, I * B, H}, {H, I * B, MLP}, {tile, tile, HEAD},
+                {HEAD, tile, tile}, {3 * H, H, I * B}, {MLP, H, I * B}, {H, MLP, I * B}, {H, I * B, 3 * H}};
+    }
+
+    template<std::size_t B>
+    LinearLib::Matrix<O, B, float> forward(const LinearLib::Matrix<F, I * B, float>& x) {
+        constexpr std::size_t N = I * B;
+
+        LinearLib::Arena& arena = LinearLib::Arena::current();
+
+        activations.reset(B);
+        float* base = activations.push(I);
+
+        const std::size_t ld = activations.ld();
+        float* stream = base + STREAM * ld;
+
+        const float* input = batchMajor<B>(x, arena);
+        LinearLib::gemm(false, false, H, N, F, this->w_in().raw(), F, input, N, 0.0f, stream, ld);
+        for (std::size_t i = 0; i < H; i++) {
+            for (std::size_t b = 0; b < B; b++) {
+                for (std::size_t t = 0; t < I; t++) {
+                    stream[i * ld + b * I + t] += this->b_in()[i][0] + this->position()[i][t];
+                }
+            }
+        }
+
+        for (std::size_t l = 0; l < LAYERS; l++) {
+            float* a = base + l * ROWS * ld;
+
+            Cell::layerNorm(H, N, stream, ld, gamma_1(l).raw(), beta_1(l).raw(), a + X_HAT_1 * ld, a + NORM_1 * ld,
+                            a + RSTD_1 * ld, ld);
+
+            LinearLib::gemm(false, false, 3 * H, N, H, w_qkv(l).raw(), H, a + NORM_1 * ld, ld, 0.0f, a + QKV * ld, ld);
+            Cell::addBias(3 * H, N, a + QKV * ld, ld, b_qkv(l).raw());
+
+            for (std::size_t b = 0; b < B; b++) {
+                for (std::size_t h = 0; h < HEADS; h++) {
+                    const float* q = a + (QKV + h * HEAD) * ld + b * I;
+                    LinearLib::attention(I, HEAD, scale(), q, ld, q + H * ld, ld, q + 2 * H * ld, ld,
+                                         a + (CONTEXT + h * HEAD) * ld + b * I, ld, a + (LSE + h) * ld + b * I);
+                }
+            }
+
+            LinearLib::gemm(false, false, H, N, H, w_o(l).raw(), H, a + CONTEXT * ld, ld, 1.0f, stream, ld);
+            Cell::addBias(H, N, stream, ld, b_o(l).raw());
+
+            Cell::layerNorm(H, N, stream, ld, gamma_2(l).raw(), beta_2(l).raw(), a + X_HAT_2 * ld, a + NORM_2 * ld,
+                            a + RSTD_2 * ld, ld);
+
+            float* hidden = a + HIDDEN * ld;
+            LinearLib::gemm(false, false, MLP, N, H, w_1(l).raw(), H, a + NORM_2 * ld, ld, 0.0f, hidden, ld);
+            for (std::size_t i = 0; i < MLP; i++) {
+                for (std::size_t j = 0; j < N; j++) {
+                    hidden[i * ld + j] = std::max(0.0f, hidden[i * ld + j] + b_1(l)[i][0]);
+                }
+            }
+
+            LinearLib::gemm(false, false, H, N, MLP, w_2(l).raw(), MLP, hidden, ld, 1.0f, stream, ld);
+            Cell::addBias(H, N, stream, ld, b_2(l).raw());
+        }
+
+        const float* last = lastSteps<B>(stream, ld, arena);
+
+        LinearLib::Matrix<O, B, float> y;
+        LinearLib::gemm(false, false, O, B, H, this->w_h_o().raw(), H, last, B, 0.0f, y.raw(), B);
+        Cell::addBias(y, this->b_h_o());
+
+        return y;
+    }
+
+    /**
+     * Backpropagation for the batch of the last forward, given its input x. Gradients are averaged over the first
+     * count columns, columns past count are padding and must have a zero d_y.
+     *
+     * The gradient of the residual stream d_s flows back through every block unchanged, each branch adding its
+     * own contribution on top through its norm.
+     */
+    template<std::size_t B>
+    void backward(const LinearLib::Matrix<F, I * B, float>& x, const LinearLib::Matrix<O, B, float>& d_y,
+                  const std::size_t count = B) {
+        constexpr std::size_t N = I * B;
+
+        LinearLib::Arena& arena = LinearLib::Arena::current();
+
+        parameters.clearGradients();
+
+        auto& d_w_in = parameters.template gradient<H, F>(W_IN);
+        auto& d_b_in = parameters.template gradient<H, 1>(B_IN);
+        auto& d_position = parameters.template gradient<H, I>(POSITION);
+        auto& d_w_h_o = parameters.template gradient<O, H>(W_H_O);
+        auto& d_b_h_o = parameters.template gradient<O, 1>(B_H_O);
+
+        const std::size_t ld = activations.ld();
+        const float* base = activations.at(0);
+
+        const float* last = lastSteps<B>(base + STREAM * ld, ld, arena);
+        LinearLib::gemm(false, true, O, H, B, d_y.raw(), B, last, B, 0.0f, d_w_h_o.raw(), H);
+        Cell::sumColumns(d_y, d_b_h_o);
+
+        // Only the last step feeds the head
+        float* d_last = arena.allocate<float>(H * B);
+        LinearLib::gemm(true, false, H, B, O, this->w_h_o().raw(), H, d_y.raw(), B, 0.0f, d_last, B);
+
+        float* d_s = arena.allocate<float>(H * N);
+        std::fill_n(d_s, H * N, 0.0f);
+        for (std::size_t i = 0; i < H; i++) {
+            for (std::size_t b = 0; b < B; b++) {
+                d_s[i * N + b * I + I - 1] = d_last[i * B + b];
+            }
+        }
+
+        float* d_h = arena.allocate<float>(H * N);
+        float* d_qkv = arena.allocate<float>(3 * H * N);
+        float* d_hidden = arena.allocate<float>(MLP * N);
+
+        for (std::size_t l = LAYERS; l-- > 0;) {
+            const float* a = base + l * ROWS * ld;
+            float* g = parameters.gradients() + BLOCKS + l * LAYER;
+
+            const float* hidden = a + HIDDEN * ld;
+
+            Cell::sumColumns(H, N, d_s, N, g + B_2);
+            LinearLib::gemm(false, true, H, MLP, N, d_s, N, hidden, ld, 0.0f, g + W_2, MLP);
+            LinearLib::gemm(true, false, MLP, N, H, w_2(l).raw(), MLP, d_s, N, 0.0f, d_hidden, N);
+            for (std::size_t i = 0; i < MLP; i++) {
+                for (std::size_t j = 0; j < N; j++) {
+                    d_hidden[i * N + j] = hidden[i * ld + j] > 0.0f ? d_hidden[i * N + j] : 0.0f;
+                }
+            }
+
+            Cell::sumColumns(MLP, N, d_hidden, N, g + B_1);
+            LinearLib::gemm(false, true, MLP, H, N, d_hidden, N, a + NORM_2 * ld, ld, 0.0f, g + W_1, H);
+            LinearLib::gemm(true, false, H, N, MLP, w_1(l).raw(), H, d_hidden, N, 0.0f, d_h, N);
+
+            Cell::layerNormBackward(H, N, d_h, N, gamma_2(l).raw(), a + X_HAT_2 * ld, a + RSTD_2 * ld, ld, d_s, N,
+                                    g + GAMMA_2, g + BETA_2);
+
+            Cell::sumColumns(H, N, d_s, N, g + B_O);
+            LinearLib::gemm(false, true, H, H, N, d_s, N, a + CONTEXT * ld, ld, 0.0f, g + W_O, H);
+            LinearLib::gemm(true, false, H, N, H, w_o(l).raw(), H, d_s, N, 0.0f, d_h, N);
+
+            std::fill_n(d_qkv, 3 * H * N, 0.0f);
+            for (std::size_t b = 0; b < B; b++) {
+                for (std::size_t h = 0; h < HEADS; h++) {
+                    const float* q = a + (QKV + h * HEAD) * ld + b * I;
+                    float* d_q = d_qkv + h * HEAD * N + b * I;
+                    LinearLib::attentionBackward(I, HEAD, scale(), q, ld, q + H * ld, ld, q + 2 * H * ld, ld,
+                                                 a + (CONTEXT + h * HEAD) * ld + b * I, ld,
+                                                 a + (LSE + h) * ld + b * I, d_h + h * HEAD * N + b * I, N, d_q, N,
+                                                 d_q + H * N, N, d_q + 2 * H * N, N);
+                }
+            }
+
+            Cell::sumColumns(3 * H, N, d_qkv, N, g + B_QKV);
+            LinearLib::gemm(false, true, 3 * H, H, N, d_qkv, N, a + NORM_1 * ld, ld, 0.0f, g + W_QKV, H);
+            LinearLib::gemm(true, false, H, N, 3 * H, w_qkv(l).raw(), H, d_qkv, N, 0.0f, d_h, N);
+
+            Cell::layerNormBackward(H, N, d_h, N, gamma_1(l).raw(), a + X_HAT_1 * ld, a + RSTD_1 * ld, ld, d_s, N,
+                                    g + GAMMA_1, g + BETA_1);
+        }
+
+        Cell::sumColumns(H, N, d_s, N, d_b_in.raw());
+        for (std::size_t i = 0; i < H; i++) {
+            for (std::size_t b = 0; b < B; b++) {
+                for (std::size_t t = 0; t < I; t++) {
+                    d_position[i][t] += d_s[i * N + b * I + t];
+                }
+            }
+        }
+
+        const float* input = batchMajor<B>(x, arena);
+        LinearLib::gemm(false, true, H, F, N, d_s, N, input, N, 0.0f, d_w_in.raw(), F);
+
+        // Average over the batch, clip and apply, one pass over the model
+        optimizer.step();
+        optimizer.update(0, parameters.values(), parameters.gradients(), PARAMETERS, 1.0f / static_cast<float>(count),
+                         this->clip, this->learning_rate);
+    }
+
+    // Drops the stored activations, keeping their memory
+    void clearHistory() {
+        activations.reset(activations.batch);
+    }
+
+    // Scale of the attention scores, 1 / sqrt(HEAD)
+    static float scale() {
+        return 1.0f / std::sqrt(static_cast<float>(HEAD));
+    }
+
+    // Copy of the time major input in the model's batch major column order, in the arena
+    template<std::size_t B>
+    static const float* batchMajor(const LinearLib::Matrix<F, I * B, float>& x, LinearLib::Arena& arena) {
+        float* res = arena.allocate<float>(F * I * B);
+        for (std::size_t f = 0; f < F; f++) {
+            for (std::size_t t = 0; t < I; t++) {
+                for (std::size_t b = 0; b < B; b++) {
+                    res[f * I * B + b * I + t] = x[f][t * B + b];
+                }
+            }
+        }
+        return res;
+    }
+
+    // The last step of every window of the residual stream as an H x B block, in the arena
+    template<std::size_t B>
+    static const float* lastSteps(const float* stream, const std::size_t ld, LinearLib::Arena& arena) {
+        float* res = arena.allocate<float>(H * B);
+        for (std::size_t i = 0; i < H; i++) {
+            for (std::size_t b = 0; b < B; b++) {
+                res[i * B + b] = stream[i * ld + b * I + I - 1];
+            }
+        }
+        return res;
+    }
+
+    static Transformer deserialize(const std::string& serialized) {
+        std::stringstream stream(serialized);
+        std::string token;
+
+        std::getline(stream, token, '\x{1E}');
+        assert(token == std::to_string(I) && "Invalid input size!");
+
+        std::getline(stream, token, '\x{1E}');
+        assert(token == std::to_string(H) && "Invalid hidden size!");
+
+        std::getline(stream, token, '\x{1E}');
+        assert(token == std::to_string(O) && "Invalid output size!");
+
+        std::getline(stream, token, '\x{1E}');
+        assert(token == std::to_string(F) && "Invalid feature count!");
+
+        std::getline(stream, token, '\x{1E}');
+        float learning_rate = std::stof(token);
+
+        std::getline(stream, token, '\x{1E}');
+        float clip = std::stof(token);
+
+        std::getline(stream, token, '\x{1E}');
+        int seed = std::stoi(token);
+
+        Transformer transformer(learning_rate, clip, seed);
+
+        Cell::read(stream, transformer.w_in());
+        Cell::read(stream, transformer.b_in());
+        Cell::read(stream, transformer.position());
+        for (std::size_t l = 0; l < LAYERS; l++) {
+            Cell::read(stream, transformer.gamma_1(l));
+            Cell::read(stream, transformer.beta_1(l));
+            Cell::read(stream, transformer.w_qkv(l));
+            Cell::read(stream, transformer.b_qkv(l));
+            Cell::read(stream, transformer.w_o(l));
+            Cell::read(stream, transformer.b_o(l));
+            Cell::read(stream, transformer.gamma_2(l));
+            Cell::read(stream, transformer.beta_2(l));
+            Cell::read(stream, transformer.w_1(l));
+            Cell::read(stream, transformer.b_1(l));
+            Cell::read(stream, transformer.w_2(l));
+            Cell::read(stream, transformer.b_2(l));
+        }
+        Cell::read(stream, transformer.w_h_o());
+        Cell::read(stream, transformer.b_h_o());
+
+        return transformer;
+    }
+
+    [[nodiscard]] std::string serialize() const {
+
+        std::stringstream stream("");
+
+        stream << I << "\x{1E}" << H << "\x{1E}" << O << "\x{1E}" << F << "\x{1E}" << learning_rate << "\x{1E}" << clip << "\x{1E}" << seed << "\x{1E}";
+
+        Cell::write(stream, w_in());
+        Cell::write(stream, b_in());
+        Cell::write(stream, position());
+        for (std::size_t l = 0; l < LAYERS; l++) {
+            Cell::write(stream, gamma_1(l));
+            Cell::write(stream, beta_1(l));
+            Cell::write(stream, w_qkv(l));
+            Cell::write(stream, b_qkv(l));
+            Cell::write(stream, w_o(l));
+            Cell::write(stream, b_o(l));
+            Cell::write(stream, gamma_2(l));
+            Cell::write(stream, beta_2(l));
+            Cell::write(stream, w_1(l));
+            Cell::write(stream, b_1(l));
+            Cell::write(stream, w_2(l));
+            Cell::write(stream, b_2(l));
+        }
+        Cell::write(stream, w_h_o());
+        Cell::write(stream, b_h_o());
+
+        return stream.str();
+    }
+};
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Runs the stages of a pipeline concurrently, one thread per stage, where stage s may only consume step t once stage
+ * s - 1 has published it. For a stack of recurrent layers the stages are the layers and the steps time steps, so
+ * layer l works on step t while layer l - 1 is already on step t + 1 and the stack finishes in I + depth - 1 step
+ * times instead of I * depth.
+ *
+ * The threads are started once and parked between runs, so a run costs no thread creation or allocation. Stages
+ * wait on each other through one progress counter each, on its own cache line, with atomic wait and notify.
+ *
+ * With fewer hardware threads than stages the stages run one after another on the calling thread instead, which
+ * meets every wait by construction and avoids the context switch a blocked stage would cost on every step.
+ */
+struct Wavefront {
+    struct alignas(64) Counter {
+        std::atomic<std::size_t> value = 0;
+    };
+
+    std::size_t stages;
+    bool threaded;
+
+    // Steps each stage has published in the current run
+    std::unique_ptr<Counter[]> progress;
+
+    // Task of the current run, called with the stage to run
+    void (*task)(void*, std::size_t) = nullptr;
+    void* context = nullptr;
+
+    // Bumped to start a run, and the workers that have finished it
+    Counter generation;
+    Counter finished;
+    std::atomic<bool> stopping = false;
+
+    std::vector<std::jthread> workers;
+
+    explicit Wavefront(const std::size_t stages, const std::size_t threads = std::thread::hardware_concurrency()) :
+        stages(stages), threaded(stages > 1 && threads >= stages), progress(std::make_unique<Counter[]>(stages)) {
+        if (this->threaded) {
+            for (std::size_t s = 1; s < stages; s++) {
+                workers.emplace_back([this, s] { work(s); });
+            }
+        }
+    }
+
+    // A copy gets threads of its own, there is no state worth copying between runs
+    Wavefront(const Wavefront& other) : Wavefront(other.stages, other.threaded ? other.stages : 1) {}
+
+    Wavefront& operator=(const Wavefront& other) {
+        assert(stages == other.stages && "Wavefronts differ in depth");
+        return *this;
+    }
+
+    ~Wavefront() {
+        stopping.store(true, std::memory_order_release);
+        generation.value.fetch_add(1, std::memory_order_release);
+        generation.value.notify_all();
+    }
+
+    /**
+     * Calls fn(s) for every stage s, concurrently when threaded, and returns once all have returned. Stage 0 runs on
+     * the calling thread.
+     */
+    template<typename Fn>
+    void run(Fn&& fn) {
+        for (std::size_t s = 0; s < stages; s++) {
+            progress[s].value.store(0, std::memory_order_relaxed);
+        }
+
+        if (!threaded) {
+            for (std::size_t s = 0; s < stages; s++) {
+                fn(s);
+            }
+            return;
+        }
+
+        using Task = std::remove_cvref_t<Fn>;
+        task = [](void* context, const std::size_t s) { (*static_cast<Task*>(context))(s); };
+        context = const_cast<Task*>(std::addressof(fn));
+
+        finished.value.store(0, std::memory_order_relaxed);
+        generation.value.fetch_add(1, std::memory_order_release);
+        generation.value.notify_all();
+
+        fn(0);
+
+        for (std::size_t done; (done = finished.value.load(std::memory_order_acquire)) < stages - 1;) {
+            finished.value.wait(done, std::memory_order_acquire);
+        }
+    }
+
+    // Marks the first steps of a stage as done, their results visible to whichever stage awaits them
+    void publish(const std::size_t stage, const std::size_t steps) {
+        progress[stage].value.store(steps, std::memory_order_release);
+        if (threaded) {
+            progress[stage].value.notify_all();
+        }
+    }
+
+    // Blocks until the given stage has published at least steps steps
+    void await(const std::size_t stage, const std::size_t steps) {
+        for (std::size_t done; (done = progress[stage].value.load(std::memory_order_acquire)) < steps;) {
+            assert(threaded && "A sequential stage awaits one that has not run yet");
+            progress[stage].value.wait(done, std::memory_order_acquire);
+        }
+    }
+
+    void work(const std::size_t stage) {
+        std::size_t seen = 0;
+
+        for (;;) {
+            generation.value.wait(seen, std::memory_order_acquire);
+            seen = generation.value.load(std::memory_order_acquire);
+
+            if (stopping.load(std::memory_order_acquire)) {
+                return;
+            }
+
+            task(context, stage);
+
+            finished.value.fetch_add(1, std::memory_order_acq_rel);
+            finished.value.notify_one();
+        }
+    }
+};
@@ -0,0 +1,84 @@
+#include "Allocations.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+    std::atomic<std::size_t> allocations = 0;
+
+    void* allocate(const std::size_t size) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+
+        if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+            return ptr;
+        }
+
+        throw std::bad_alloc();
+    }
+
+    void* allocate(const std::size_t size, const std::align_val_t alignment) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+
+        const auto align = static_cast<std::size_t>(alignment);
+        const std::size_t rounded = (size + align - 1) / align * align;
+
+        if (void* ptr = std::aligned_alloc(align, rounded == 0 ? align : rounded)) {
+            return ptr;
+        }
+
+        throw std::bad_alloc();
+    }
+}
+
+std::size_t allocationCount() {
+    return allocations.load(std::memory_order_relaxed);
+}
+
+void* operator new(const std::size_t size) {
+    return allocate(size);
+}
+
+void* operator new[](const std::size_t size) {
+    return allocate(size);
+}
+
+void* operator new(const std::size_t size, const std::align_val_t alignment) {
+    return allocate(size, alignment);
+}
+
+void* operator new[](const std::size_t size, const std::align_val_t alignment) {
+    return allocate(size, alignment);
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept {
+    std::free(ptr);
+}
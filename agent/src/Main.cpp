@@ -1,50 +1,314 @@
+#include "Ensemble.hpp"
 #include "Environment.hpp"
 #include "Data.hpp"
+#include "LinearLib/Benchmark.hpp"
 
 #include <algorithm>
+#include <array>
+#include <chrono>
 #include <random>
+#include <string_view>
+#include <utility>
 
+// Trading days ahead forecast by the models: a day, a week, a month and a quarter
+constexpr std::array<std::size_t, 4> HORIZONS = {1, 5, 21, 63};
+
+/**
+ * Windows of I observations over the series, each labelled with the values the given horizons after its last
+ * observation, in shuffled order. The windows are views into one copy of the series, see WindowDataset.
+ */
 template<std::size_t I, std::size_t O>
-std::vector<Sample<I, O>> generateSamples(const std::vector<VixData>& vix) {
+WindowDataset<I, O> generateWindows(const std::vector<VixData>& vix, const std::array<std::size_t, O>& horizons) {
 
-    std::vector<Sample<I, O>> samples;
+    std::vector<float> series(vix.size());
+    std::transform(vix.begin(), vix.end(), series.begin(), [](const VixData& row) {
+        return static_cast<float>(row.vix);
+    });
 
-    for (std::size_t i = 0; i < vix.size() - I; i++) {
-        LinearLib::Matrix<I, 1, float> input = LinearLib::Matrix<I, 1, float>::zeros();
-        for (std::size_t j = 0; j < I; j++) {
-            input[j][0] = static_cast<float>(vix[i + j].vix);
-        }
+    WindowDataset<I, O> windows(series.data(), series.size(), 1, {0}, 0, horizons);
+    windows.shuffle(42);
+
+    return windows;
+}
+
+// The whole series one step at a time, each observation labelled with the values the given horizons later, for
+// truncated BPTT
+template<std::size_t O>
+std::vector<Sample<1, O>> generateSeries(const std::vector<VixData>& vix, const std::array<std::size_t, O>& horizons) {
+
+    std::vector<Sample<1, O>> samples;
 
-        const auto label = LinearLib::Matrix<O, 1, float>{{static_cast<float>(vix[i + I].vix)}};
+    const std::size_t longest = *std::max_element(horizons.begin(), horizons.end());
+
+    for (std::size_t i = 0; i + longest < vix.size(); i++) {
+        const auto input = LinearLib::Matrix<1, 1, float>{{static_cast<float>(vix[i].vix)}};
+
+        LinearLib::Matrix<O, 1, float> label;
+        for (std::size_t o = 0; o < O; o++) {
+            label[o][0] = static_cast<float>(vix[i + horizons[o]].vix);
+        }
 
         samples.emplace_back(input, label);
     }
 
-    std::shuffle(samples.begin(), samples.end(), std::default_random_engine(42));
-
     return samples;
 }
 
-int main() {
+// Mean reverting random walk standing in for the VIX series when benchmarking without a database
+std::vector<VixData> syntheticVix(const std::size_t count) {
+    std::mt19937_64 rng(42);
+    std::normal_distribution<double> noise(0.0, 1.0);
+
+    std::vector<VixData> data(count);
+
+    double level = 20.0;
+    for (VixData& row: data) {
+        level += 0.05 * (20.0 - level) + noise(rng);
+        row.vix = level;
+    }
+
+    return data;
+}
+
+/**
+ * Trains the RNN in float and in mixed precision with activations stored as Storage side by side, from the same seed
+ * on the same samples, and reports per epoch how much faster the mixed model trained and how far its losses moved.
+ */
+template<typename Storage, std::size_t I, std::size_t O>
+void compareMixed(const WindowDataset<I, O>& training, const WindowDataset<I, O>& validation,
+                  const unsigned int epochs) {
+    Environment<I, 512, O, 64> reference(epochs);
+    Environment<I, 512, O, 64, 1, Mixed<Storage>::template RNN> mixed(epochs);
+
+    reference.model.optimizer = Optimizer::adam();
+    reference.model.learning_rate = 1e-3f;
+    mixed.model.optimizer = Optimizer::adam();
+    mixed.model.learning_rate = 1e-3f;
+
+    const auto timed = [](auto&& pass) {
+        const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        const float loss = pass();
+        const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        return std::pair(loss, std::chrono::duration<double, std::milli>(end - begin).count());
+    };
+
+    const auto samples = static_cast<float>(training.size());
+    const auto held = static_cast<float>(validation.size());
+
+    for (unsigned int epoch = 1; epoch <= epochs; epoch++) {
+        const auto [referenceLoss, referenceTime] = timed([&] { return reference.epoch(training); });
+        const auto [mixedLoss, mixedTime] = timed([&] { return mixed.epoch(training); });
+
+        const float referenceValidation = reference.evaluate(validation) / held;
+        const float mixedValidation = mixed.evaluate(validation) / held;
+
+        std::cout << "Epoch " << epoch << ": " << referenceTime << "ms float, " << mixedTime << "ms mixed ("
+                  << referenceTime / mixedTime << "x), training loss " << referenceLoss / samples << " vs "
+                  << mixedLoss / samples << ", validation loss " << referenceValidation << " vs " << mixedValidation
+                  << " (delta " << mixedValidation - referenceValidation << ")" << std::endl;
+    }
+
+    if (mixed.model.scaling.dynamic) {
+        std::cout << "Loss scale " << mixed.model.scaling.scale << ", " << mixed.model.scaling.skipped
+                  << " steps skipped for overflow" << std::endl;
+    }
+}
+
+int main(const int argc, char* argv[]) {
+
+    if (argc > 1 && std::string_view(argv[1]) == "--bench") {
+        for (std::size_t n = 512; n <= 4096; n *= 2) {
+            LinearLib::Benchmark::strassen<float>(std::cout, n, 256);
+        }
+
+        const WindowDataset<32, 1> samples = generateWindows<32, 1>(syntheticVix(2048), {1});
+
+        Environment<32, 512, 1> single(1);
+        single.benchmark(samples, 256);
+
+        Environment<32, 512, 1, 64> batched(1);
+        batched.benchmark(samples, 64);
+
+        // Serving the trained weights, one window at a time and in batches
+        single.benchmarkInference(samples, 256);
+        batched.benchmarkInference(samples, 16);
+
+        Environment<32, 512, 1, 64, 1, LSTM> lstm(1);
+        lstm.benchmark(samples, 16);
+
+        Environment<32, 512, 1, 64, 1, GRU> gru(1);
+        gru.benchmark(samples, 16);
+
+        // Differentiated by the autodiff tape rather than by hand
+        Environment<32, 512, 1, 64, 1, MGU> mgu(1);
+        mgu.benchmark(samples, 16);
+
+        // Three layers pipelined across threads, near the single layer time given a core per layer
+        Environment<32, 512, 1, 64, 1, Stacked<3>::RNN> stacked(1);
+        stacked.benchmark(samples, 16);
+
+        // Fewer channels than the recurrent cells for a comparable parameter count over its 5 levels
+        Environment<32, 128, 1, 64, 1, TCN> tcn(1);
+        tcn.benchmark(samples, 16);
+
+        // Narrower again, two blocks with a 4x MLP already hold more parameters than the 512 unit RNN
+        Environment<32, 128, 1, 64, 1, Transformer> transformer(1);
+        transformer.benchmark(samples, 16);
+
+        return 0;
+    }
+
+    if (argc > 1 && std::string_view(argv[1]) == "--truncated") {
+        // A year of trading days of lookback, updated monthly, over 16 streams of the series
+        Environment<252, 512, HORIZONS.size(), 16> env(1000);
+        env.model.optimizer = Optimizer::adam();
+        env.model.learning_rate = 1e-3f;
 
-    Environment<32, 512, 1> env(1000);
+        const std::vector<Sample<1, HORIZONS.size()>> series = generateSeries(Data().getVixData(), HORIZONS);
+        const std::size_t trainingEnd = static_cast<std::size_t>(series.size() * 0.8);
+
+        env.trainTruncated(std::vector(series.begin(), series.begin() + trainingEnd), 21, 252);
+        env.validateTruncated(std::vector(series.begin() + trainingEnd, series.end()), 21);
+
+        return 0;
+    }
+
+    if (argc > 1 && std::string_view(argv[1]) == "--quantiles") {
+        // The median and the 50% and 90% intervals of every horizon, all out of one forward pass
+        using Quantiles = Loss::Quantiles<5, 25, 50, 75, 95>;
+        constexpr std::size_t outputs = Quantiles::COUNT * HORIZONS.size();
+
+        Environment<32, 512, outputs, 64, 1, RNN, Quantiles> env(1000);
+        env.model.optimizer = Optimizer::adam();
+        env.model.learning_rate = 1e-3f;
+
+        const std::vector<VixData> vix = Data().getVixData();
+        const WindowDataset<32, HORIZONS.size()> samples = generateWindows<32>(vix, HORIZONS);
+        const std::size_t trainingEnd = static_cast<std::size_t>(samples.size() * 0.8);
+
+        env.train(samples.slice(0, trainingEnd));
+        env.validate(samples.slice(trainingEnd, samples.size()));
+
+        auto session = env.session();
+        LinearLib::Matrix<outputs, 1, float> forecast;
+        for (std::size_t i = vix.size() - 32; i < vix.size(); i++) {
+            forecast = session.observe(LinearLib::Matrix<1, 1, float>{{static_cast<float>(vix[i].vix)}});
+        }
+
+        // Output q * HORIZONS.size() + h holds quantile q of horizon h
+        for (std::size_t h = 0; h < HORIZONS.size(); h++) {
+            const auto quantile = [&](const std::size_t q) { return forecast[q * HORIZONS.size() + h][0]; };
+            std::cout << "VIX " << HORIZONS[h] << " days ahead: median " << quantile(2) << ", 50% [" << quantile(1)
+                      << ", " << quantile(3) << "], 90% [" << quantile(0) << ", " << quantile(4) << "]" << std::endl;
+        }
+
+        return 0;
+    }
+
+    if (argc > 1 && std::string_view(argv[1]) == "--ensemble") {
+        // Four seeds trained side by side, forecasting their mean and how far they disagree
+        Ensemble<4, 32, 512, HORIZONS.size(), 64> ensemble(1000);
+        for (const auto& member: ensemble.members) {
+            member->model.optimizer = Optimizer::adam();
+            member->model.learning_rate = 1e-3f;
+        }
+
+        const std::vector<VixData> vix = Data().getVixData();
+        const WindowDataset<32, HORIZONS.size()> samples = generateWindows<32>(vix, HORIZONS);
+        const std::size_t trainingEnd = static_cast<std::size_t>(samples.size() * 0.8);
+
+        ensemble.train(samples.slice(0, trainingEnd));
+        ensemble.validate(samples.slice(trainingEnd, samples.size()));
+
+        LinearLib::Matrix<32, 1, float> window;
+        for (std::size_t i = 0; i < 32; i++) {
+            window[i][0] = static_cast<float>(vix[vix.size() - 32 + i].vix);
+        }
+
+        const auto forecast = ensemble.predict(window);
+        for (std::size_t o = 0; o < HORIZONS.size(); o++) {
+            std::cout << "VIX forecast " << HORIZONS[o] << " days ahead: " << forecast.mean[o][0] << " +- "
+                      << forecast.spread[o][0] << std::endl;
+        }
+
+        return 0;
+    }
+
+    if (argc > 1 && std::string_view(argv[1]) == "--prune") {
+        // 90% of every weight matrix pruned by epoch 20, epochs speeding up once the layers pass 80% and go sparse
+        Environment<32, 512, HORIZONS.size(), 64> env(30);
+        env.model.optimizer = Optimizer::adam();
+        env.model.learning_rate = 1e-3f;
+        env.pruning = Pruning{.target = 0.9f, .begin = 1, .end = 20};
+
+        const WindowDataset<32, HORIZONS.size()> samples = generateWindows<32>(Data().getVixData(), HORIZONS);
+        const std::size_t trainingEnd = static_cast<std::size_t>(samples.size() * 0.8);
+
+        env.train(samples.slice(0, trainingEnd));
+        env.validate(samples.slice(trainingEnd, samples.size()));
+
+        // Read back from its sparse export, the pruned model validates the same
+        Environment<32, 512, HORIZONS.size(), 64> restored(0);
+        restored.load(env.saveSparse());
+        restored.validate(samples.slice(trainingEnd, samples.size()));
+
+        return 0;
+    }
+
+    if (argc > 1 && std::string_view(argv[1]) == "--mixed") {
+        // bf16 needs no loss scaling, fp16 keeps more mantissa but scales the loss to stay clear of underflow
+        const WindowDataset<32, HORIZONS.size()> samples = generateWindows<32>(Data().getVixData(), HORIZONS);
+        const std::size_t trainingEnd = static_cast<std::size_t>(samples.size() * 0.8);
+
+        const auto training = samples.slice(0, trainingEnd);
+        const auto validation = samples.slice(trainingEnd, samples.size());
+
+        if (argc > 2 && std::string_view(argv[2]) == "fp16") {
+            compareMixed<LinearLib::Half>(training, validation, 20);
+        } else {
+            compareMixed<LinearLib::BFloat16>(training, validation, 20);
+        }
+
+        return 0;
+    }
+
+    // Every horizon comes out of one forward pass of one model
+    Environment<32, 512, HORIZONS.size(), 64> env(1000);
+
+    // Adam reaches the loss of plain SGD in far fewer epochs
+    env.model.optimizer = Optimizer::adam();
+    env.model.learning_rate = 1e-3f;
+
+    const bool retune = argc > 1 && std::string_view(argv[1]) == "--autotune";
+    LinearLib::Autotune::configure("data/autotune.cache", env.gemmShapes(), std::cout, retune);
 
     const auto data = Data();
 
     const std::vector<VixData> vix = data.getVixData();
 
-    std::vector<Sample<32, 1>> samples = generateSamples<32, 1>(vix);
+    const WindowDataset<32, HORIZONS.size()> samples = generateWindows<32>(vix, HORIZONS);
 
     const std::size_t trainingEndIdx = static_cast<size_t>(samples.size() * 0.8);
     const std::size_t validationStartIdx = trainingEndIdx;
 
-    const std::vector trainingSamples(samples.begin(), samples.begin() + trainingEndIdx);
-    const std::vector validationSamples(samples.begin() + validationStartIdx, samples.end());
+    const WindowDataset trainingSamples = samples.slice(0, trainingEndIdx);
+    const WindowDataset validationSamples = samples.slice(validationStartIdx, samples.size());
 
     env.train(trainingSamples);
 
     env.validate(validationSamples);
 
+    // Live forecast, carrying the state over the last window one observation at a time
+    auto session = env.session();
+    LinearLib::Matrix<HORIZONS.size(), 1, float> forecast;
+    for (std::size_t i = vix.size() - 32; i < vix.size(); i++) {
+        forecast = session.observe(LinearLib::Matrix<1, 1, float>{{static_cast<float>(vix[i].vix)}});
+    }
+
+    for (std::size_t o = 0; o < HORIZONS.size(); o++) {
+        std::cout << "VIX forecast " << HORIZONS[o] << " days ahead: " << forecast[o][0] << std::endl;
+    }
+
     return 0;
 }
 
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace LinearLib {
+    /**
+     * Bump allocator for short lived temporaries. Allocation is a pointer increment and everything is released at
+     * once when the enclosing Scope ends, typically once per training sample or batch.
+     *
+     * When a step outgrows the current block a new one is chained on, and the next full reset coalesces all blocks
+     * into one big enough for the observed peak. After the first few steps the arena therefore stops calling the
+     * system allocator entirely.
+     */
+    struct Arena {
+        static constexpr std::size_t ALIGNMENT = 64;
+
+        struct Release {
+            void operator()(std::byte* memory) const {
+                ::operator delete[](memory, std::align_val_t(ALIGNMENT));
+            }
+        };
+
+        struct Block {
+            std::unique_ptr<std::byte[], Release> memory;
+            std::size_t size = 0;
+        };
+
+        struct Stats {
+            // Bytes currently handed out
+            std::size_t used = 0;
+            // High water mark of used since construction
+            std::size_t peak = 0;
+            // Total bytes owned across all blocks
+            std::size_t capacity = 0;
+            // Number of times the arena itself went to the system allocator
+            std::size_t blockAllocations = 0;
+            std::size_t resets = 0;
+        };
+
+        /**
+         * Rewinds the arena to where it was when the scope was entered, and makes the arena the thread's current
+         * one for the duration. Scopes nest, so a callee can open its own scope on the same arena.
+         */
+        struct Scope {
+            Arena& arena;
+            Arena* previous;
+            std::size_t block;
+            std::size_t offset;
+            std::size_t used;
+
+            explicit Scope(Arena& arena) :
+                arena(arena), previous(active()), block(arena.block), offset(arena.offset), used(arena.stats.used) {
+                active() = &arena;
+            }
+
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+
+            ~Scope() {
+                if (block == 0 && offset == 0) {
+                    arena.reset();
+                } else {
+                    arena.block = block;
+                    arena.offset = offset;
+                    arena.stats.used = used;
+                }
+                active() = previous;
+            }
+        };
+
+        std::vector<Block> blocks;
+        std::size_t block = 0;
+        std::size_t offset = 0;
+        Stats stats;
+
+        explicit Arena(std::size_t const capacity = std::size_t{1} << 20) {
+            grow(capacity);
+        }
+
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        /**
+         * The arena of the innermost active Scope on this thread.
+         */
+        static Arena*& active() {
+            thread_local Arena* arena = nullptr;
+            return arena;
+        }
+
+        static Arena& current() {
+            assert(active() != nullptr && "No arena is active on this thread, open an Arena::Scope first");
+            return *active();
+        }
+
+        void* allocate(std::size_t const bytes, std::size_t const alignment = ALIGNMENT) {
+            assert(alignment <= ALIGNMENT && (alignment & (alignment - 1)) == 0 && "Unsupported alignment");
+
+            std::size_t start = (offset + alignment - 1) & ~(alignment - 1);
+
+            while (start + bytes > blocks[block].size) {
+                if (block + 1 == blocks.size()) {
+                    grow(std::max(bytes, blocks[block].size * 2));
+                }
+                stats.used += blocks[block].size - offset;
+                block++;
+                offset = 0;
+                start = 0;
+            }
+
+            stats.used += start + bytes - offset;
+            stats.peak = std::max(stats.peak, stats.used);
+            offset = start + bytes;
+
+            return blocks[block].memory.get() + start;
+        }
+
+        template<typename T>
+        T* allocate(std::size_t const count) {
+            static_assert(std::is_trivially_destructible_v<T>, "Arena memory is never destructed");
+            return static_cast<T*>(allocate(count * sizeof(T), alignof(T) > ALIGNMENT ? ALIGNMENT : alignof(T)));
+        }
+
+        /**
+         * Default constructs an object in the arena, e.g. a Matrix temporary. Its storage is reclaimed with the
+         * scope, so it must not outlive it.
+         */
+        template<typename M>
+        M& make() {
+            static_assert(std::is_trivially_destructible_v<M>, "Arena memory is never destructed");
+            return *new(allocate(sizeof(M), std::min(alignof(M), ALIGNMENT))) M;
+        }
+
+        /**
+         * Releases everything. If the last cycle spilled into more than one block, they are merged into a single
+         * block of the combined size so the next cycle fits without allocating.
+         */
+        void reset() {
+            if (blocks.size() > 1) {
+                const std::size_t total = stats.capacity;
+                blocks.clear();
+                stats.capacity = 0;
+                grow(total);
+            }
+
+            block = 0;
+            offset = 0;
+            stats.used = 0;
+            stats.resets++;
+        }
+
+        void grow(std::size_t const size) {
+            const std::size_t rounded = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+            auto* memory = static_cast<std::byte*>(::operator new[](rounded, std::align_val_t(ALIGNMENT)));
+            blocks.push_back(Block{std::unique_ptr<std::byte[], Release>(memory), rounded});
+            stats.capacity += rounded;
+            stats.blockAllocations++;
+        }
+    };
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <type_traits>
+
+#include "Gemm.hpp"
+
+namespace LinearLib {
+
+    // Queries and keys per tile of the blocked attention kernels
+    constexpr std::size_t ATTENTION_BLOCK = 64;
+
+    /**
+     * Causal scaled dot product attention of one head over a sequence, o_t = sum_{s <= t} softmax_s(scale q_t . k_s)
+     * v_s. q, k, v and o are dim x steps, column t holding step t, with their own leading dimensions.
+     *
+     * The steps x steps score matrix is never formed. Queries and keys are tiled into ATTENTION_BLOCK sized blocks
+     * and each query block sweeps the key blocks up to its diagonal with an online softmax: a running maximum and
+     * normaliser per query, the output rescaled whenever the maximum grows. Scores and weights of a tile are two
+     * GEMMs. The log-sum-exp of every query's scores is written to lse, which is all the backward pass needs to
+     * rebuild the weights.
+     */
+    template<typename T>
+    requires std::is_floating_point_v<T>
+    void attention(const std::size_t steps, const std::size_t dim, const T scale, const T* q, const std::size_t ldq,
+                   const T* k, const std::size_t ldk, const T* v, const std::size_t ldv, T* o, const std::size_t ldo,
+                   T* lse) {
+        std::array<T, ATTENTION_BLOCK * ATTENTION_BLOCK> p;
+        std::array<T, ATTENTION_BLOCK> max;
+        std::array<T, ATTENTION_BLOCK> sum;
+        std::array<T, ATTENTION_BLOCK> rescale;
+
+        for (std::size_t r0 = 0; r0 < steps; r0 += ATTENTION_BLOCK) {
+            const std::size_t rows = std::min(ATTENTION_BLOCK, steps - r0);
+
+            max.fill(-std::numeric_limits<T>::infinity());
+            sum.fill(T{});
+
+            for (std::size_t c0 = 0; c0 < r0 + rows; c0 += ATTENTION_BLOCK) {
+                const std::size_t cols = std::min(ATTENTION_BLOCK, steps - c0);
+
+                gemm(true, false, rows, cols, dim, q + r0, ldq, k + c0, ldk, T{}, p.data(), cols);
+
+                for (std::size_t r = 0; r < rows; r++) {
+                    T* row = p.data() + r * cols;
+
+                    // Keys past the query are masked out, only the diagonal tile has any
+                    const std::size_t visible = std::min(cols, r0 + r + 1 - std::min(r0 + r + 1, c0));
+
+                    T next = max[r];
+                    for (std::size_t c = 0; c < visible; c++) {
+                        row[c] *= scale;
+                        next = std::max(next, row[c]);
+                    }
+
+                    T total = T{};
+                    for (std::size_t c = 0; c < visible; c++) {
+                        row[c] = std::exp(row[c] - next);
+                        total += row[c];
+                    }
+                    std::fill(row + visible, row + cols, T{});
+
+                    rescale[r] = std::exp(max[r] - next);
+                    sum[r] = sum[r] * rescale[r] + total;
+                    max[r] = next;
+                }
+
+                // The first tile overwrites the output, later ones rescale what has been accumulated so far
+                if (c0 > 0) {
+                    for (std::size_t d = 0; d < dim; d++) {
+                        for (std::size_t r = 0; r < rows; r++) {
+                            o[d * ldo + r0 + r] *= rescale[r];
+                        }
+                    }
+                }
+
+                gemm(false, true, dim, rows, cols, v + c0, ldv, p.data(), cols, c0 == 0 ? T{} : T{1}, o + r0, ldo);
+            }
+
+            for (std::size_t d = 0; d < dim; d++) {
+                for (std::size_t r = 0; r < rows; r++) {
+                    o[d * ldo + r0 + r] /= sum[r];
+                }
+            }
+
+            for (std::size_t r = 0; r < rows; r++) {
+                lse[r0 + r] = max[r] + std::log(sum[r]);
+            }
+        }
+    }
+
+    /**
+     * Gradient of attention given the gradient d_o of its output, in the same layout, and the o and lse of the
+     * forward pass. The weights of each tile are recomputed from the scores and lse rather than stored, so this too
+     * runs in memory linear in steps. The gradients are accumulated into d_q, d_k and d_v.
+     */
+    template<typename T>
+    requires std::is_floating_point_v<T>
+    void attentionBackward(const std::size_t steps, const std::size_t dim, const T scale, const T* q,
+                           const std::size_t ldq, const T* k, const std::size_t ldk, const T* v, const std::size_t ldv,
+                           const T* o, const std::size_t ldo, const T* lse, const T* d_o, const std::size_t lddo,
+                           T* d_q, const std::size_t lddq, T* d_k, const std::size_t lddk, T* d_v,
+                           const std::size_t lddv) {
+        std::array<T, ATTENTION_BLOCK * ATTENTION_BLOCK> p;
+        std::array<T, ATTENTION_BLOCK * ATTENTION_BLOCK> d_s;
+        std::array<T, ATTENTION_BLOCK> dot;
+
+        for (std::size_t r0 = 0; r0 < steps; r0 += ATTENTION_BLOCK) {
+            const std::size_t rows = std::min(ATTENTION_BLOCK, steps - r0);
+
+            // d_o . o per query, the softmax Jacobian's correction term
+            dot.fill(T{});
+            for (std::size_t d = 0; d < dim; d++) {
+                for (std::size_t r = 0; r < rows; r++) {
+                    dot[r] += d_o[d * lddo + r0 + r] * o[d * ldo + r0 + r];
+                }
+            }
+
+            for (std::size_t c0 = 0; c0 < r0 + rows; c0 += ATTENTION_BLOCK) {
+                const std::size_t cols = std::min(ATTENTION_BLOCK, steps - c0);
+
+                gemm(true, false, rows, cols, dim, q + r0, ldq, k + c0, ldk, T{}, p.data(), cols);
+                gemm(true, false, rows, cols, dim, d_o + r0, lddo, v + c0, ldv, T{}, d_s.data(), cols);
+
+                for (std::size_t r = 0; r < rows; r++) {
+                    T* row = p.data() + r * cols;
+                    T* d_row = d_s.data() + r * cols;
+
+                    const std::size_t visible = std::min(cols, r0 + r + 1 - std::min(r0 + r + 1, c0));
+
+                    for (std::size_t c = 0; c < visible; c++) {
+                        row[c] = std::exp(row[c] * scale - lse[r0 + r]);
+                        d_row[c] = row[c] * (d_row[c] - dot[r]) * scale;
+                    }
+                    std::fill(row + visible, row + cols, T{});
+                    std::fill(d_row + visible, d_row + cols, T{});
+                }
+
+                gemm(false, false, dim, cols, rows, d_o + r0, lddo, p.data(), cols, T{1}, d_v + c0, lddv);
+                gemm(false, true, dim, rows, cols, k + c0, ldk, d_s.data(), cols, T{1}, d_q + r0, lddq);
+                gemm(false, false, dim, cols, rows, q + r0, ldq, d_s.data(), cols, T{1}, d_k + c0, lddk);
+            }
+        }
+    }
+}
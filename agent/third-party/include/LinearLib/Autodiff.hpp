@@ -0,0 +1,385 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <initializer_list>
+
+#include "Arena.hpp"
+#include "Gemm.hpp"
+
+namespace LinearLib::Autodiff {
+
+    /**
+     * A rows x cols row major matrix on a Tape together with its gradient, both with leading dimension ld. grad is
+     * null for values that need no gradient, such as inputs. Vars are plain handles: slices share the memory of the
+     * Var they are taken from, so gradients flowing into a slice land in its parent.
+     */
+    struct Var {
+        float* value = nullptr;
+        float* grad = nullptr;
+        std::size_t rows = 0;
+        std::size_t cols = 0;
+        std::size_t ld = 0;
+
+        [[nodiscard]] bool empty() const {
+            return value == nullptr;
+        }
+
+        // Columns [start, start + n), e.g. one time step of a time major batch
+        [[nodiscard]] Var columns(const std::size_t start, const std::size_t n) const {
+            assert(start + n <= cols && "Columns lie outside the Var");
+            return {value + start, grad != nullptr ? grad + start : nullptr, rows, n, ld};
+        }
+
+        // Rows [start, start + n), e.g. one gate of stacked gate weights
+        [[nodiscard]] Var block(const std::size_t start, const std::size_t n) const {
+            assert(start + n <= rows && "Rows lie outside the Var");
+            return {value + start * ld, grad != nullptr ? grad + start * ld : nullptr, n, cols, ld};
+        }
+    };
+
+    enum class Activation { Identity, Tanh, Sigmoid, Relu };
+
+    /**
+     * Reverse mode automatic differentiation over LinearLib matrices. Every operation computes its result right away
+     * and records a node, and backward() walks the nodes last to first, accumulating the gradient of each result into
+     * the gradients of its operands.
+     *
+     * Nodes, results and their gradients all come from an Arena, so recording a training step costs pointer bumps
+     * rather than heap allocations and the whole tape is released with the arena's scope. Parameters are bound to
+     * external value and gradient buffers, so their gradients accumulate straight into e.g. a model's Parameters.
+     *
+     * The operations are the fused patterns the hand-written models use rather than single arithmetic ops: linear()
+     * is act(w x + plus + bias) with one GEMM per product and one pass for the bias and activation, forward and
+     * backward, and lerp() is the gated update of GRU like cells. A model written against the tape therefore runs
+     * the same GEMMs as its hand-written counterpart.
+     *
+     * Gradients are linear in the seed given to the outputs, so seeding with the downhill error of the models,
+     * label - y, yields downhill parameter gradients.
+     */
+    struct Tape {
+        enum class Op { MatMul, Linear, Add, Mul, Lerp, Activate };
+
+        struct Node {
+            Op op;
+            Activation activation;
+            Var out;
+            // Operands: a b for MatMul, Add and Mul; w x plus bias for Linear; a b f for Lerp; x for Activate
+            Var in[4];
+            Node* previous;
+        };
+
+        Arena* arena = nullptr;
+        Node* last = nullptr;
+        std::size_t nodes = 0;
+
+        Tape() = default;
+
+        explicit Tape(Arena& arena) : arena(&arena) {}
+
+        // Forgets every node and records into the given arena from now on
+        void reset(Arena& arena) {
+            this->arena = &arena;
+            last = nullptr;
+            nodes = 0;
+        }
+
+        // A value that needs no gradient, such as the input of a batch
+        static Var constant(const float* value, const std::size_t rows, const std::size_t cols,
+                            const std::size_t ld = 0) {
+            return {const_cast<float*>(value), nullptr, rows, cols, ld == 0 ? cols : ld};
+        }
+
+        // A trainable value whose gradient accumulates into grad, which the caller zeroes
+        static Var parameter(float* value, float* grad, const std::size_t rows, const std::size_t cols) {
+            return {value, grad, rows, cols, cols};
+        }
+
+        // A zero matrix that needs no gradient, e.g. an initial state
+        Var zeros(const std::size_t rows, const std::size_t cols) {
+            Var res = make(rows, cols, false);
+            std::fill_n(res.value, rows * cols, 0.0f);
+            return res;
+        }
+
+        Var matmul(const Var& a, const Var& b) {
+            assert(a.cols == b.rows && "Inner dimensions differ");
+
+            Var out = make(a.rows, b.cols, a.grad != nullptr || b.grad != nullptr);
+            gemm(false, false, a.rows, b.cols, a.cols, a.value, a.ld, b.value, b.ld, 0.0f, out.value, out.ld);
+
+            record(Op::MatMul, Activation::Identity, out, {a, b});
+            return out;
+        }
+
+        /**
+         * act(w x + plus + bias), where plus, e.g. an input projection precomputed for every step at once, and the
+         * bias, a column broadcast over the columns, may be left empty.
+         */
+        Var linear(const Var& w, const Var& x, const Var& bias = {}, const Activation activation = Activation::Identity,
+                   const Var& plus = {}) {
+            assert(w.cols == x.rows && "Inner dimensions differ");
+            assert((plus.empty() || (plus.rows == w.rows && plus.cols == x.cols)) && "Addend differs in shape");
+            assert((bias.empty() || bias.rows == w.rows) && "Bias differs in shape");
+
+            const bool grad = w.grad != nullptr || x.grad != nullptr || plus.grad != nullptr || bias.grad != nullptr;
+            Var out = make(w.rows, x.cols, grad);
+
+            if (plus.empty()) {
+                gemm(false, false, w.rows, x.cols, w.cols, w.value, w.ld, x.value, x.ld, 0.0f, out.value, out.ld);
+            } else {
+                for (std::size_t i = 0; i < out.rows; i++) {
+                    std::copy_n(plus.value + i * plus.ld, out.cols, out.value + i * out.ld);
+                }
+                gemm(false, false, w.rows, x.cols, w.cols, w.value, w.ld, x.value, x.ld, 1.0f, out.value, out.ld);
+            }
+
+            for (std::size_t i = 0; i < out.rows; i++) {
+                float* row = out.value + i * out.ld;
+                const float b = bias.empty() ? 0.0f : bias.value[i * bias.ld];
+                for (std::size_t j = 0; j < out.cols; j++) {
+                    row[j] = activate(activation, row[j] + b);
+                }
+            }
+
+            record(Op::Linear, activation, out, {w, x, plus, bias});
+            return out;
+        }
+
+        Var add(const Var& a, const Var& b) {
+            return elementwise(Op::Add, a, b, [](const float x, const float y) { return x + y; });
+        }
+
+        Var mul(const Var& a, const Var& b) {
+            return elementwise(Op::Mul, a, b, [](const float x, const float y) { return x * y; });
+        }
+
+        // a + f (b - a), the gated interpolation of GRU like cells
+        Var lerp(const Var& a, const Var& b, const Var& f) {
+            assert(a.rows == b.rows && a.cols == b.cols && a.rows == f.rows && a.cols == f.cols && "Shapes differ");
+
+            Var out = make(a.rows, a.cols, a.grad != nullptr || b.grad != nullptr || f.grad != nullptr);
+            for (std::size_t i = 0; i < out.rows; i++) {
+                for (std::size_t j = 0; j < out.cols; j++) {
+                    const float x = a.value[i * a.ld + j];
+                    out.value[i * out.ld + j] = x + f.value[i * f.ld + j] * (b.value[i * b.ld + j] - x);
+                }
+            }
+
+            record(Op::Lerp, Activation::Identity, out, {a, b, f});
+            return out;
+        }
+
+        Var apply(const Activation activation, const Var& x) {
+            Var out = make(x.rows, x.cols, x.grad != nullptr);
+            for (std::size_t i = 0; i < out.rows; i++) {
+                for (std::size_t j = 0; j < out.cols; j++) {
+                    out.value[i * out.ld + j] = activate(activation, x.value[i * x.ld + j]);
+                }
+            }
+
+            record(Op::Activate, activation, out, {x});
+            return out;
+        }
+
+        Var tanh(const Var& x) {
+            return apply(Activation::Tanh, x);
+        }
+
+        Var sigmoid(const Var& x) {
+            return apply(Activation::Sigmoid, x);
+        }
+
+        Var relu(const Var& x) {
+            return apply(Activation::Relu, x);
+        }
+
+        /**
+         * Propagates the gradients already seeded into the outputs, e.g. the error of the last layer, back through
+         * every recorded node. The gradients of intermediate results are consumed in place.
+         */
+        void backward() {
+            for (Node* node = last; node != nullptr; node = node->previous) {
+                if (node->out.grad != nullptr) {
+                    propagate(*node);
+                }
+            }
+        }
+
+        static float activate(const Activation activation, const float x) {
+            switch (activation) {
+                case Activation::Tanh:
+                    return std::tanh(x);
+                case Activation::Sigmoid:
+                    return 1.0f / (1.0f + std::exp(-x));
+                case Activation::Relu:
+                    return std::max(0.0f, x);
+                default:
+                    return x;
+            }
+        }
+
+        // Derivative of the activation expressed through its output y
+        static float derivative(const Activation activation, const float y) {
+            switch (activation) {
+                case Activation::Tanh:
+                    return 1.0f - y * y;
+                case Activation::Sigmoid:
+                    return y * (1.0f - y);
+                case Activation::Relu:
+                    return y > 0.0f ? 1.0f : 0.0f;
+                default:
+                    return 1.0f;
+            }
+        }
+
+    private:
+        Var make(const std::size_t rows, const std::size_t cols, const bool grad) {
+            assert(arena != nullptr && "The tape records into no arena");
+
+            Var res{arena->allocate<float>(rows * cols), nullptr, rows, cols, cols};
+            if (grad) {
+                res.grad = arena->allocate<float>(rows * cols);
+                std::fill_n(res.grad, rows * cols, 0.0f);
+            }
+            return res;
+        }
+
+        void record(const Op op, const Activation activation, const Var& out, std::initializer_list<Var> in) {
+            Node& node = arena->make<Node>();
+            node.op = op;
+            node.activation = activation;
+            node.out = out;
+            std::copy(in.begin(), in.end(), node.in);
+            std::fill(node.in + in.size(), node.in + 4, Var{});
+            node.previous = last;
+
+            last = &node;
+            nodes++;
+        }
+
+        template<typename Fn>
+        Var elementwise(const Op op, const Var& a, const Var& b, Fn&& fn) {
+            assert(a.rows == b.rows && a.cols == b.cols && "Shapes differ");
+
+            Var out = make(a.rows, a.cols, a.grad != nullptr || b.grad != nullptr);
+            for (std::size_t i = 0; i < out.rows; i++) {
+                for (std::size_t j = 0; j < out.cols; j++) {
+                    out.value[i * out.ld + j] = fn(a.value[i * a.ld + j], b.value[i * b.ld + j]);
+                }
+            }
+
+            record(op, Activation::Identity, out, {a, b});
+            return out;
+        }
+
+        static void propagate(Node& node) {
+            Var& out = node.out;
+            const std::size_t rows = out.rows;
+            const std::size_t cols = out.cols;
+            float* d = out.grad;
+
+            switch (node.op) {
+                case Op::MatMul: {
+                    const Var& a = node.in[0];
+                    const Var& b = node.in[1];
+                    if (a.grad != nullptr) {
+                        gemm(false, true, rows, a.cols, cols, d, out.ld, b.value, b.ld, 1.0f, a.grad, a.ld);
+                    }
+                    if (b.grad != nullptr) {
+                        gemm(true, false, b.rows, cols, rows, a.value, a.ld, d, out.ld, 1.0f, b.grad, b.ld);
+                    }
+                    break;
+                }
+
+                case Op::Linear: {
+                    const Var& w = node.in[0];
+                    const Var& x = node.in[1];
+                    const Var& plus = node.in[2];
+                    const Var& bias = node.in[3];
+
+                    // The gradient of the pre-activation replaces that of the output, then one pass feeds the bias
+                    // and the addend
+                    for (std::size_t i = 0; i < rows; i++) {
+                        float sum = 0.0f;
+                        for (std::size_t j = 0; j < cols; j++) {
+                            float& g = d[i * out.ld + j];
+                            g *= derivative(node.activation, out.value[i * out.ld + j]);
+                            sum += g;
+                        }
+                        if (bias.grad != nullptr) {
+                            bias.grad[i * bias.ld] += sum;
+                        }
+                        if (plus.grad != nullptr) {
+                            for (std::size_t j = 0; j < cols; j++) {
+                                plus.grad[i * plus.ld + j] += d[i * out.ld + j];
+                            }
+                        }
+                    }
+
+                    if (w.grad != nullptr) {
+                        gemm(false, true, rows, w.cols, cols, d, out.ld, x.value, x.ld, 1.0f, w.grad, w.ld);
+                    }
+                    if (x.grad != nullptr) {
+                        gemm(true, false, x.rows, cols, rows, w.value, w.ld, d, out.ld, 1.0f, x.grad, x.ld);
+                    }
+                    break;
+                }
+
+                case Op::Add:
+                case Op::Mul: {
+                    const Var& a = node.in[0];
+                    const Var& b = node.in[1];
+                    const bool product = node.op == Op::Mul;
+                    for (std::size_t i = 0; i < rows; i++) {
+                        for (std::size_t j = 0; j < cols; j++) {
+                            const float g = d[i * out.ld + j];
+                            if (a.grad != nullptr) {
+                                a.grad[i * a.ld + j] += product ? g * b.value[i * b.ld + j] : g;
+                            }
+                            if (b.grad != nullptr) {
+                                b.grad[i * b.ld + j] += product ? g * a.value[i * a.ld + j] : g;
+                            }
+                        }
+                    }
+                    break;
+                }
+
+                case Op::Lerp: {
+                    const Var& a = node.in[0];
+                    const Var& b = node.in[1];
+                    const Var& f = node.in[2];
+                    for (std::size_t i = 0; i < rows; i++) {
+                        for (std::size_t j = 0; j < cols; j++) {
+                            const float g = d[i * out.ld + j];
+                            const float gate = f.value[i * f.ld + j];
+                            if (a.grad != nullptr) {
+                                a.grad[i * a.ld + j] += g * (1.0f - gate);
+                            }
+                            if (b.grad != nullptr) {
+                                b.grad[i * b.ld + j] += g * gate;
+                            }
+                            if (f.grad != nullptr) {
+                                f.grad[i * f.ld + j] += g * (b.value[i * b.ld + j] - a.value[i * a.ld + j]);
+                            }
+                        }
+                    }
+                    break;
+                }
+
+                case Op::Activate: {
+                    const Var& x = node.in[0];
+                    for (std::size_t i = 0; i < rows; i++) {
+                        for (std::size_t j = 0; j < cols; j++) {
+                            x.grad[i * x.ld + j] += d[i * out.ld + j]
+                                                    * derivative(node.activation, out.value[i * out.ld + j]);
+                        }
+                    }
+                    break;
+                }
+            }
+        }
+    };
+}
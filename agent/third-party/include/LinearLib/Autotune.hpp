@@ -0,0 +1,287 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <optional>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "Benchmark.hpp"
+#include "Gemm.hpp"
+#include "Strassen.hpp"
+
+namespace LinearLib::Autotune {
+
+    /**
+     * A product C (m x n) = A (m x k) * B (k x n) the caller wants the kernel tuned for.
+     */
+    struct Shape {
+        std::size_t m;
+        std::size_t n;
+        std::size_t k;
+    };
+
+    /**
+     * Host identifier used to key the cache, the CPU model name as reported by the kernel.
+     */
+    inline std::string cpuModel() {
+        std::ifstream cpuinfo("/proc/cpuinfo");
+        std::string line;
+
+        while (std::getline(cpuinfo, line)) {
+            if (line.starts_with("model name")) {
+                const std::size_t colon = line.find(':');
+                if (colon != std::string::npos && colon + 2 <= line.size()) {
+                    return line.substr(colon + 2);
+                }
+            }
+        }
+
+        return "unknown";
+    }
+
+    /**
+     * Cache key of a host tuned for a set of shapes, the CPU model and an FNV-1a hash of the shapes in order. A
+     * configuration tuned for one model or batch size is thereby never reused for another.
+     */
+    inline std::string cacheKey(const std::vector<Shape>& shapes) {
+        std::uint64_t hash = 14695981039346656037ull;
+        for (const Shape& shape: shapes) {
+            for (const std::size_t dimension: {shape.m, shape.n, shape.k}) {
+                for (std::size_t byte = 0; byte < sizeof(std::uint64_t); byte++) {
+                    hash ^= (static_cast<std::uint64_t>(dimension) >> (8 * byte)) & 0xff;
+                    hash *= 1099511628211ull;
+                }
+            }
+        }
+
+        std::stringstream key;
+        key << cpuModel() << "/" << std::hex << hash;
+        return key.str();
+    }
+
+    /**
+     * Total best-of time of the candidate configuration over every shape the caller registered, through the same
+     * dispatch as the models so the Strassen cutoff counts as well. Each shape is timed plain, with B transposed as
+     * in the weight gradients and with A transposed as in the backpropagated errors, since the packing differs.
+     */
+    inline double measure(const GemmConfig& candidate, const std::vector<Shape>& shapes) {
+        const GemmConfig previous = gemmConfig();
+        gemmConfig() = candidate;
+
+        double total = 0;
+
+        for (const Shape& shape: shapes) {
+            const std::vector<float> a = Benchmark::random<float>(shape.m * shape.k, 1);
+            const std::vector<float> b = Benchmark::random<float>(shape.k * shape.n, 2);
+            std::vector<float> c(shape.m * shape.n);
+
+            constexpr std::array<std::pair<bool, bool>, 3> TRANSPOSES = {{
+                {false, false}, {false, true}, {true, false}
+            }};
+            for (const auto& [transA, transB]: TRANSPOSES) {
+                const std::size_t lda = transA ? shape.m : shape.k;
+                const std::size_t ldb = transB ? shape.k : shape.n;
+
+                total += Benchmark::time([&] {
+                    strassenGemm(transA, transB, shape.m, shape.n, shape.k, a.data(), lda, b.data(), ldb, 0.0f,
+                                 c.data(), shape.n);
+                });
+            }
+        }
+
+        gemmConfig() = previous;
+
+        return total;
+    }
+
+    /**
+     * Coordinate search over the register tile and the kc, mc and nc blocking, one parameter at a time starting
+     * from the current configuration, then over the Strassen cutoff on the shapes that split into square blocks.
+     * Shapes too small to reach the packed kernel are ignored.
+     */
+    inline GemmConfig tune(const std::vector<Shape>& shapes, std::ostream& log) {
+
+        std::vector<Shape> packed;
+        for (const Shape& shape: shapes) {
+            if (shape.m * shape.n * shape.k > Detail::GEMM_SMALL_THRESHOLD) {
+                packed.push_back(shape);
+            }
+        }
+
+        // The blocking is tuned for the plain kernel, which is also what Strassen bottoms out in
+        GemmConfig best = gemmConfig();
+        best.strassenCutoff = 0;
+
+        if (packed.empty()) {
+            log << "No shapes large enough to tune, keeping default GEMM configuration." << std::endl;
+            return best;
+        }
+
+        double bestTime = measure(best, packed);
+
+        const auto search = [&](const char* name, std::size_t GemmConfig::*field,
+                                const std::vector<std::size_t>& values) {
+            for (const std::size_t value: values) {
+                GemmConfig candidate = best;
+                candidate.*field = value;
+
+                const double candidateTime = measure(candidate, packed);
+                if (candidateTime < bestTime) {
+                    bestTime = candidateTime;
+                    best = candidate;
+                }
+            }
+            log << "Autotune " << name << " = " << best.*field << " (" << bestTime * 1e3 << "ms)" << std::endl;
+        };
+
+        std::vector<std::size_t> kernels;
+        for (std::size_t i = 0; i < GEMM_KERNELS.size(); i++) {
+            kernels.push_back(i);
+        }
+
+        search("kernel", &GemmConfig::kernel, kernels);
+        search("kc", &GemmConfig::kc, {128, 192, 256, 384, 512});
+        search("mc", &GemmConfig::mc, {48, 72, 96, 144, 192, 288});
+        search("nc", &GemmConfig::nc, {512, 1024, 2048, 4096});
+
+        // Only shapes with square blocks above the smallest cutoff can recurse, timed with and without Strassen
+        std::vector<Shape> square;
+        std::size_t largest = 0;
+        for (const Shape& shape: packed) {
+            const std::size_t block = std::gcd(shape.m, std::gcd(shape.n, shape.k));
+            if (block > 64) {
+                square.push_back(shape);
+                largest = std::max(largest, block);
+            }
+        }
+
+        if (square.empty()) {
+            log << "Autotune strassenCutoff = 0 (no square blocks)" << std::endl;
+            return best;
+        }
+
+        // Strassen trades accuracy and extra memory traffic for fewer flops, so it has to win by more than the noise
+        const double plainTime = measure(best, square);
+        bestTime = plainTime * 0.95;
+
+        GemmConfig candidate = best;
+        for (std::size_t cutoff = 64; cutoff < largest; cutoff *= 2) {
+            candidate.strassenCutoff = cutoff;
+
+            const double candidateTime = measure(candidate, square);
+            if (candidateTime < bestTime) {
+                bestTime = candidateTime;
+                best = candidate;
+            }
+        }
+
+        log << "Autotune strassenCutoff = " << best.strassenCutoff << " ("
+            << std::min(bestTime, plainTime) * 1e3 << "ms, " << plainTime * 1e3 << "ms without)" << std::endl;
+
+        return best;
+    }
+
+    /**
+     * Reads the cached configuration for a key, see cacheKey(). Each line of the cache holds one key, its fields
+     * separated by the same record separator as the model files. An entry that does not parse, or holds an
+     * impossible configuration, reads as missing.
+     */
+    inline std::optional<GemmConfig> load(const std::string& path, const std::string& key) {
+        std::ifstream file(path);
+        std::string line;
+
+        while (std::getline(file, line)) {
+            std::stringstream stream(line);
+            std::string token;
+
+            std::getline(stream, token, '\x{1E}');
+            if (token != key) {
+                continue;
+            }
+
+            GemmConfig config;
+            for (std::size_t* field: {&config.mc, &config.kc, &config.nc, &config.kernel, &config.strassenCutoff}) {
+                if (!std::getline(stream, token, '\x{1E}')) {
+                    return std::nullopt;
+                }
+                const auto [end, error] = std::from_chars(token.data(), token.data() + token.size(), *field);
+                if (error != std::errc() || end != token.data() + token.size()) {
+                    return std::nullopt;
+                }
+            }
+
+            // A corrupt entry is retuned rather than trusted, zero blocks would never advance the blocked loops
+            if (config.kernel >= GEMM_KERNELS.size() || config.mc == 0 || config.kc == 0 || config.nc == 0) {
+                return std::nullopt;
+            }
+
+            return config;
+        }
+
+        return std::nullopt;
+    }
+
+    /**
+     * Writes the configuration for a key, replacing an existing entry and keeping those of other keys.
+     */
+    inline void store(const std::string& path, const std::string& key, const GemmConfig& config) {
+        std::vector<std::string> lines;
+
+        {
+            std::ifstream file(path);
+            std::string line;
+            while (std::getline(file, line)) {
+                if (!line.starts_with(key + "\x{1E}")) {
+                    lines.push_back(line);
+                }
+            }
+        }
+
+        std::stringstream entry;
+        entry << key << "\x{1E}" << config.mc << "\x{1E}" << config.kc << "\x{1E}" << config.nc << "\x{1E}"
+              << config.kernel << "\x{1E}" << config.strassenCutoff;
+        lines.push_back(entry.str());
+
+        const std::filesystem::path parent = std::filesystem::path(path).parent_path();
+        if (!parent.empty()) {
+            std::filesystem::create_directories(parent);
+        }
+
+        std::ofstream file(path, std::ios::trunc);
+        for (const std::string& line: lines) {
+            file << line << "\n";
+        }
+    }
+
+    /**
+     * Installs the cached configuration for this host and these shapes, only benchmarking when there is no entry
+     * yet or a retune is forced.
+     */
+    inline void configure(const std::string& path, const std::vector<Shape>& shapes, std::ostream& log,
+                          const bool force = false) {
+        const std::string key = cacheKey(shapes);
+
+        if (!force) {
+            if (const std::optional<GemmConfig> cached = load(path, key)) {
+                gemmConfig() = *cached;
+                log << "Loaded GEMM configuration for " << key << " from " << path << std::endl;
+                return;
+            }
+        }
+
+        log << "Autotuning GEMM kernels for " << key << "..." << std::endl;
+        gemmConfig() = tune(shapes, log);
+        store(path, key, gemmConfig());
+    }
+}
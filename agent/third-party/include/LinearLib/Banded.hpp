@@ -0,0 +1,216 @@
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <type_traits>
+
+#include "Matrix.hpp"
+
+namespace LinearLib {
+    /**
+     * Square band matrix with KL sub-diagonals and KU super-diagonals. Row i stores columns i - KL through i + KU,
+     * N * (KL + KU + 1) elements in total, and every kernel only iterates within the band.
+     */
+    template<std::size_t N, std::size_t KL, std::size_t KU, typename T>
+    requires std::is_arithmetic_v<T>
+    struct Banded {
+        static constexpr std::size_t WIDTH = KL + KU + 1;
+
+        std::array<T, N * WIDTH> data;
+
+        // Default constructor is still needed
+        Banded() = default;
+
+        static Banded identity() {
+            Banded res = zeros();
+
+            for (std::size_t i = 0; i < N; i++) {
+                res.at(i, i) = T{1};
+            }
+
+            return res;
+        }
+
+        static Banded zeros() {
+            Banded res;
+            res.data.fill(T{0});
+            return res;
+        }
+
+        /**
+         * Keeps the band of a dense square matrix, discarding everything outside it.
+         */
+        static Banded fromMatrix(const Matrix<N, N, T>& mat) {
+            Banded res = zeros();
+
+            for (std::size_t i = 0; i < N; i++) {
+                for (std::size_t j = first(i); j < last(i); j++) {
+                    res.at(i, j) = mat[i][j];
+                }
+            }
+
+            return res;
+        }
+
+        Matrix<N, N, T> toMatrix() const {
+            Matrix<N, N, T> res = Matrix<N, N, T>::zeros();
+
+            for (std::size_t i = 0; i < N; i++) {
+                for (std::size_t j = first(i); j < last(i); j++) {
+                    res[i][j] = at(i, j);
+                }
+            }
+
+            return res;
+        }
+
+        // First and one past the last column of row i inside the band
+        [[nodiscard]] static constexpr std::size_t first(std::size_t const i) {
+            return i > KL ? i - KL : 0;
+        }
+
+        [[nodiscard]] static constexpr std::size_t last(std::size_t const i) {
+            return i + KU + 1 < N ? i + KU + 1 : N;
+        }
+
+        [[nodiscard]] static constexpr bool inBand(std::size_t const i, std::size_t const j) {
+            return j + KL >= i && j <= i + KU;
+        }
+
+        T& at(std::size_t const i, std::size_t const j) {
+            assert(i < N && j < N && inBand(i, j) && "Index outside the band");
+            return data[i * WIDTH + j + KL - i];
+        }
+
+        const T& at(std::size_t const i, std::size_t const j) const {
+            assert(i < N && j < N && inBand(i, j) && "Index outside the band");
+            return data[i * WIDTH + j + KL - i];
+        }
+
+        // Element access for any position, zero outside the band
+        T operator()(std::size_t const i, std::size_t const j) const {
+            return inBand(i, j) ? at(i, j) : T{0};
+        }
+
+        /**
+         * Solves A * X = B by banded Gaussian elimination without pivoting, O(N * KL * (KU + C)). Without row swaps
+         * the factors stay inside the band, which is stable for the diagonally dominant systems this is meant for.
+         */
+        template<std::size_t C>
+        Matrix<N, C, T> solve(const Matrix<N, C, T>& b) const {
+            Banded lu = *this;
+            Matrix<N, C, T> res = b;
+
+            for (std::size_t k = 0; k < N; k++) {
+                const T pivot = lu.at(k, k);
+                assert(pivot != T{0} && "Zero pivot in banded solve");
+
+                for (std::size_t i = k + 1; i < N && i <= k + KL; i++) {
+                    const T factor = lu.at(i, k) / pivot;
+                    for (std::size_t j = k + 1; j < last(k); j++) {
+                        lu.at(i, j) -= factor * lu.at(k, j);
+                    }
+                    for (std::size_t j = 0; j < C; j++) {
+                        res[i][j] -= factor * res[k][j];
+                    }
+                }
+            }
+
+            for (std::size_t step = 0; step < N; step++) {
+                const std::size_t i = N - 1 - step;
+                for (std::size_t k = i + 1; k < last(i); k++) {
+                    const T scale = lu.at(i, k);
+                    for (std::size_t j = 0; j < C; j++) {
+                        res[i][j] -= scale * res[k][j];
+                    }
+                }
+                for (std::size_t j = 0; j < C; j++) {
+                    res[i][j] /= lu.at(i, i);
+                }
+            }
+
+            return res;
+        }
+
+        bool operator==(const Banded& other) const {
+            return data == other.data;
+        }
+
+        friend Banded operator+(const Banded& lhs, const Banded& rhs) {
+            Banded res;
+
+            for (std::size_t i = 0; i < N * WIDTH; i++) {
+                res.data[i] = lhs.data[i] + rhs.data[i];
+            }
+
+            return res;
+        }
+
+        friend Banded operator*(const Banded& mat, const T& scalar) {
+            Banded res;
+
+            for (std::size_t i = 0; i < N * WIDTH; i++) {
+                res.data[i] = mat.data[i] * scalar;
+            }
+
+            return res;
+        }
+
+        /**
+         * Product of two band matrices, the bandwidths add up
+         */
+        template<std::size_t L2, std::size_t U2>
+        friend Banded<N, KL + L2, KU + U2, T> operator&(const Banded& lhs, const Banded<N, L2, U2, T>& rhs) {
+            Banded<N, KL + L2, KU + U2, T> res = Banded<N, KL + L2, KU + U2, T>::zeros();
+
+            for (std::size_t i = 0; i < N; i++) {
+                for (std::size_t k = first(i); k < last(i); k++) {
+                    const T scale = lhs.at(i, k);
+                    for (std::size_t j = Banded<N, L2, U2, T>::first(k); j < Banded<N, L2, U2, T>::last(k); j++) {
+                        res.at(i, j) += scale * rhs.at(k, j);
+                    }
+                }
+            }
+
+            return res;
+        }
+
+        /**
+         * A * M, each output row accumulates over the band of that row only
+         */
+        template<std::size_t C>
+        friend Matrix<N, C, T> operator&(const Banded& lhs, const Matrix<N, C, T>& rhs) {
+            Matrix<N, C, T> res = Matrix<N, C, T>::zeros();
+
+            for (std::size_t i = 0; i < N; i++) {
+                for (std::size_t k = first(i); k < last(i); k++) {
+                    const T scale = lhs.at(i, k);
+                    for (std::size_t j = 0; j < C; j++) {
+                        res[i][j] += scale * rhs[k][j];
+                    }
+                }
+            }
+
+            return res;
+        }
+
+        /**
+         * M * A, row k of A only reaches the columns inside its band
+         */
+        template<std::size_t R>
+        friend Matrix<R, N, T> operator&(const Matrix<R, N, T>& lhs, const Banded& rhs) {
+            Matrix<R, N, T> res = Matrix<R, N, T>::zeros();
+
+            for (std::size_t i = 0; i < R; i++) {
+                for (std::size_t k = 0; k < N; k++) {
+                    const T scale = lhs[i][k];
+                    for (std::size_t j = first(k); j < last(k); j++) {
+                        res[i][j] += scale * rhs.at(k, j);
+                    }
+                }
+            }
+
+            return res;
+        }
+    };
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <ostream>
+#include <random>
+#include <vector>
+
+#include "Gemm.hpp"
+#include "Strassen.hpp"
+
+namespace LinearLib::Benchmark {
+
+    /**
+     * Best wall time in seconds over a number of runs, the first run is treated as warm up.
+     */
+    template<typename F>
+    double time(F&& func, std::size_t const repeats = 3) {
+        func();
+
+        double best = std::numeric_limits<double>::max();
+        for (std::size_t i = 0; i < repeats; i++) {
+            const auto begin = std::chrono::steady_clock::now();
+            func();
+            const auto end = std::chrono::steady_clock::now();
+            best = std::min(best, std::chrono::duration<double>(end - begin).count());
+        }
+
+        return best;
+    }
+
+    template<typename T>
+    std::vector<T> random(std::size_t const count, std::size_t const seed) {
+        std::mt19937_64 rng(seed);
+        std::uniform_real_distribution<T> dist(-1, 1);
+
+        std::vector<T> res(count);
+        for (T& val: res) {
+            val = dist(rng);
+        }
+
+        return res;
+    }
+
+    /**
+     * Largest element-wise deviation of a result from a reference, relative to the largest reference magnitude.
+     */
+    template<typename T>
+    T relativeError(const std::vector<T>& reference, const std::vector<T>& result) {
+        T maxDiff = 0;
+        T maxRef = 0;
+        for (std::size_t i = 0; i < reference.size(); i++) {
+            maxDiff = std::max(maxDiff, std::abs(reference[i] - result[i]));
+            maxRef = std::max(maxRef, std::abs(reference[i]));
+        }
+        return maxRef == 0 ? maxDiff : maxDiff / maxRef;
+    }
+
+    /**
+     * Compares Strassen-Winograd against the blocked gemm kernel on n x n products, reporting GFLOP/s (counted as
+     * the classical 2n^3 so the rates are comparable) and the relative error against a double precision reference.
+     */
+    template<typename T>
+    void strassen(std::ostream& out, std::size_t const n, std::size_t const cutoff) {
+        const std::vector<T> a = random<T>(n * n, 1);
+        const std::vector<T> b = random<T>(n * n, 2);
+        std::vector<T> blocked(n * n);
+        std::vector<T> fast(n * n);
+
+        StrassenWorkspace<T> workspace(n, cutoff);
+
+        const double blockedTime = time([&] {
+            gemm(false, false, n, n, n, a.data(), n, b.data(), n, T{}, blocked.data(), n);
+        });
+
+        const double fastTime = time([&] {
+            strassen(n, a.data(), n, b.data(), n, fast.data(), n, workspace, cutoff);
+        });
+
+        const std::vector<double> a64(a.begin(), a.end());
+        const std::vector<double> b64(b.begin(), b.end());
+        std::vector<double> reference(n * n);
+        gemm(false, false, n, n, n, a64.data(), n, b64.data(), n, 0.0, reference.data(), n);
+
+        const std::vector<double> blocked64(blocked.begin(), blocked.end());
+        const std::vector<double> fast64(fast.begin(), fast.end());
+
+        const double flops = 2.0 * static_cast<double>(n) * static_cast<double>(n) * static_cast<double>(n);
+
+        out << "n=" << n << " cutoff=" << cutoff
+            << " blocked: " << blockedTime * 1e3 << "ms " << flops / blockedTime * 1e-9 << " GFLOP/s err "
+            << relativeError(reference, blocked64)
+            << " | strassen: " << fastTime * 1e3 << "ms " << flops / fastTime * 1e-9 << " GFLOP/s err "
+            << relativeError(reference, fast64)
+            << " | speedup " << blockedTime / fastTime << "x workspace " << workspace.peak * sizeof(T) / 1024
+            << "KiB" << std::endl;
+    }
+}
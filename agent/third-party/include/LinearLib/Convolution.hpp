@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+
+#include "Gemm.hpp"
+
+namespace LinearLib {
+
+    /**
+     * Causal dilated 1-D convolution over a time major batch. x is cin x (steps * batch) and y is cout x
+     * (steps * batch), column t * batch + b holding step t of sequence b, and
+     *
+     *   y_t = beta * y_t + sum_k w_k x_{t - k * dilation}
+     *
+     * where w stacks the taps w_0 .. w_{taps - 1}, each cout x cin, and steps before the start count as zero.
+     * Delaying a tap only shifts the columns it reads, so each tap is one GEMM over every step of every sequence at
+     * once, without an im2col copy.
+     */
+    template<typename T>
+    requires std::is_arithmetic_v<T>
+    void causalConv(const std::size_t taps, const std::size_t dilation, const std::size_t cout, const std::size_t cin,
+                    const std::size_t steps, const std::size_t batch, const T* w, const T* x, const std::size_t ldx,
+                    const T beta, T* y, const std::size_t ldy) {
+        for (std::size_t k = 0; k < taps && k * dilation < steps; k++) {
+            const std::size_t shift = k * dilation * batch;
+            gemm(false, false, cout, steps * batch - shift, cin, w + k * cout * cin, cin, x, ldx, k == 0 ? beta : T{1},
+                 y + shift, ldy);
+        }
+    }
+
+    /**
+     * Gradient of causalConv with respect to its input, d_x = beta * d_x + sum_k w_k^T d_y_{t + k * dilation}, given
+     * the output gradient d_y in the same layout.
+     */
+    template<typename T>
+    requires std::is_arithmetic_v<T>
+    void causalConvBackwardData(const std::size_t taps, const std::size_t dilation, const std::size_t cout,
+                                const std::size_t cin, const std::size_t steps, const std::size_t batch, const T* w,
+                                const T* d_y, const std::size_t ldy, const T beta, T* d_x, const std::size_t ldx) {
+        for (std::size_t k = 0; k < taps && k * dilation < steps; k++) {
+            const std::size_t shift = k * dilation * batch;
+            gemm(true, false, cin, steps * batch - shift, cout, w + k * cout * cin, cin, d_y + shift, ldy,
+                 k == 0 ? beta : T{1}, d_x, ldx);
+        }
+    }
+
+    /**
+     * Gradient of causalConv with respect to its taps, d_w_k = beta * d_w_k + sum_t d_y_t x_{t - k * dilation}^T,
+     * summed over the batch. Taps that reach back past the first step see only zeros.
+     */
+    template<typename T>
+    requires std::is_arithmetic_v<T>
+    void causalConvBackwardWeights(const std::size_t taps, const std::size_t dilation, const std::size_t cout,
+                                   const std::size_t cin, const std::size_t steps, const std::size_t batch,
+                                   const T* d_y, const std::size_t ldy, const T* x, const std::size_t ldx,
+                                   const T beta, T* d_w) {
+        for (std::size_t k = 0; k < taps; k++) {
+            T* d_w_k = d_w + k * cout * cin;
+
+            if (k * dilation < steps) {
+                const std::size_t shift = k * dilation * batch;
+                gemm(false, true, cout, cin, steps * batch - shift, d_y + shift, ldy, x, ldx, beta, d_w_k, cin);
+            } else {
+                for (std::size_t i = 0; i < cout * cin; i++) {
+                    d_w_k[i] = beta == T{} ? T{} : beta * d_w_k[i];
+                }
+            }
+        }
+    }
+}
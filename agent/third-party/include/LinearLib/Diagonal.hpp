@@ -0,0 +1,167 @@
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <initializer_list>
+#include <type_traits>
+
+#include "Matrix.hpp"
+
+namespace LinearLib {
+    /**
+     * Square diagonal matrix storing only its N diagonal entries. Products with a dense matrix scale its rows or
+     * columns in O(N * C) instead of running a full O(N^2 * C) multiplication.
+     */
+    template<std::size_t N, typename T>
+    requires std::is_arithmetic_v<T>
+    struct Diagonal {
+        std::array<T, N> data;
+
+        Diagonal(std::initializer_list<T> init) {
+            assert(init.size() == N && "Initializer list size must match matrix dimension");
+            std::copy(init.begin(), init.end(), data.begin());
+        }
+
+        // Default constructor is still needed
+        Diagonal() = default;
+
+        static Diagonal identity() {
+            return uniform(T{1});
+        }
+
+        static Diagonal zeros() {
+            return uniform(T{0});
+        }
+
+        static Diagonal uniform(T const val) {
+            Diagonal res;
+
+            for (std::size_t i = 0; i < N; i++) {
+                res.data[i] = val;
+            }
+
+            return res;
+        }
+
+        /**
+         * Keeps the main diagonal of a dense square matrix, discarding everything else.
+         */
+        static Diagonal fromMatrix(const Matrix<N, N, T>& mat) {
+            Diagonal res;
+
+            for (std::size_t i = 0; i < N; i++) {
+                res.data[i] = mat[i][i];
+            }
+
+            return res;
+        }
+
+        Matrix<N, N, T> toMatrix() const {
+            Matrix<N, N, T> res = Matrix<N, N, T>::zeros();
+
+            for (std::size_t i = 0; i < N; i++) {
+                res[i][i] = data[i];
+            }
+
+            return res;
+        }
+
+        Diagonal inverse() const {
+            Diagonal res;
+
+            for (std::size_t i = 0; i < N; i++) {
+                assert(data[i] != T{0} && "Singular diagonal matrix has no inverse");
+                res.data[i] = T{1} / data[i];
+            }
+
+            return res;
+        }
+
+        T determinant() const {
+            T res = T{1};
+
+            for (std::size_t i = 0; i < N; i++) {
+                res *= data[i];
+            }
+
+            return res;
+        }
+
+        bool operator==(const Diagonal& other) const {
+            return data == other.data;
+        }
+
+        T& operator[](std::size_t index) {
+            assert(index < N && "Index out of bounds");
+            return data[index];
+        }
+
+        const T& operator[](std::size_t index) const {
+            assert(index < N && "Index out of bounds");
+            return data[index];
+        }
+
+        friend Diagonal operator+(const Diagonal& lhs, const Diagonal& rhs) {
+            Diagonal res;
+
+            for (std::size_t i = 0; i < N; i++) {
+                res.data[i] = lhs.data[i] + rhs.data[i];
+            }
+
+            return res;
+        }
+
+        friend Diagonal operator*(const Diagonal& mat, const T& scalar) {
+            Diagonal res;
+
+            for (std::size_t i = 0; i < N; i++) {
+                res.data[i] = mat.data[i] * scalar;
+            }
+
+            return res;
+        }
+
+        friend Diagonal operator&(const Diagonal& lhs, const Diagonal& rhs) {
+            Diagonal res;
+
+            for (std::size_t i = 0; i < N; i++) {
+                res.data[i] = lhs.data[i] * rhs.data[i];
+            }
+
+            return res;
+        }
+
+        /**
+         * D * M, scales row i of M by d_i
+         */
+        template<std::size_t C>
+        friend Matrix<N, C, T> operator&(const Diagonal& lhs, const Matrix<N, C, T>& rhs) {
+            Matrix<N, C, T> res;
+
+            for (std::size_t i = 0; i < N; i++) {
+                const T scale = lhs.data[i];
+                for (std::size_t j = 0; j < C; j++) {
+                    res[i][j] = scale * rhs[i][j];
+                }
+            }
+
+            return res;
+        }
+
+        /**
+         * M * D, scales column j of M by d_j
+         */
+        template<std::size_t R>
+        friend Matrix<R, N, T> operator&(const Matrix<R, N, T>& lhs, const Diagonal& rhs) {
+            Matrix<R, N, T> res;
+
+            for (std::size_t i = 0; i < R; i++) {
+                for (std::size_t j = 0; j < N; j++) {
+                    res[i][j] = lhs[i][j] * rhs.data[j];
+                }
+            }
+
+            return res;
+        }
+    };
+}
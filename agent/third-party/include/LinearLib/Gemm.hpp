@@ -0,0 +1,683 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "Half.hpp"
+
+#if defined(__AVX512BF16__)
+#include <immintrin.h>
+#endif
+
+namespace LinearLib {
+
+    /**
+     * Cache blocking parameters for the packed GEMM kernel. A is packed in mc x kc blocks (sized for L2) and B in
+     * kc x nc blocks (sized for L3), each sliced into register tiles for the micro-kernel.
+     */
+    struct GemmConfig {
+        std::size_t mc = 96;
+        std::size_t kc = 256;
+        std::size_t nc = 2048;
+
+        // Index into GEMM_KERNELS selecting the register tile of the micro-kernel
+        std::size_t kernel = 0;
+
+        // Square blocks larger than this go through Strassen-Winograd, see strassenGemm, 0 disables it.
+        std::size_t strassenCutoff = 0;
+    };
+
+    struct KernelShape {
+        std::size_t mr;
+        std::size_t nr;
+    };
+
+    // Register tiles with a compiled micro-kernel, the autotuner picks among these per host
+    inline constexpr std::array<KernelShape, 4> GEMM_KERNELS = {{{6, 16}, {4, 16}, {8, 8}, {4, 32}}};
+
+    inline GemmConfig& gemmConfig() {
+        static GemmConfig config;
+        return config;
+    }
+
+    namespace Detail {
+        // Products smaller than this many multiply-adds skip packing entirely.
+        constexpr std::size_t GEMM_SMALL_THRESHOLD = 32 * 32 * 32;
+
+        template<typename T>
+        std::vector<T>& packBuffer(const std::size_t slot, const std::size_t size) {
+            thread_local std::vector<T> buffers[2];
+            if (buffers[slot].size() < size) {
+                buffers[slot].resize(size);
+            }
+            return buffers[slot];
+        }
+
+        /**
+         * Packs an mc x kc block of A into MR-row panels, laid out so the micro-kernel reads it sequentially.
+         * Rows past the edge of A are zero padded. A half precision A is widened on the way.
+         */
+        template<std::size_t MR, typename TA, typename T>
+        void packA(const std::size_t mc, const std::size_t kc, const TA* a, const std::size_t rsa,
+                   const std::size_t csa, T* packed) {
+            for (std::size_t ir = 0; ir < mc; ir += MR) {
+                const std::size_t rows = std::min(MR, mc - ir);
+                for (std::size_t p = 0; p < kc; p++) {
+                    for (std::size_t i = 0; i < rows; i++) {
+                        packed[i] = static_cast<T>(a[(ir + i) * rsa + p * csa]);
+                    }
+                    for (std::size_t i = rows; i < MR; i++) {
+                        packed[i] = T{};
+                    }
+                    packed += MR;
+                }
+            }
+        }
+
+        /**
+         * Packs a kc x nc block of B into NR-column panels. Columns past the edge of B are zero padded, a half
+         * precision B is widened.
+         */
+        template<std::size_t NR, typename TB, typename T>
+        void packB(const std::size_t kc, const std::size_t nc, const TB* b, const std::size_t rsb,
+                   const std::size_t csb, T* packed) {
+            for (std::size_t jr = 0; jr < nc; jr += NR) {
+                const std::size_t cols = std::min(NR, nc - jr);
+                for (std::size_t p = 0; p < kc; p++) {
+                    for (std::size_t j = 0; j < cols; j++) {
+                        packed[j] = static_cast<T>(b[p * rsb + (jr + j) * csb]);
+                    }
+                    for (std::size_t j = cols; j < NR; j++) {
+                        packed[j] = T{};
+                    }
+                    packed += NR;
+                }
+            }
+        }
+
+        /**
+         * Register tile: C[MR x NR] = beta * C + Ap * Bp over kc. Only the leading rows x cols of the tile are
+         * written back so edge tiles can reuse the full-size kernel.
+         */
+        template<std::size_t MR, std::size_t NR, typename T>
+        void microKernel(const std::size_t kc, const T* ap, const T* bp, T* c, const std::size_t ldc,
+                         const std::size_t rows, const std::size_t cols, const T beta) {
+            T acc[MR][NR] = {};
+
+            // The B row is staged in a local and both loops fully unrolled, which keeps the accumulator tile in
+            // registers at every optimisation level (-O3 otherwise vectorizes across the wrong loop)
+            for (std::size_t p = 0; p < kc; p++) {
+                T b[NR];
+                for (std::size_t j = 0; j < NR; j++) {
+                    b[j] = bp[j];
+                }
+
+#pragma GCC unroll 8
+                for (std::size_t i = 0; i < MR; i++) {
+                    const T a = ap[i];
+#pragma GCC unroll 32
+                    for (std::size_t j = 0; j < NR; j++) {
+                        acc[i][j] += a * b[j];
+                    }
+                }
+                ap += MR;
+                bp += NR;
+            }
+
+            for (std::size_t i = 0; i < rows; i++) {
+                for (std::size_t j = 0; j < cols; j++) {
+                    if (beta == T{}) {
+                        c[i * ldc + j] = acc[i][j];
+                    } else {
+                        c[i * ldc + j] = beta * c[i * ldc + j] + acc[i][j];
+                    }
+                }
+            }
+        }
+
+        /**
+         * Dot product of two unit stride sequences, split over independent partial sums so the loop vectorizes
+         * without reassociating a single accumulator.
+         */
+        template<typename T, typename X, typename Y>
+        T dot(const std::size_t k, const X* x, const Y* y) {
+            constexpr std::size_t LANES = 8;
+
+            T partial[LANES] = {};
+            std::size_t p = 0;
+
+            for (; p + LANES <= k; p += LANES) {
+                for (std::size_t l = 0; l < LANES; l++) {
+                    partial[l] += static_cast<T>(x[p + l]) * static_cast<T>(y[p + l]);
+                }
+            }
+
+            T sum = T{};
+            for (; p < k; p++) {
+                sum += static_cast<T>(x[p]) * static_cast<T>(y[p]);
+            }
+            for (std::size_t l = 0; l < LANES; l++) {
+                sum += partial[l];
+            }
+
+            return sum;
+        }
+
+        /**
+         * Unpacked kernel for products too small to amortise packing. Picks the loop order that keeps the innermost
+         * loop on unit stride memory: row updates when rows of B are contiguous, dot products when the rows of A and
+         * the columns of B are.
+         */
+        template<typename TA, typename TB, typename T>
+        void gemmSmall(const std::size_t m, const std::size_t n, const std::size_t k, const TA* a,
+                       const std::size_t rsa, const std::size_t csa, const TB* b, const std::size_t rsb,
+                       const std::size_t csb, const T beta, T* c, const std::size_t ldc) {
+
+            // Transposed matrix-vector product, the columns of A are contiguous so accumulate them scaled by b,
+            // four at a time to cut the loads and stores of c
+            if (n == 1 && rsa == 1 && ldc == 1) {
+                T* __restrict res = c;
+                for (std::size_t i = 0; i < m; i++) {
+                    res[i] = beta == T{} ? T{} : beta * res[i];
+                }
+
+                std::size_t p = 0;
+                for (; p + 4 <= k; p += 4) {
+                    const T s0 = static_cast<T>(b[p * rsb]);
+                    const T s1 = static_cast<T>(b[(p + 1) * rsb]);
+                    const T s2 = static_cast<T>(b[(p + 2) * rsb]);
+                    const T s3 = static_cast<T>(b[(p + 3) * rsb]);
+                    const TA* __restrict c0 = a + p * csa;
+                    const TA* __restrict c1 = c0 + csa;
+                    const TA* __restrict c2 = c1 + csa;
+                    const TA* __restrict c3 = c2 + csa;
+                    for (std::size_t i = 0; i < m; i++) {
+                        res[i] += s0 * static_cast<T>(c0[i]) + s1 * static_cast<T>(c1[i])
+                                  + s2 * static_cast<T>(c2[i]) + s3 * static_cast<T>(c3[i]);
+                    }
+                }
+                for (; p < k; p++) {
+                    const T scale = static_cast<T>(b[p * rsb]);
+                    const TA* __restrict column = a + p * csa;
+                    for (std::size_t i = 0; i < m; i++) {
+                        res[i] += scale * static_cast<T>(column[i]);
+                    }
+                }
+                return;
+            }
+
+            // A strided vector is gathered once so the dot products below stay on unit stride memory
+            if (n == 1 && rsb != 1 && csa == 1) {
+                T* gathered = packBuffer<T>(1, k).data();
+                for (std::size_t p = 0; p < k; p++) {
+                    gathered[p] = static_cast<T>(b[p * rsb]);
+                }
+                for (std::size_t i = 0; i < m; i++) {
+                    const T sum = dot<T>(k, a + i * rsa, gathered);
+                    c[i * ldc] = beta == T{} ? sum : beta * c[i * ldc] + sum;
+                }
+                return;
+            }
+
+            if ((n == 1 || csb != 1) && rsb == 1 && csa == 1) {
+                for (std::size_t i = 0; i < m; i++) {
+                    T* row = c + i * ldc;
+                    for (std::size_t j = 0; j < n; j++) {
+                        const T sum = dot<T>(k, a + i * rsa, b + j * csb);
+                        row[j] = beta == T{} ? sum : beta * row[j] + sum;
+                    }
+                }
+                return;
+            }
+
+            for (std::size_t i = 0; i < m; i++) {
+                T* row = c + i * ldc;
+                for (std::size_t j = 0; j < n; j++) {
+                    row[j] = beta == T{} ? T{} : beta * row[j];
+                }
+                for (std::size_t p = 0; p < k; p++) {
+                    const T scale = static_cast<T>(a[i * rsa + p * csa]);
+                    const TB* source = b + p * rsb;
+                    if (csb == 1) {
+                        for (std::size_t j = 0; j < n; j++) {
+                            row[j] += scale * static_cast<T>(source[j]);
+                        }
+                    } else {
+                        for (std::size_t j = 0; j < n; j++) {
+                            row[j] += scale * static_cast<T>(source[j * csb]);
+                        }
+                    }
+                }
+            }
+        }
+
+        template<std::size_t MR, std::size_t NR, typename TA, typename TB, typename T>
+        void gemmBlocked(const GemmConfig& config, const std::size_t m, const std::size_t n, const std::size_t k,
+                         const TA* a, const std::size_t rsa, const std::size_t csa, const TB* b, const std::size_t rsb,
+                         const std::size_t csb, const T beta, T* c, const std::size_t ldc) {
+
+            const std::size_t mc = std::max<std::size_t>(MR, config.mc / MR * MR);
+            const std::size_t kc = std::max<std::size_t>(1, config.kc);
+            const std::size_t nc = std::max<std::size_t>(NR, config.nc / NR * NR);
+
+            T* packedA = packBuffer<T>(0, mc * kc).data();
+            T* packedB = packBuffer<T>(1, kc * nc).data();
+
+            for (std::size_t jc = 0; jc < n; jc += nc) {
+                const std::size_t ncCur = std::min(nc, n - jc);
+
+                for (std::size_t pc = 0; pc < k; pc += kc) {
+                    const std::size_t kcCur = std::min(kc, k - pc);
+                    const T betaCur = pc == 0 ? beta : T{1};
+
+                    packB<NR>(kcCur, ncCur, b + pc * rsb + jc * csb, rsb, csb, packedB);
+
+                    for (std::size_t ic = 0; ic < m; ic += mc) {
+                        const std::size_t mcCur = std::min(mc, m - ic);
+
+                        packA<MR>(mcCur, kcCur, a + ic * rsa + pc * csa, rsa, csa, packedA);
+
+                        for (std::size_t jr = 0; jr < ncCur; jr += NR) {
+                            for (std::size_t ir = 0; ir < mcCur; ir += MR) {
+                                microKernel<MR, NR>(kcCur, packedA + ir * kcCur, packedB + jr * kcCur,
+                                                    c + (ic + ir) * ldc + jc + jr, ldc,
+                                                    std::min(MR, mcCur - ir), std::min(NR, ncCur - jr), betaCur);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+#if defined(__AVX512BF16__)
+        // Register tile of the bf16 kernel: MR rows by two 16 lane vectors
+        constexpr std::size_t BF16_MR = 8;
+        constexpr std::size_t BF16_NR = 32;
+
+        // Two values as the bf16 pair (lo, hi) in one 32 bit word, branch free so packing loops vectorize
+        template<typename T>
+        std::uint32_t pair(const T lo, const T hi) {
+            const auto bits = [](const T value) -> std::uint32_t {
+                if constexpr (std::is_same_v<T, BFloat16>) {
+                    return value.bits;
+                } else {
+                    return BFloat16::round(static_cast<float>(value));
+                }
+            };
+            return bits(hi) << 16 | bits(lo);
+        }
+
+        /**
+         * Packs an mc x kc block of A into MR-row panels of bf16 pairs: for every two steps p, p + 1 of k, row i
+         * holds A(i, p) next to A(i, p + 1), the operand layout of vdpbf16ps. Rows and steps past the edges are
+         * zero padded.
+         */
+        template<typename TA>
+        void packPairsA(const std::size_t mc, const std::size_t kc, const TA* a, const std::size_t rsa,
+                        const std::size_t csa, std::uint32_t* packed) {
+            for (std::size_t ir = 0; ir < mc; ir += BF16_MR) {
+                const std::size_t rows = std::min(BF16_MR, mc - ir);
+                for (std::size_t p = 0; p < kc; p += 2) {
+                    const bool odd = p + 1 == kc;
+                    for (std::size_t i = 0; i < rows; i++) {
+                        const TA* row = a + (ir + i) * rsa + p * csa;
+                        packed[i] = pair(row[0], odd ? TA{} : row[csa]);
+                    }
+                    std::fill(packed + rows, packed + BF16_MR, 0u);
+                    packed += BF16_MR;
+                }
+            }
+        }
+
+        // The same for a kc x nc block of B in NR-column panels, column j holding B(p, j) next to B(p + 1, j)
+        template<typename TB>
+        void packPairsB(const std::size_t kc, const std::size_t nc, const TB* b, const std::size_t rsb,
+                        const std::size_t csb, std::uint32_t* packed) {
+            for (std::size_t jr = 0; jr < nc; jr += BF16_NR) {
+                const std::size_t cols = std::min(BF16_NR, nc - jr);
+                for (std::size_t p = 0; p < kc; p += 2) {
+                    const TB* lo = b + p * rsb + jr * csb;
+                    const TB* hi = lo + rsb;
+                    if (p + 1 == kc) {
+                        for (std::size_t j = 0; j < cols; j++) {
+                            packed[j] = pair(lo[j * csb], TB{});
+                        }
+                    } else if (csb == 1) {
+                        for (std::size_t j = 0; j < cols; j++) {
+                            packed[j] = pair(lo[j], hi[j]);
+                        }
+                    } else {
+                        for (std::size_t j = 0; j < cols; j++) {
+                            packed[j] = pair(lo[j * csb], hi[j * csb]);
+                        }
+                    }
+                    std::fill(packed + cols, packed + BF16_NR, 0u);
+                    packed += BF16_NR;
+                }
+            }
+        }
+
+        /**
+         * Register tile of bf16 products accumulated in float: C[MR x NR] = beta * C + Ap * Bp over kp pairs of k.
+         * Every vdpbf16ps does two multiply-adds per lane, twice the rate of the float kernel at half the bytes.
+         */
+        inline void microKernelBf16(const std::size_t kp, const std::uint32_t* ap, const std::uint32_t* bp, float* c,
+                                    const std::size_t ldc, const std::size_t rows, const std::size_t cols,
+                                    const float beta) {
+            __m512 acc[BF16_MR][2];
+            for (auto& row: acc) {
+                row[0] = _mm512_setzero_ps();
+                row[1] = _mm512_setzero_ps();
+            }
+
+            for (std::size_t p = 0; p < kp; p++) {
+                const auto b0 = (__m512bh) _mm512_loadu_si512(bp);
+                const auto b1 = (__m512bh) _mm512_loadu_si512(bp + 16);
+
+#pragma GCC unroll 8
+                for (std::size_t i = 0; i < BF16_MR; i++) {
+                    const auto a = (__m512bh) _mm512_set1_epi32(static_cast<int>(ap[i]));
+                    acc[i][0] = _mm512_dpbf16_ps(acc[i][0], a, b0);
+                    acc[i][1] = _mm512_dpbf16_ps(acc[i][1], a, b1);
+                }
+                ap += BF16_MR;
+                bp += BF16_NR;
+            }
+
+            const __m512 scale = _mm512_set1_ps(beta);
+
+            if (rows == BF16_MR && cols == BF16_NR) {
+                for (std::size_t i = 0; i < BF16_MR; i++) {
+                    for (std::size_t h = 0; h < 2; h++) {
+                        float* out = c + i * ldc + 16 * h;
+                        _mm512_storeu_ps(out, beta == 0.0f ? acc[i][h]
+                                                           : _mm512_fmadd_ps(scale, _mm512_loadu_ps(out), acc[i][h]));
+                    }
+                }
+                return;
+            }
+
+            alignas(64) float tile[BF16_MR][BF16_NR];
+            for (std::size_t i = 0; i < BF16_MR; i++) {
+                _mm512_store_ps(tile[i], acc[i][0]);
+                _mm512_store_ps(tile[i] + 16, acc[i][1]);
+            }
+            for (std::size_t i = 0; i < rows; i++) {
+                for (std::size_t j = 0; j < cols; j++) {
+                    float& out = c[i * ldc + j];
+                    out = beta == 0.0f ? tile[i][j] : beta * out + tile[i][j];
+                }
+            }
+        }
+
+        // Blocked GEMM on the bf16 kernel, rounding float operands to bf16 while packing
+        template<typename TA, typename TB>
+        void gemmBf16(const std::size_t m, const std::size_t n, const std::size_t k, const TA* a,
+                      const std::size_t rsa, const std::size_t csa, const TB* b, const std::size_t rsb,
+                      const std::size_t csb, const float beta, float* c, const std::size_t ldc) {
+            const GemmConfig& config = gemmConfig();
+
+            const std::size_t mc = std::max(BF16_MR, config.mc / BF16_MR * BF16_MR);
+            const std::size_t kc = std::max<std::size_t>(2, config.kc / 2 * 2);
+            const std::size_t nc = std::max(BF16_NR, config.nc / BF16_NR * BF16_NR);
+
+            // Pairs of bf16 as 32 bit words, half as many as the float kernel packs
+            std::uint32_t* packedA = packBuffer<std::uint32_t>(0, mc * kc / 2).data();
+            std::uint32_t* packedB = packBuffer<std::uint32_t>(1, kc * nc / 2).data();
+
+            for (std::size_t jc = 0; jc < n; jc += nc) {
+                const std::size_t ncCur = std::min(nc, n - jc);
+
+                for (std::size_t pc = 0; pc < k; pc += kc) {
+                    const std::size_t kcCur = std::min(kc, k - pc);
+                    const std::size_t kp = (kcCur + 1) / 2;
+                    const float betaCur = pc == 0 ? beta : 1.0f;
+
+                    packPairsB(kcCur, ncCur, b + pc * rsb + jc * csb, rsb, csb, packedB);
+
+                    for (std::size_t ic = 0; ic < m; ic += mc) {
+                        const std::size_t mcCur = std::min(mc, m - ic);
+
+                        packPairsA(mcCur, kcCur, a + ic * rsa + pc * csa, rsa, csa, packedA);
+
+                        for (std::size_t jr = 0; jr < ncCur; jr += BF16_NR) {
+                            for (std::size_t ir = 0; ir < mcCur; ir += BF16_MR) {
+                                microKernelBf16(kp, packedA + ir * kp, packedB + jr * kp,
+                                                c + (ic + ir) * ldc + jc + jr, ldc, std::min(BF16_MR, mcCur - ir),
+                                                std::min(BF16_NR, ncCur - jr), betaCur);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+#endif
+
+        /**
+         * Runs fn.template operator()<MR, NR>() with the register tile of the given kernel index, see GEMM_KERNELS.
+         */
+        template<typename Fn>
+        void withKernel(const std::size_t kernel, Fn&& fn) {
+            switch (kernel) {
+                case 1:
+                    fn.template operator()<GEMM_KERNELS[1].mr, GEMM_KERNELS[1].nr>();
+                    break;
+                case 2:
+                    fn.template operator()<GEMM_KERNELS[2].mr, GEMM_KERNELS[2].nr>();
+                    break;
+                case 3:
+                    fn.template operator()<GEMM_KERNELS[3].mr, GEMM_KERNELS[3].nr>();
+                    break;
+                default:
+                    fn.template operator()<GEMM_KERNELS[0].mr, GEMM_KERNELS[0].nr>();
+                    break;
+            }
+        }
+
+        /**
+         * Generic strided GEMM: C = beta * C + A * B, where A(i, p) = a[i * rsa + p * csa] and
+         * B(p, j) = b[p * rsb + j * csb]. C is row major with leading dimension ldc.
+         */
+        template<typename TA, typename TB, typename T>
+        void gemmStrided(const std::size_t m, const std::size_t n, const std::size_t k, const TA* a,
+                         const std::size_t rsa, const std::size_t csa, const TB* b, const std::size_t rsb,
+                         const std::size_t csb, const T beta, T* c, const std::size_t ldc) {
+
+            if (m == 0 || n == 0) {
+                return;
+            }
+
+            // Matrix-vector products are memory bound, packing A would only add a copy of it
+            if (k == 0 || n == 1 || m * n * k <= GEMM_SMALL_THRESHOLD) {
+                gemmSmall(m, n, k, a, rsa, csa, b, rsb, csb, beta, c, ldc);
+                return;
+            }
+
+            const GemmConfig& config = gemmConfig();
+
+            switch (config.kernel) {
+                case 1:
+                    gemmBlocked<GEMM_KERNELS[1].mr, GEMM_KERNELS[1].nr>(config, m, n, k, a, rsa, csa, b, rsb, csb,
+                                                                        beta, c, ldc);
+                    break;
+                case 2:
+                    gemmBlocked<GEMM_KERNELS[2].mr, GEMM_KERNELS[2].nr>(config, m, n, k, a, rsa, csa, b, rsb, csb,
+                                                                        beta, c, ldc);
+                    break;
+                case 3:
+                    gemmBlocked<GEMM_KERNELS[3].mr, GEMM_KERNELS[3].nr>(config, m, n, k, a, rsa, csa, b, rsb, csb,
+                                                                        beta, c, ldc);
+                    break;
+                default:
+                    gemmBlocked<GEMM_KERNELS[0].mr, GEMM_KERNELS[0].nr>(config, m, n, k, a, rsa, csa, b, rsb, csb,
+                                                                        beta, c, ldc);
+                    break;
+            }
+        }
+    }
+
+    /**
+     * A left operand packed once ahead of many products with it, e.g. the weights of a frozen model. Products of the
+     * width n it was packed for that take the blocked path read its MR-row panels directly instead of repacking it
+     * every call. Products that would skip packing anyway keep it row major.
+     *
+     * The blocking and the kernel are those configured when it was packed, so later retuning does not invalidate it.
+     */
+    template<typename T>
+    struct PackedMatrix {
+        std::size_t m = 0;
+        std::size_t k = 0;
+        bool packed = false;
+
+        // Blocking of the panels: kc x mc blocks, kc major, each mc rows rounded up to whole MR panels
+        std::size_t kernel = 0;
+        std::size_t mc = 0;
+        std::size_t kc = 0;
+
+        std::vector<T> data;
+    };
+
+    /**
+     * Packs op(A), m x k, for products with k x n right operands, see PackedMatrix.
+     */
+    template<typename T>
+    requires std::is_arithmetic_v<T>
+    PackedMatrix<T> pack(const bool transA, const std::size_t m, const std::size_t k, const T* a,
+                         const std::size_t lda, const std::size_t n) {
+        const std::size_t rsa = transA ? 1 : lda;
+        const std::size_t csa = transA ? lda : 1;
+
+        PackedMatrix<T> res;
+        res.m = m;
+        res.k = k;
+        res.packed = k > 0 && n > 1 && m * n * k > Detail::GEMM_SMALL_THRESHOLD;
+
+        if (!res.packed) {
+            res.data.resize(m * k);
+            for (std::size_t i = 0; i < m; i++) {
+                for (std::size_t p = 0; p < k; p++) {
+                    res.data[i * k + p] = a[i * rsa + p * csa];
+                }
+            }
+            return res;
+        }
+
+        const GemmConfig& config = gemmConfig();
+        res.kernel = config.kernel;
+
+        Detail::withKernel(res.kernel, [&]<std::size_t MR, std::size_t NR>() {
+            res.mc = std::max<std::size_t>(MR, config.mc / MR * MR);
+            res.kc = std::max<std::size_t>(1, config.kc);
+
+            const std::size_t rows = (m + MR - 1) / MR * MR;
+            res.data.resize(rows * k);
+
+            for (std::size_t pc = 0; pc < k; pc += res.kc) {
+                const std::size_t kcCur = std::min(res.kc, k - pc);
+                for (std::size_t ic = 0; ic < m; ic += res.mc) {
+                    Detail::packA<MR>(std::min(res.mc, m - ic), kcCur, a + ic * rsa + pc * csa, rsa, csa,
+                                      res.data.data() + pc * rows + ic * kcCur);
+                }
+            }
+        });
+
+        return res;
+    }
+
+    /**
+     * C = beta * C + A * B with A packed by pack(), B k x n row major. Only B is packed per call.
+     */
+    template<typename T>
+    requires std::is_arithmetic_v<T>
+    void gemm(const PackedMatrix<T>& a, const std::size_t n, const T* b, const std::size_t ldb, const T beta, T* c,
+              const std::size_t ldc) {
+        const std::size_t m = a.m;
+        const std::size_t k = a.k;
+
+        if (!a.packed) {
+            Detail::gemmStrided(m, n, k, a.data.data(), k, std::size_t{1}, b, ldb, std::size_t{1}, beta, c, ldc);
+            return;
+        }
+
+        Detail::withKernel(a.kernel, [&]<std::size_t MR, std::size_t NR>() {
+            const std::size_t nc = std::max<std::size_t>(NR, gemmConfig().nc / NR * NR);
+            const std::size_t rows = (m + MR - 1) / MR * MR;
+
+            T* packedB = Detail::packBuffer<T>(1, a.kc * nc).data();
+
+            for (std::size_t jc = 0; jc < n; jc += nc) {
+                const std::size_t ncCur = std::min(nc, n - jc);
+
+                for (std::size_t pc = 0; pc < k; pc += a.kc) {
+                    const std::size_t kcCur = std::min(a.kc, k - pc);
+                    const T betaCur = pc == 0 ? beta : T{1};
+
+                    Detail::packB<NR>(kcCur, ncCur, b + pc * ldb + jc, ldb, 1, packedB);
+
+                    for (std::size_t ic = 0; ic < m; ic += a.mc) {
+                        const std::size_t mcCur = std::min(a.mc, m - ic);
+                        const T* packedA = a.data.data() + pc * rows + ic * kcCur;
+
+                        for (std::size_t jr = 0; jr < ncCur; jr += NR) {
+                            for (std::size_t ir = 0; ir < mcCur; ir += MR) {
+                                Detail::microKernel<MR, NR>(kcCur, packedA + ir * kcCur, packedB + jr * kcCur,
+                                                            c + (ic + ir) * ldc + jc + jr, ldc,
+                                                            std::min(MR, mcCur - ir), std::min(NR, ncCur - jr),
+                                                            betaCur);
+                            }
+                        }
+                    }
+                }
+            }
+        });
+    }
+
+    /**
+     * Blocked matrix multiplication on row major storage, C = beta * C + op(A) * op(B), where op transposes its
+     * operand when the matching flag is set. op(A) is m x k and op(B) is k x n.
+     */
+    template<typename T>
+    requires std::is_arithmetic_v<T>
+    void gemm(const bool transA, const bool transB, const std::size_t m, const std::size_t n, const std::size_t k,
+              const T* a, const std::size_t lda, const T* b, const std::size_t ldb, const T beta, T* c,
+              const std::size_t ldc) {
+        Detail::gemmStrided(m, n, k,
+                            a, transA ? 1 : lda, transA ? lda : 1,
+                            b, transB ? 1 : ldb, transB ? ldb : 1,
+                            beta, c, ldc);
+    }
+
+    /**
+     * Mixed precision GEMM, C = beta * C + op(A) * op(B) in float with either operand in half precision, e.g.
+     * weights and activations stored as bf16. On hosts with AVX512-BF16, bf16 and float operands of large products
+     * are rounded to bf16 and multiplied by the bf16 kernel; otherwise the operands are widened while packing and
+     * run through the float kernel, which still halves the memory traffic of the stored operand.
+     */
+    template<typename TA, typename TB>
+    requires (IS_HALF_PRECISION<TA> || IS_HALF_PRECISION<TB>)
+             && (IS_HALF_PRECISION<TA> || std::is_same_v<TA, float>)
+             && (IS_HALF_PRECISION<TB> || std::is_same_v<TB, float>)
+    void gemm(const bool transA, const bool transB, const std::size_t m, const std::size_t n, const std::size_t k,
+              const TA* a, const std::size_t lda, const TB* b, const std::size_t ldb, const float beta, float* c,
+              const std::size_t ldc) {
+        const std::size_t rsa = transA ? 1 : lda;
+        const std::size_t csa = transA ? lda : 1;
+        const std::size_t rsb = transB ? 1 : ldb;
+        const std::size_t csb = transB ? ldb : 1;
+
+#if defined(__AVX512BF16__)
+        if constexpr (!std::is_same_v<TA, Half> && !std::is_same_v<TB, Half>) {
+            if (m > 0 && n > 1 && k > 0 && m * n * k > Detail::GEMM_SMALL_THRESHOLD) {
+                Detail::gemmBf16(m, n, k, a, rsa, csa, b, rsb, csb, beta, c, ldc);
+                return;
+            }
+        }
+#endif
+
+        Detail::gemmStrided(m, n, k, a, rsa, csa, b, rsb, csb, beta, c, ldc);
+    }
+}
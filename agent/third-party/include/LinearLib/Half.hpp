@@ -0,0 +1,108 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <type_traits>
+
+namespace LinearLib {
+
+    /**
+     * 16 bit brain float: the sign, the 8 exponent bits and the top 7 mantissa bits of a float. It keeps the range
+     * of float at about 3 significant digits, so values convert without overflow or underflow and mixed precision
+     * training with it needs no loss scaling. Conversion from float rounds to nearest even.
+     *
+     * A storage type only: it converts implicitly to and from float, and arithmetic happens in float.
+     */
+    struct BFloat16 {
+        std::uint16_t bits = 0;
+
+        BFloat16() = default;
+
+        BFloat16(const float value) : bits(round(value)) {}
+
+        operator float() const {
+            return std::bit_cast<float>(static_cast<std::uint32_t>(bits) << 16);
+        }
+
+        static std::uint16_t round(const float value) {
+            const auto u = std::bit_cast<std::uint32_t>(value);
+
+            // NaN stays a quiet NaN rather than rounding into infinity
+            if ((u & 0x7FFFFFFFu) > 0x7F800000u) {
+                return static_cast<std::uint16_t>((u >> 16) | 0x40u);
+            }
+
+            return static_cast<std::uint16_t>((u + 0x7FFFu + ((u >> 16) & 1u)) >> 16);
+        }
+    };
+
+    /**
+     * IEEE 754 half precision: 5 exponent and 10 mantissa bits. More precise than BFloat16 but with a range of only
+     * about 6e-8 to 65504, so gradients stored in it need loss scaling to stay clear of underflow. Conversion from
+     * float rounds to nearest even, overflowing to infinity.
+     *
+     * A storage type only: it converts implicitly to and from float, and arithmetic happens in float.
+     */
+    struct Half {
+        std::uint16_t bits = 0;
+
+        Half() = default;
+
+        Half(const float value) : bits(round(value)) {}
+
+        operator float() const {
+            const std::uint32_t sign = static_cast<std::uint32_t>(bits & 0x8000u) << 16;
+            const std::uint32_t exponent = (bits >> 10) & 0x1Fu;
+            const std::uint32_t mantissa = bits & 0x3FFu;
+
+            if (exponent == 0x1Fu) {
+                return std::bit_cast<float>(sign | 0x7F800000u | (mantissa << 13));
+            }
+            if (exponent == 0) {
+                // Zero or subnormal, mantissa * 2^-24
+                const float magnitude = static_cast<float>(mantissa) * 5.9604644775390625e-8f;
+                return sign != 0 ? -magnitude : magnitude;
+            }
+            return std::bit_cast<float>(sign | ((exponent + 112) << 23) | (mantissa << 13));
+        }
+
+        static std::uint16_t round(const float value) {
+            const auto u = std::bit_cast<std::uint32_t>(value);
+            const auto sign = static_cast<std::uint16_t>((u >> 16) & 0x8000u);
+            const std::uint32_t magnitude = u & 0x7FFFFFFFu;
+
+            if (magnitude >= 0x7F800000u) {
+                return sign | (magnitude > 0x7F800000u ? 0x7E00u : 0x7C00u);
+            }
+
+            // Beyond the largest half after rounding
+            if (magnitude >= 0x477FF000u) {
+                return sign | 0x7C00u;
+            }
+
+            // Subnormal or zero: shift the mantissa with its implicit bit into place, rounding to nearest even
+            if (magnitude < 0x38800000u) {
+                const std::uint32_t exponent = magnitude >> 23;
+                if (exponent < 102) {
+                    return sign;
+                }
+                const std::uint32_t mantissa = (magnitude & 0x7FFFFFu) | 0x800000u;
+                const std::uint32_t shift = 126 - exponent;
+                const std::uint32_t half = 1u << (shift - 1);
+                const std::uint32_t rest = mantissa & ((1u << shift) - 1);
+                std::uint32_t res = mantissa >> shift;
+                if (rest > half || (rest == half && (res & 1u))) {
+                    res++;
+                }
+                return sign | static_cast<std::uint16_t>(res);
+            }
+
+            // Normal: rebias the exponent and round the mantissa to 10 bits, a carry correctly bumps the exponent
+            const std::uint32_t rebiased = magnitude - 0x38000000u;
+            return sign | static_cast<std::uint16_t>((rebiased + 0xFFFu + ((rebiased >> 13) & 1u)) >> 13);
+        }
+    };
+
+    template<typename T>
+    inline constexpr bool IS_HALF_PRECISION = std::is_same_v<T, BFloat16> || std::is_same_v<T, Half>;
+}
@@ -8,6 +8,7 @@
 #include <type_traits>
 #include <ranges>
 
+#include "Strassen.hpp"
 #include "Vector.hpp"
 
 namespace LinearLib {
@@ -28,6 +29,17 @@ namespace LinearLib {
         // Default constructor is still needed
         Matrix() = default;
 
+        // Contiguous row major view of the elements for the raw kernels
+        T* raw() noexcept {
+            static_assert(sizeof(data) == R * C * sizeof(T), "Matrix storage must be contiguous");
+            return data[0].data.data();
+        }
+
+        const T* raw() const noexcept {
+            static_assert(sizeof(data) == R * C * sizeof(T), "Matrix storage must be contiguous");
+            return data[0].data.data();
+        }
+
         // Iterator methods
         typename std::array<Vector<C, T>, R>::iterator begin() noexcept { return data.begin(); }
         typename std::array<Vector<C, T>, R>::const_iterator begin() const noexcept { return data.begin(); }
@@ -79,14 +91,16 @@ namespace LinearLib {
 
         static Matrix uniform(T const val) {
             Matrix res;
+            res.fill(val);
+            return res;
+        }
 
+        void fill(T const val) {
             for (std::size_t i = 0; i < R; i++) {
                 for (std::size_t j = 0; j < C; j++) {
-                    res.data[i][j] = val;
+                    data[i][j] = val;
                 }
             }
-
-            return res;
         }
 
         static Matrix random(T const min, T const max, std::size_t const seed) {
@@ -150,14 +164,16 @@ namespace LinearLib {
 
         Matrix<C, R, T> transpose() const {
             Matrix<C, R, T> res;
+            transpose(res);
+            return res;
+        }
 
+        void transpose(Matrix<C, R, T>& res) const {
             for (std::size_t i = 0; i < C; i++) {
                 for (std::size_t j = 0; j < R; j++) {
                     res.data[i][j] = data[j][i];
                 }
             }
-
-            return res;
         }
 
         Matrix reshape(std::size_t const rows, std::size_t const cols) const {
@@ -284,12 +300,16 @@ namespace LinearLib {
 
         static Matrix add(const Matrix& lhs, const Matrix& rhs) {
             Matrix res;
+            add(lhs, rhs, res);
+            return res;
+        }
 
+        static void add(const Matrix& lhs, const Matrix& rhs, Matrix& res) {
             for (std::size_t i = 0; i < R; i++) {
-                res[i] = lhs[i] + rhs[i];
+                for (std::size_t j = 0; j < C; j++) {
+                    res.data[i][j] = lhs.data[i][j] + rhs.data[i][j];
+                }
             }
-
-            return res;
         }
 
         friend Matrix operator+(const Matrix& lhs, const Matrix& rhs) {
@@ -303,12 +323,16 @@ namespace LinearLib {
 
         static Matrix subtract(const Matrix& minuend, const Matrix& subtrahend) {
             Matrix res;
+            subtract(minuend, subtrahend, res);
+            return res;
+        }
 
+        static void subtract(const Matrix& minuend, const Matrix& subtrahend, Matrix& res) {
             for (std::size_t i = 0; i < R; i++) {
-                res[i] = minuend[i] - subtrahend[i];
+                for (std::size_t j = 0; j < C; j++) {
+                    res.data[i][j] = minuend.data[i][j] - subtrahend.data[i][j];
+                }
             }
-
-            return res;
         }
 
         friend Matrix operator-(const Matrix& minuend, const Matrix& subtrahend) {
@@ -323,12 +347,16 @@ namespace LinearLib {
 
         static Matrix multiply(const Matrix& multiplicand, const Matrix& multiplier) {
             Matrix res;
+            multiply(multiplicand, multiplier, res);
+            return res;
+        }
 
+        static void multiply(const Matrix& multiplicand, const Matrix& multiplier, Matrix& res) {
             for (std::size_t i = 0; i < R; i++) {
-                res[i] = multiplicand[i] * multiplier[i];
+                for (std::size_t j = 0; j < C; j++) {
+                    res.data[i][j] = multiplicand.data[i][j] * multiplier.data[i][j];
+                }
             }
-
-            return res;
         }
 
         friend Matrix operator*(const Matrix& multiplicand, const Matrix& multiplier) {
@@ -380,12 +408,16 @@ namespace LinearLib {
 
         static Matrix multiply(const Matrix& mat, const T& scalar) {
             Matrix res;
+            multiply(mat, scalar, res);
+            return res;
+        }
 
+        static void multiply(const Matrix& mat, const T& scalar, Matrix& res) {
             for (std::size_t i = 0; i < R; i++) {
-                res[i] = mat[i] * scalar;
+                for (std::size_t j = 0; j < C; j++) {
+                    res.data[i][j] = mat.data[i][j] * scalar;
+                }
             }
-
-            return res;
         }
 
         friend Matrix operator*(const Matrix& mat, const T& scalar) {
@@ -405,17 +437,34 @@ namespace LinearLib {
 
             Matrix<R, I, T> res;
 
-            for (std::size_t i = 0; i < R; i++) {
-                for (std::size_t j = 0; j < I; j++) {
-                    T sum = T{};
-                    for (std::size_t k = 0; k < C; k++) {
-                        sum += lhs[i][k] * rhs[k][j];
-                    }
-                    res[i][j] = sum;
-                }
-            }
+            strassenGemm(false, false, R, I, C, lhs.raw(), C, rhs.raw(), I, T{}, res.raw(), I);
 
             return res;
         }
     };
+
+    /**
+     * In-place matrix multiplication, res = beta * res + lhs * rhs, for results that live outside the stack
+     * (e.g. in an Arena) and should not round trip through a temporary.
+     */
+    template<std::size_t R, std::size_t K, std::size_t C, typename T>
+    void matmul(const Matrix<R, K, T>& lhs, const Matrix<K, C, T>& rhs, Matrix<R, C, T>& res, T const beta = T{}) {
+        gemm(false, false, R, C, K, lhs.raw(), K, rhs.raw(), C, beta, res.raw(), C);
+    }
+
+    /**
+     * res = beta * res + lhs^T * rhs without materialising the transpose
+     */
+    template<std::size_t R, std::size_t K, std::size_t C, typename T>
+    void matmulTN(const Matrix<K, R, T>& lhs, const Matrix<K, C, T>& rhs, Matrix<R, C, T>& res, T const beta = T{}) {
+        gemm(true, false, R, C, K, lhs.raw(), R, rhs.raw(), C, beta, res.raw(), C);
+    }
+
+    /**
+     * res = beta * res + lhs * rhs^T without materialising the transpose
+     */
+    template<std::size_t R, std::size_t K, std::size_t C, typename T>
+    void matmulNT(const Matrix<R, K, T>& lhs, const Matrix<C, K, T>& rhs, Matrix<R, C, T>& res, T const beta = T{}) {
+        gemm(false, true, R, C, K, lhs.raw(), K, rhs.raw(), K, beta, res.raw(), C);
+    }
 }
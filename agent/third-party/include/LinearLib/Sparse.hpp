@@ -0,0 +1,184 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "Gemm.hpp"
+
+namespace LinearLib {
+    /**
+     * Runtime sized sparse matrix in compressed sparse row form: the column indices and values of row i are the
+     * entries offsets[i] .. offsets[i + 1] of columns and values. The sparsity pattern is taken from a mask once and
+     * kept, while gather() refreshes the values from the dense matrix, e.g. after every update of a pruned weight.
+     *
+     * The kernels multiply it with dense row major blocks of n columns, so their innermost loops run over contiguous
+     * columns of a row and cost proportional to the stored entries rather than to rows * cols.
+     */
+    template<typename T>
+    requires std::is_arithmetic_v<T>
+    struct SparseMatrix {
+        std::size_t rows = 0;
+        std::size_t cols = 0;
+
+        std::vector<std::size_t> offsets;
+        std::vector<std::uint32_t> columns;
+        std::vector<T> values;
+
+        SparseMatrix() = default;
+
+        // Compresses the entries of the dense rows x cols matrix with leading dimension ld whose mask is set
+        template<typename M>
+        SparseMatrix(const std::size_t rows, const std::size_t cols, const T* dense, const std::size_t ld,
+                     const M* mask) : rows(rows), cols(cols), offsets(rows + 1, 0) {
+            for (std::size_t i = 0; i < rows; i++) {
+                for (std::size_t j = 0; j < cols; j++) {
+                    if (mask[i * ld + j] != M{}) {
+                        columns.push_back(static_cast<std::uint32_t>(j));
+                        values.push_back(dense[i * ld + j]);
+                    }
+                }
+                offsets[i + 1] = columns.size();
+            }
+        }
+
+        [[nodiscard]] bool empty() const {
+            return offsets.empty();
+        }
+
+        [[nodiscard]] std::size_t nonZeros() const {
+            return values.size();
+        }
+
+        // Share of the entries that are not stored
+        [[nodiscard]] double sparsity() const {
+            return rows * cols == 0 ? 0.0 : 1.0 - static_cast<double>(nonZeros()) / static_cast<double>(rows * cols);
+        }
+
+        // Reloads the stored entries from the dense matrix they were compressed from, keeping the pattern
+        void gather(const T* dense, const std::size_t ld) {
+            for (std::size_t i = 0; i < rows; i++) {
+                for (std::size_t e = offsets[i]; e < offsets[i + 1]; e++) {
+                    values[e] = dense[i * ld + columns[e]];
+                }
+            }
+        }
+    };
+
+    /**
+     * C = beta * C + op(A) * B for sparse A, where B has n columns and rows matching op(A). B is worked through in
+     * panels of up to PANEL columns. Without transposition each panel of B is packed contiguously, so the rows the
+     * entries gather stay in cache whatever the stride of B; with transposition each row of B is scattered into the
+     * rows of a contiguous panel of C. Either way the innermost loop is a unit stride multiply-add over the panel,
+     * and the panel of C is merged into C once complete. B may be stored in lower precision, e.g. bf16 activations,
+     * and is widened as it is read.
+     */
+    template<typename T, typename TB>
+    void spmm(const SparseMatrix<T>& a, const bool transA, const std::size_t n, const TB* b, const std::size_t ldb,
+              const T beta, T* c, const std::size_t ldc) {
+        constexpr std::size_t PANEL = 64;
+
+        const std::size_t k = transA ? a.rows : a.cols;
+        const std::size_t m = transA ? a.cols : a.rows;
+        T* __restrict packed = Detail::packBuffer<T>(0, (m + k) * PANEL).data();
+        T* __restrict result = packed + k * PANEL;
+
+        for (std::size_t j0 = 0; j0 < n; j0 += PANEL) {
+            const std::size_t width = std::min(PANEL, n - j0);
+            std::fill_n(result, m * width, T{});
+
+            if (!transA) {
+                for (std::size_t p = 0; p < k; p++) {
+                    for (std::size_t j = 0; j < width; j++) {
+                        packed[p * width + j] = static_cast<T>(b[p * ldb + j0 + j]);
+                    }
+                }
+
+                for (std::size_t i = 0; i < m; i++) {
+                    T* __restrict out = result + i * width;
+                    for (std::size_t e = a.offsets[i]; e < a.offsets[i + 1]; e++) {
+                        const T value = a.values[e];
+                        const T* __restrict in = packed + a.columns[e] * width;
+                        for (std::size_t j = 0; j < width; j++) {
+                            out[j] += value * in[j];
+                        }
+                    }
+                }
+            } else {
+                for (std::size_t i = 0; i < k; i++) {
+                    const TB* __restrict in = b + i * ldb + j0;
+                    for (std::size_t e = a.offsets[i]; e < a.offsets[i + 1]; e++) {
+                        const T value = a.values[e];
+                        T* __restrict out = result + a.columns[e] * width;
+                        for (std::size_t j = 0; j < width; j++) {
+                            out[j] += value * static_cast<T>(in[j]);
+                        }
+                    }
+                }
+            }
+
+            for (std::size_t i = 0; i < m; i++) {
+                T* row = c + i * ldc + j0;
+                for (std::size_t j = 0; j < width; j++) {
+                    row[j] = beta == T{} ? result[i * width + j] : beta * row[j] + result[i * width + j];
+                }
+            }
+        }
+    }
+
+    /**
+     * Sampled dense product, C += X * Y^T evaluated only at the entries stored in the pattern of A, where X is
+     * a.rows x n, Y is a.cols x n and C is dense a.rows x a.cols. This is the gradient of a sparse weight: the
+     * entries outside the pattern, which pruning holds at zero, cost nothing and are left untouched.
+     *
+     * The n columns are split into panels, each packing Y contiguously so the rows the entries pick stay in cache.
+     */
+    template<typename T, typename TX, typename TY>
+    void sddmm(const SparseMatrix<T>& a, const std::size_t n, const TX* x, const std::size_t ldx, const TY* y,
+               const std::size_t ldy, T* c, const std::size_t ldc) {
+        constexpr std::size_t PANEL = 256;
+        constexpr std::size_t LANES = 16;
+
+        T* __restrict packed = Detail::packBuffer<T>(0, (a.cols + 1) * PANEL).data();
+        T* __restrict lhs = packed + a.cols * PANEL;
+
+        for (std::size_t p0 = 0; p0 < n; p0 += PANEL) {
+            const std::size_t width = std::min(PANEL, n - p0);
+
+            // Zero padded to whole lanes, so the dot products need no tail
+            const std::size_t padded = (width + LANES - 1) / LANES * LANES;
+
+            for (std::size_t j = 0; j < a.cols; j++) {
+                for (std::size_t p = 0; p < padded; p++) {
+                    packed[j * padded + p] = p < width ? static_cast<T>(y[j * ldy + p0 + p]) : T{};
+                }
+            }
+
+            for (std::size_t i = 0; i < a.rows; i++) {
+                for (std::size_t p = 0; p < padded; p++) {
+                    lhs[p] = p < width ? static_cast<T>(x[i * ldx + p0 + p]) : T{};
+                }
+
+                for (std::size_t e = a.offsets[i]; e < a.offsets[i + 1]; e++) {
+                    const T* __restrict rhs = packed + a.columns[e] * padded;
+
+                    T partial[LANES] = {};
+                    for (std::size_t p = 0; p < padded; p += LANES) {
+                        for (std::size_t l = 0; l < LANES; l++) {
+                            partial[l] += lhs[p + l] * rhs[p + l];
+                        }
+                    }
+
+                    T sum = T{};
+                    for (std::size_t l = 0; l < LANES; l++) {
+                        sum += partial[l];
+                    }
+                    c[i * ldc + a.columns[e]] += sum;
+                }
+            }
+        }
+    }
+}
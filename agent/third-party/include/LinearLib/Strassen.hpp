@@ -0,0 +1,261 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <numeric>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Gemm.hpp"
+
+namespace LinearLib {
+
+    /**
+     * Preallocated scratch memory for the Strassen-Winograd recursion. Every level borrows two half-size temporaries
+     * from the top of the buffer and returns them on the way out, so a full product never touches the allocator.
+     */
+    template<typename T>
+    struct StrassenWorkspace {
+        std::vector<T> buffer;
+        std::size_t offset = 0;
+        std::size_t peak = 0;
+
+        StrassenWorkspace() = default;
+
+        StrassenWorkspace(std::size_t const n, std::size_t const cutoff) {
+            reserve(n, cutoff);
+        }
+
+        /**
+         * Scratch elements needed to multiply two n x n matrices, two (n/2)^2 temporaries per recursion level.
+         */
+        [[nodiscard]] static std::size_t required(std::size_t n, std::size_t const cutoff) {
+            std::size_t total = 0;
+            while (recurses(n, cutoff)) {
+                n /= 2;
+                total += 2 * n * n;
+            }
+            return total;
+        }
+
+        [[nodiscard]] static bool recurses(std::size_t const n, std::size_t const cutoff) {
+            return n > cutoff && n % 2 == 0;
+        }
+
+        void reserve(std::size_t const n, std::size_t const cutoff) {
+            const std::size_t size = required(n, cutoff);
+            if (buffer.size() < size) {
+                buffer.resize(size);
+            }
+        }
+
+        T* acquire(std::size_t const count) {
+            assert(offset + count <= buffer.size() && "Strassen workspace exhausted");
+            T* res = buffer.data() + offset;
+            offset += count;
+            peak = std::max(peak, offset);
+            return res;
+        }
+
+        void release(std::size_t const count) {
+            assert(count <= offset && "Releasing more workspace than acquired");
+            offset -= count;
+        }
+    };
+
+    namespace Detail {
+        template<typename T>
+        void addBlock(std::size_t const n, const T* x, std::size_t const ldx, const T* y, std::size_t const ldy, T* z,
+                      std::size_t const ldz) {
+            for (std::size_t i = 0; i < n; i++) {
+                for (std::size_t j = 0; j < n; j++) {
+                    z[i * ldz + j] = x[i * ldx + j] + y[i * ldy + j];
+                }
+            }
+        }
+
+        template<typename T>
+        void subtractBlock(std::size_t const n, const T* x, std::size_t const ldx, const T* y, std::size_t const ldy,
+                           T* z, std::size_t const ldz) {
+            for (std::size_t i = 0; i < n; i++) {
+                for (std::size_t j = 0; j < n; j++) {
+                    z[i * ldz + j] = x[i * ldx + j] - y[i * ldy + j];
+                }
+            }
+        }
+    }
+
+    /**
+     * Strassen-Winograd product C = A * B of n x n row major matrices, 7 half-size products and 15 additions per
+     * level. Recursion stops at the cutoff or on an odd dimension and hands over to the blocked gemm kernel.
+     *
+     * The schedule follows Boyer et al., "Memory efficient scheduling of Strassen-Winograd's matrix multiplication
+     * algorithm", keeping the intermediates in the quadrants of C plus two temporaries X and Y.
+     */
+    template<typename T>
+    void strassen(std::size_t const n, const T* a, std::size_t const lda, const T* b, std::size_t const ldb, T* c,
+                  std::size_t const ldc, StrassenWorkspace<T>& workspace, std::size_t const cutoff) {
+
+        if (!StrassenWorkspace<T>::recurses(n, cutoff)) {
+            gemm(false, false, n, n, n, a, lda, b, ldb, T{}, c, ldc);
+            return;
+        }
+
+        const std::size_t h = n / 2;
+
+        const T* a11 = a;
+        const T* a12 = a + h;
+        const T* a21 = a + h * lda;
+        const T* a22 = a + h * lda + h;
+
+        const T* b11 = b;
+        const T* b12 = b + h;
+        const T* b21 = b + h * ldb;
+        const T* b22 = b + h * ldb + h;
+
+        T* c11 = c;
+        T* c12 = c + h;
+        T* c21 = c + h * ldc;
+        T* c22 = c + h * ldc + h;
+
+        T* x = workspace.acquire(h * h);
+        T* y = workspace.acquire(h * h);
+
+        // S3 = A11 - A21, T3 = B22 - B12, P7 = S3 * T3
+        Detail::subtractBlock(h, a11, lda, a21, lda, x, h);
+        Detail::subtractBlock(h, b22, ldb, b12, ldb, y, h);
+        strassen(h, x, h, y, h, c21, ldc, workspace, cutoff);
+
+        // S1 = A21 + A22, T1 = B12 - B11, P5 = S1 * T1
+        Detail::addBlock(h, a21, lda, a22, lda, x, h);
+        Detail::subtractBlock(h, b12, ldb, b11, ldb, y, h);
+        strassen(h, x, h, y, h, c22, ldc, workspace, cutoff);
+
+        // S2 = S1 - A11, T2 = B22 - T1, P6 = S2 * T2
+        Detail::subtractBlock(h, x, h, a11, lda, x, h);
+        Detail::subtractBlock(h, b22, ldb, y, h, y, h);
+        strassen(h, x, h, y, h, c12, ldc, workspace, cutoff);
+
+        // S4 = A12 - S2, P3 = S4 * B22
+        Detail::subtractBlock(h, a12, lda, x, h, x, h);
+        strassen(h, x, h, b22, ldb, c11, ldc, workspace, cutoff);
+
+        // P1 = A11 * B11
+        strassen(h, a11, lda, b11, ldb, x, h, workspace, cutoff);
+
+        // U2 = P1 + P6, U3 = U2 + P7, U4 = U2 + P5, U7 = U3 + P5, U5 = U4 + P3
+        Detail::addBlock(h, x, h, c12, ldc, c12, ldc);
+        Detail::addBlock(h, c12, ldc, c21, ldc, c21, ldc);
+        Detail::addBlock(h, c12, ldc, c22, ldc, c12, ldc);
+        Detail::addBlock(h, c21, ldc, c22, ldc, c22, ldc);
+        Detail::addBlock(h, c12, ldc, c11, ldc, c12, ldc);
+
+        // T4 = T2 - B21, P4 = A22 * T4, U6 = U3 - P4
+        Detail::subtractBlock(h, y, h, b21, ldb, y, h);
+        strassen(h, a22, lda, y, h, c11, ldc, workspace, cutoff);
+        Detail::subtractBlock(h, c21, ldc, c11, ldc, c21, ldc);
+
+        // P2 = A12 * B21, U1 = P1 + P2
+        strassen(h, a12, lda, b21, ldb, c11, ldc, workspace, cutoff);
+        Detail::addBlock(h, x, h, c11, ldc, c11, ldc);
+
+        workspace.release(2 * h * h);
+    }
+
+    template<typename T>
+    void strassen(std::size_t const n, const T* a, std::size_t const lda, const T* b, std::size_t const ldb, T* c,
+                  std::size_t const ldc, std::size_t const cutoff) {
+        thread_local StrassenWorkspace<T> workspace;
+        workspace.reserve(n, cutoff);
+        strassen(n, a, lda, b, ldb, c, ldc, workspace, cutoff);
+    }
+
+    namespace Detail {
+        /**
+         * C = beta * C + op(A) * op(B) with m, n and k all multiples of s, summed from Strassen-Winograd products of
+         * s x s blocks. Transposed blocks are copied out row major first.
+         */
+        template<typename T>
+        void strassenBlocks(const bool transA, const bool transB, const std::size_t m, const std::size_t n,
+                            const std::size_t k, const std::size_t s, const T* a, const std::size_t lda, const T* b,
+                            const std::size_t ldb, const T beta, T* c, const std::size_t ldc,
+                            const std::size_t cutoff) {
+            thread_local StrassenWorkspace<T> workspace;
+            workspace.reserve(s, cutoff);
+
+            // The product of two blocks, then the transposed copies of the blocks of A and B when needed
+            thread_local std::vector<T> scratch;
+            if (scratch.size() < 3 * s * s) {
+                scratch.resize(3 * s * s);
+            }
+            T* product = scratch.data();
+
+            // Block (i, j) of op(X), as a pointer and leading dimension into X or into the copy
+            const auto block = [&](const T* x, const std::size_t ldx, const bool trans, const std::size_t i,
+                                   const std::size_t j, T* copy) {
+                if (!trans) {
+                    return std::pair(x + i * s * ldx + j * s, ldx);
+                }
+
+                // Transposed in tiles, so both the rows read and the rows written stay in cache
+                constexpr std::size_t TILE = 16;
+                for (std::size_t r0 = 0; r0 < s; r0 += TILE) {
+                    for (std::size_t q0 = 0; q0 < s; q0 += TILE) {
+                        for (std::size_t q = q0; q < std::min(q0 + TILE, s); q++) {
+                            for (std::size_t r = r0; r < std::min(r0 + TILE, s); r++) {
+                                copy[r * s + q] = x[(j * s + q) * ldx + i * s + r];
+                            }
+                        }
+                    }
+                }
+                return std::pair(static_cast<const T*>(copy), s);
+            };
+
+            for (std::size_t i = 0; i < m / s; i++) {
+                for (std::size_t p = 0; p < k / s; p++) {
+                    const auto [lhs, ldl] = block(a, lda, transA, i, p, scratch.data() + s * s);
+
+                    for (std::size_t j = 0; j < n / s; j++) {
+                        const auto [rhs, ldr] = block(b, ldb, transB, p, j, scratch.data() + 2 * s * s);
+                        strassen(s, lhs, ldl, rhs, ldr, product, s, workspace, cutoff);
+
+                        // The first block of the sum scales C by beta, overwriting it when beta is zero
+                        T* out = c + i * s * ldc + j * s;
+                        for (std::size_t r = 0; r < s; r++) {
+                            for (std::size_t q = 0; q < s; q++) {
+                                const T previous = p > 0 ? out[r * ldc + q]
+                                                         : beta == T{} ? T{} : beta * out[r * ldc + q];
+                                out[r * ldc + q] = previous + product[r * s + q];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    /**
+     * C = beta * C + op(A) * op(B), taking the gemm arguments. A product whose m, n and k are all multiples of a
+     * square block larger than the tuned cutoff, see GemmConfig, is summed from Strassen-Winograd products of such
+     * blocks, e.g. the H x H gradient of a recurrent weight over a batch of a multiple of H columns. Every other
+     * product, all of them while the cutoff is 0, and those with half precision operands go straight to gemm.
+     */
+    template<typename TA, typename TB, typename T>
+    void strassenGemm(const bool transA, const bool transB, const std::size_t m, const std::size_t n,
+                      const std::size_t k, const TA* a, const std::size_t lda, const TB* b, const std::size_t ldb,
+                      const T beta, T* c, const std::size_t ldc) {
+        if constexpr (std::is_same_v<TA, T> && std::is_same_v<TB, T>) {
+            const std::size_t cutoff = gemmConfig().strassenCutoff;
+            const std::size_t s = std::gcd(m, std::gcd(n, k));
+
+            if (cutoff != 0 && StrassenWorkspace<T>::recurses(s, cutoff)) {
+                Detail::strassenBlocks(transA, transB, m, n, k, s, a, lda, b, ldb, beta, c, ldc, cutoff);
+                return;
+            }
+        }
+
+        gemm(transA, transB, m, n, k, a, lda, b, ldb, beta, c, ldc);
+    }
+}
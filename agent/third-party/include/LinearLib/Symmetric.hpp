@@ -0,0 +1,204 @@
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <type_traits>
+
+#include "Matrix.hpp"
+
+namespace LinearLib {
+    /**
+     * Square symmetric matrix keeping only its lower triangle in packed row major storage, N(N+1)/2 elements.
+     * Rank-k updates only compute the stored half and products read each off-diagonal element once for both of
+     * the positions it stands for.
+     */
+    template<std::size_t N, typename T>
+    requires std::is_arithmetic_v<T>
+    struct Symmetric {
+        static constexpr std::size_t SIZE = N * (N + 1) / 2;
+
+        std::array<T, SIZE> data;
+
+        // Default constructor is still needed
+        Symmetric() = default;
+
+        static Symmetric identity() {
+            Symmetric res = zeros();
+
+            for (std::size_t i = 0; i < N; i++) {
+                res.at(i, i) = T{1};
+            }
+
+            return res;
+        }
+
+        static Symmetric zeros() {
+            return uniform(T{0});
+        }
+
+        static Symmetric uniform(T const val) {
+            Symmetric res;
+            res.data.fill(val);
+            return res;
+        }
+
+        /**
+         * Takes the lower triangle of a dense matrix, which is assumed to be symmetric.
+         */
+        static Symmetric fromMatrix(const Matrix<N, N, T>& mat) {
+            assert(mat.isSymmetric() && "Matrix must be symmetric");
+
+            Symmetric res;
+
+            for (std::size_t i = 0; i < N; i++) {
+                for (std::size_t j = 0; j <= i; j++) {
+                    res.at(i, j) = mat[i][j];
+                }
+            }
+
+            return res;
+        }
+
+        Matrix<N, N, T> toMatrix() const {
+            Matrix<N, N, T> res;
+
+            for (std::size_t i = 0; i < N; i++) {
+                for (std::size_t j = 0; j <= i; j++) {
+                    res[i][j] = at(i, j);
+                    res[j][i] = at(i, j);
+                }
+            }
+
+            return res;
+        }
+
+        /**
+         * Rank-k update alpha * A * A^T, e.g. the (unnormalised) covariance of the K observations in the columns of
+         * A. Only the lower triangle is computed, half the work of the dense product.
+         */
+        template<std::size_t K>
+        static Symmetric syrk(const Matrix<N, K, T>& a, T const alpha = T{1}) {
+            Symmetric res;
+
+            for (std::size_t i = 0; i < N; i++) {
+                for (std::size_t j = 0; j <= i; j++) {
+                    T sum = T{};
+                    for (std::size_t k = 0; k < K; k++) {
+                        sum += a[i][k] * a[j][k];
+                    }
+                    res.at(i, j) = alpha * sum;
+                }
+            }
+
+            return res;
+        }
+
+        /**
+         * Symmetric matrix-vector product, a single pass over the packed triangle.
+         */
+        Matrix<N, 1, T> symv(const Matrix<N, 1, T>& x) const {
+            Matrix<N, 1, T> res = Matrix<N, 1, T>::zeros();
+
+            const T* element = data.data();
+            for (std::size_t i = 0; i < N; i++) {
+                T sum = T{};
+                for (std::size_t j = 0; j < i; j++, element++) {
+                    sum += *element * x[j][0];
+                    res[j][0] += *element * x[i][0];
+                }
+                res[i][0] += sum + *element * x[i][0];
+                element++;
+            }
+
+            return res;
+        }
+
+        [[nodiscard]] static constexpr std::size_t index(std::size_t const i, std::size_t const j) {
+            return i * (i + 1) / 2 + j;
+        }
+
+        T& at(std::size_t const i, std::size_t const j) {
+            assert(j <= i && i < N && "Index outside the stored lower triangle");
+            return data[index(i, j)];
+        }
+
+        const T& at(std::size_t const i, std::size_t const j) const {
+            assert(j <= i && i < N && "Index outside the stored lower triangle");
+            return data[index(i, j)];
+        }
+
+        // Element access for any position, mirrored through the diagonal
+        T operator()(std::size_t const i, std::size_t const j) const {
+            return j <= i ? at(i, j) : at(j, i);
+        }
+
+        bool operator==(const Symmetric& other) const {
+            return data == other.data;
+        }
+
+        friend Symmetric operator+(const Symmetric& lhs, const Symmetric& rhs) {
+            Symmetric res;
+
+            for (std::size_t i = 0; i < SIZE; i++) {
+                res.data[i] = lhs.data[i] + rhs.data[i];
+            }
+
+            return res;
+        }
+
+        friend Symmetric operator*(const Symmetric& mat, const T& scalar) {
+            Symmetric res;
+
+            for (std::size_t i = 0; i < SIZE; i++) {
+                res.data[i] = mat.data[i] * scalar;
+            }
+
+            return res;
+        }
+
+        /**
+         * S * M, each stored off-diagonal element contributes to two output rows
+         */
+        template<std::size_t C>
+        friend Matrix<N, C, T> operator&(const Symmetric& lhs, const Matrix<N, C, T>& rhs) {
+            Matrix<N, C, T> res = Matrix<N, C, T>::zeros();
+
+            for (std::size_t i = 0; i < N; i++) {
+                for (std::size_t k = 0; k < i; k++) {
+                    const T scale = lhs.at(i, k);
+                    for (std::size_t j = 0; j < C; j++) {
+                        res[i][j] += scale * rhs[k][j];
+                        res[k][j] += scale * rhs[i][j];
+                    }
+                }
+                const T diagonal = lhs.at(i, i);
+                for (std::size_t j = 0; j < C; j++) {
+                    res[i][j] += diagonal * rhs[i][j];
+                }
+            }
+
+            return res;
+        }
+
+        /**
+         * M * S, each stored off-diagonal element contributes to two output columns
+         */
+        template<std::size_t R>
+        friend Matrix<R, N, T> operator&(const Matrix<R, N, T>& lhs, const Symmetric& rhs) {
+            Matrix<R, N, T> res = Matrix<R, N, T>::zeros();
+
+            for (std::size_t r = 0; r < R; r++) {
+                for (std::size_t i = 0; i < N; i++) {
+                    for (std::size_t k = 0; k < i; k++) {
+                        const T scale = rhs.at(i, k);
+                        res[r][k] += lhs[r][i] * scale;
+                        res[r][i] += lhs[r][k] * scale;
+                    }
+                    res[r][i] += lhs[r][i] * rhs.at(i, i);
+                }
+            }
+
+            return res;
+        }
+    };
+}
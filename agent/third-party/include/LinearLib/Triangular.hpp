@@ -0,0 +1,212 @@
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <type_traits>
+
+#include "Matrix.hpp"
+
+namespace LinearLib {
+    enum class Triangle {
+        Lower,
+        Upper
+    };
+
+    /**
+     * Square triangular matrix in packed row major storage, N(N+1)/2 elements. Multiplication only visits the
+     * stored half and solves run by forward or back substitution instead of a general inverse.
+     */
+    template<std::size_t N, Triangle U, typename T>
+    requires std::is_arithmetic_v<T>
+    struct Triangular {
+        static constexpr std::size_t SIZE = N * (N + 1) / 2;
+
+        std::array<T, SIZE> data;
+
+        // Default constructor is still needed
+        Triangular() = default;
+
+        static Triangular identity() {
+            Triangular res = uniform(T{0});
+
+            for (std::size_t i = 0; i < N; i++) {
+                res.at(i, i) = T{1};
+            }
+
+            return res;
+        }
+
+        static Triangular zeros() {
+            return uniform(T{0});
+        }
+
+        static Triangular uniform(T const val) {
+            Triangular res;
+            res.data.fill(val);
+            return res;
+        }
+
+        /**
+         * Keeps the stored triangle of a dense square matrix, discarding the other half.
+         */
+        static Triangular fromMatrix(const Matrix<N, N, T>& mat) {
+            Triangular res;
+
+            for (std::size_t i = 0; i < N; i++) {
+                for (std::size_t j = first(i); j < last(i); j++) {
+                    res.at(i, j) = mat[i][j];
+                }
+            }
+
+            return res;
+        }
+
+        Matrix<N, N, T> toMatrix() const {
+            Matrix<N, N, T> res = Matrix<N, N, T>::zeros();
+
+            for (std::size_t i = 0; i < N; i++) {
+                for (std::size_t j = first(i); j < last(i); j++) {
+                    res[i][j] = at(i, j);
+                }
+            }
+
+            return res;
+        }
+
+        // First and one past the last stored column of row i
+        [[nodiscard]] static constexpr std::size_t first(std::size_t const i) {
+            return U == Triangle::Lower ? 0 : i;
+        }
+
+        [[nodiscard]] static constexpr std::size_t last(std::size_t const i) {
+            return U == Triangle::Lower ? i + 1 : N;
+        }
+
+        [[nodiscard]] static constexpr std::size_t index(std::size_t const i, std::size_t const j) {
+            if constexpr (U == Triangle::Lower) {
+                return i * (i + 1) / 2 + j;
+            } else {
+                return i * N - i * (i - 1) / 2 + (j - i);
+            }
+        }
+
+        [[nodiscard]] static constexpr bool stored(std::size_t const i, std::size_t const j) {
+            return U == Triangle::Lower ? j <= i : j >= i;
+        }
+
+        T& at(std::size_t const i, std::size_t const j) {
+            assert(i < N && j < N && stored(i, j) && "Index outside the stored triangle");
+            return data[index(i, j)];
+        }
+
+        const T& at(std::size_t const i, std::size_t const j) const {
+            assert(i < N && j < N && stored(i, j) && "Index outside the stored triangle");
+            return data[index(i, j)];
+        }
+
+        // Element access for any position, zero outside the triangle
+        T operator()(std::size_t const i, std::size_t const j) const {
+            return stored(i, j) ? at(i, j) : T{0};
+        }
+
+        T determinant() const {
+            T res = T{1};
+
+            for (std::size_t i = 0; i < N; i++) {
+                res *= at(i, i);
+            }
+
+            return res;
+        }
+
+        Triangular<N, U == Triangle::Lower ? Triangle::Upper : Triangle::Lower, T> transpose() const {
+            Triangular<N, U == Triangle::Lower ? Triangle::Upper : Triangle::Lower, T> res;
+
+            for (std::size_t i = 0; i < N; i++) {
+                for (std::size_t j = first(i); j < last(i); j++) {
+                    res.at(j, i) = at(i, j);
+                }
+            }
+
+            return res;
+        }
+
+        /**
+         * Solves T * X = B for X by forward (lower) or back (upper) substitution, O(N^2 * C).
+         */
+        template<std::size_t C>
+        Matrix<N, C, T> solve(const Matrix<N, C, T>& b) const {
+            Matrix<N, C, T> res = b;
+
+            for (std::size_t step = 0; step < N; step++) {
+                const std::size_t i = U == Triangle::Lower ? step : N - 1 - step;
+
+                for (std::size_t k = first(i); k < last(i); k++) {
+                    if (k == i) {
+                        continue;
+                    }
+                    const T scale = at(i, k);
+                    for (std::size_t j = 0; j < C; j++) {
+                        res[i][j] -= scale * res[k][j];
+                    }
+                }
+
+                const T pivot = at(i, i);
+                assert(pivot != T{0} && "Singular triangular matrix");
+                for (std::size_t j = 0; j < C; j++) {
+                    res[i][j] /= pivot;
+                }
+            }
+
+            return res;
+        }
+
+        bool operator==(const Triangular& other) const {
+            return data == other.data;
+        }
+
+        /**
+         * T * M, each output row only accumulates over the stored columns of that row
+         */
+        template<std::size_t C>
+        friend Matrix<N, C, T> operator&(const Triangular& lhs, const Matrix<N, C, T>& rhs) {
+            Matrix<N, C, T> res = Matrix<N, C, T>::zeros();
+
+            for (std::size_t i = 0; i < N; i++) {
+                for (std::size_t k = first(i); k < last(i); k++) {
+                    const T scale = lhs.at(i, k);
+                    for (std::size_t j = 0; j < C; j++) {
+                        res[i][j] += scale * rhs[k][j];
+                    }
+                }
+            }
+
+            return res;
+        }
+
+        /**
+         * M * T, row k of T is only non-zero over its stored columns
+         */
+        template<std::size_t R>
+        friend Matrix<R, N, T> operator&(const Matrix<R, N, T>& lhs, const Triangular& rhs) {
+            Matrix<R, N, T> res = Matrix<R, N, T>::zeros();
+
+            for (std::size_t i = 0; i < R; i++) {
+                for (std::size_t k = 0; k < N; k++) {
+                    const T scale = lhs[i][k];
+                    for (std::size_t j = first(k); j < last(k); j++) {
+                        res[i][j] += scale * rhs.at(k, j);
+                    }
+                }
+            }
+
+            return res;
+        }
+    };
+
+    template<std::size_t N, typename T>
+    using LowerTriangular = Triangular<N, Triangle::Lower, T>;
+
+    template<std::size_t N, typename T>
+    using UpperTriangular = Triangular<N, Triangle::Upper, T>;
+}